@@ -6,6 +6,25 @@
 #include "util.h"
 #include "slip.h"
 #include "mydebug.h"
+#include "hdrview.h"
+#include "bridge.h"
+#include "capture.h"
+#include "warmstart.h"
+#include "link.h"
+#include "bench.h"
+#include "radio.h"
+#include "flows.h"
+#include "txqueue.h"
+#include "dns.h"
+#include "rxring.h"
+#include "ethertx.h"
+#include "profiler.h"
+#include "linkprobe.h"
+#include "splittcp.h"
+#include "nexthop.h"
+#include "transport.h"
+#include "trafficgen.h"
+#include "hotpath.h"
 
 extern "C" {
 #include <netif/wlan_lwip_if.h>
@@ -29,9 +48,8 @@ IPAddress OurIPAddress;
 IPAddress OurNetmask;
 IPAddress OurGateway;
 
-static uint8_t RXPacketBuffer[ 4096 ];
-static volatile int RXPacketLength = 0;
-static volatile int RXPacketBusy = 0;
+/* Deferred pbufs are copied out here so the bridge sees the same alignment as a ring record */
+static uint8_t RXPacketBuffer[ EtherFrameHeadroom + RXRingMaxFrameLen ] __attribute__( ( aligned( 4 ) ) );
 
 volatile int RXBytesRead = 0;
 volatile int RXBytesDropped = 0;
@@ -39,75 +57,103 @@ volatile int RXBytesDropped = 0;
 volatile int TXBytesSent = 0;
 volatile int TXBytesDropped = 0;
 
-struct BufferEntry {
-  uint8_t Buffer[ 2048 ];
-  volatile int Length;
-};
+/*
+ * Copies each pbuf of a deferred chain out to the bridge, then frees it.
+ */
+static void FASTPATH PlaybackDeferred( struct pbuf* p ) {
+  struct pbuf* Ptr = NULL;
 
-#define PacketBufferCount 8
+  for ( Ptr = p; Ptr; Ptr = Ptr->next ) {
+    if ( Ptr->len <= 0 || Ptr->len > RXRingMaxFrameLen ) {
+      RXBytesDropped+= Ptr->len;
+      continue;
+    }
 
-static struct BufferEntry PacketBuffers[ PacketBufferCount ];
-volatile static struct BufferEntry* BufferHead = &PacketBuffers[ PacketBufferCount - 1 ];
-volatile static struct BufferEntry* BufferTail = &PacketBuffers[ 0 ];
+    memcpy( &RXPacketBuffer[ EtherFrameHeadroom ], Ptr->payload, Ptr->len );
+    RXBytesRead+= Ptr->len;
 
-int AddBufferToRing( uint8_t* Buffer, int Length ) {
-  int Result = 0;
+    OnDataReceived( &RXPacketBuffer[ EtherFrameHeadroom ], Ptr->len );
+  }
 
-  if ( ! BufferHead->Length ) 
-    Result = 1;
+  noInterrupts( );
+  pbuf_free( p );
+  interrupts( );
+}
 
-  memcpy( ( void* ) BufferHead->Buffer, Buffer, Length );
+/*
+ * Hands the oldest frame in the receive ring, or failing that the oldest deferred pbuf, to the bridge.
+ * Returns 1 if there was one.
+ */
+int FASTPATH PlaybackBuffer( void ) {
+  const uint8_t* Frame = NULL;
+  struct pbuf* p = NULL;
+  int Length = 0;
 
-  BufferHead->Length = Length;
-  BufferHead++;
+  if ( ( Frame = RXRing_Peek( &Length ) ) != NULL ) {
+    OnDataReceived( Frame, Length );
+    RXRing_Release( );
 
-  if ( BufferHead >= &PacketBuffers[ PacketBufferCount ] )
-    BufferHead = &PacketBuffers[ 0 ];
+    return 1;
+  }
 
-  return Result;
-}
+  if ( ( p = RXRing_TakeDeferred( ) ) != NULL ) {
+    PlaybackDeferred( p );
+    return 1;
+  }
 
-int PlaybackBuffer( void ) {
-  int Result = 0;
+  return 0;
+}
 
-  if ( BufferTail->Length ) {
-    OnDataReceived( ( const uint8_t* ) BufferTail->Buffer, BufferTail->Length );
-    BufferTail->Length = 0;
+/*
+ * Hands up to RXDrainBudget WiFi frames to the bridge, giving the serial side a turn after each one.
+ * A burst from either side can't hold up the other or the rest of the loop for more than one pass.
+ */
+static void FASTPATH PollWiFiRX( void ) {
+  int Count = 0;
 
-    Result = 1;
+  while ( Count < RXDrainBudget && PlaybackBuffer( ) ) {
+    Count++;
+    SLIP_Tick( );
   }
 
-  BufferTail++;
-
-  if ( BufferTail >= &PacketBuffers[ PacketBufferCount ] )
-    BufferTail = &PacketBuffers[ 0 ];
-
-  return 0;
+  RXRing_CountDrain( Count );
 }
 
 /*
  * Called by the hardware WiFi stack whenever a packet is received. 
  */
-err_t MyInputFn( struct pbuf* p, struct netif* inp ) {
+err_t FASTPATH MyInputFn( struct pbuf* p, struct netif* inp ) {
+  uint32_t Start = ESP.getCycleCount( );
   struct pbuf* Ptr = NULL;
   struct pbuf* Temp = NULL;
   int Count = 0;
 
   noInterrupts( );
 
-  for ( Ptr = p; Ptr; Count++ ) {
-    if ( Ptr->len > sizeof( BufferHead->Buffer ) ) {
-      RXBytesDropped+= Ptr->len;
-      DebugPrintf( "len > buffer size!\n" );
-    } else {
-      if ( AddBufferToRing( ( uint8_t* ) Ptr->payload, Ptr->len ) == 0 ) {
-        DebugPrintf( "Overwrote packet in ring buffer!\n" );
+  Radio_CountPacket( );
+
+  /* Ring is backing up, just keep hold of the pbuf and let the main loop copy it */
+  if ( RXRing_IsDeferring( ) ) {
+    /* Copying it into the ring instead would put it ahead of older deferred frames */
+    if ( RXRing_Defer( p ) == 0 ) {
+      for ( Ptr = p; Ptr; Ptr = Ptr->next )
         RXBytesDropped+= Ptr->len;
-      } else {
-        RXBytesRead+= Ptr->len;
-      }
+
+      pbuf_free( p );
     }
 
+    RXRing_CountCallback( ESP.getCycleCount( ) - Start );
+    interrupts( );
+
+    return 0;
+  }
+
+  for ( Ptr = p; Ptr; Count++ ) {
+    if ( RXRing_Write( ( const uint8_t* ) Ptr->payload, Ptr->len ) == 0 )
+      RXBytesDropped+= Ptr->len;
+    else
+      RXBytesRead+= Ptr->len;
+
     Temp = Ptr->next;
     pbuf_free( Ptr );
     Ptr = Temp;
@@ -115,11 +161,16 @@ err_t MyInputFn( struct pbuf* p, struct netif* inp ) {
 
   //DebugPrintf( "Processed %d pbufs\n", Count );
 
+  RXRing_CountCallback( ESP.getCycleCount( ) - Start );
   interrupts( );
   return 0;
 }
 
 err_t MyOutputFn( struct netif* inp, struct pbuf* p, ip_addr_t* ipaddr ) {
+  /* lwIP's own connections for the split TCP proxy go out as normal */
+  if ( SplitTCP_IsProxyOutput( p ) )
+    return SplitTCP_Output( inp, p, ipaddr );
+
   noInterrupts( );
   pbuf_free( p );
   interrupts( );
@@ -128,6 +179,9 @@ err_t MyOutputFn( struct netif* inp, struct pbuf* p, ip_addr_t* ipaddr ) {
 }
 
 err_t MyLinkoutputFn( struct netif* inp, struct pbuf* p ) {
+  if ( SplitTCP_IsLinkOutputAllowed( ) )
+    return OriginalLinkoutputFn( inp, p );
+
   noInterrupts( );
   pbuf_free( p );
   interrupts( );
@@ -135,44 +189,60 @@ err_t MyLinkoutputFn( struct netif* inp, struct pbuf* p ) {
   return 0;
 }
 
-int ConnectToWiFi( int Timeout ) {
+/*
+ * Connects to the configured network, if WarmState is given we go straight to
+ * the cached BSSID and channel instead of doing a full scan.
+ */
+int COLDPATH ConnectToWiFi( int Timeout, const struct WarmStartState* WarmState ) {
   uint32_t WhenToGiveUp = millis( ) + Timeout;
+  uint32_t NextDot = 0;
+  uint32_t Now = 0;
 
   Serial1.print( "Connecting to " );
   Serial1.print( SSID );
-  Serial1.print( "..." );
-  
-  WiFi.begin( SSID, Password );
+  Serial1.print( WarmState ? " (warm)..." : "..." );
+
+  if ( WarmState )
+    WiFi.begin( SSID, Password, WarmState->Channel, WarmState->BSSID );
+  else
+    WiFi.begin( SSID, Password );
+
   WiFi.config( OurIPAddress, OurGateway, OurNetmask );
 
-  while ( millis( ) < WhenToGiveUp ) {
-    switch ( WiFi.status( ) ) {
-      case WL_CONNECTED: {
-        return 1;
-      }
-      default: {
-        Serial1.print( "." );
-        delay( 500 );
-        
-        continue;
-      }
-    };
+  while ( ( Now = millis( ) ) < WhenToGiveUp ) {
+    if ( WiFi.status( ) == WL_CONNECTED )
+      return 1;
 
-    yield( );
+    if ( Now >= NextDot ) {
+      Serial1.print( "." );
+      NextDot = Now + 500;
+    }
+
+    delay( 5 );
   }
   
   return 0;
 }
 
-void setup( void ) {
+void COLDPATH setup( void ) {
+  struct WarmStartState WarmState;
+  int HaveWarmState = 0;
   int i = 0;
 
-  memset( PacketBuffers, 0, sizeof( PacketBuffers ) );
-
   OurIPAddress = IPAddress( 192, 168, 2, 177 );
   OurNetmask = IPAddress( 255, 255, 255, 0 );
   OurGateway = IPAddress( 192, 168, 2, 1 );
 
+  if ( ( HaveWarmState = WarmStart_Load( &WarmState ) ) != 0 ) {
+    OurIPAddress = WarmState.IPAddress;
+    OurNetmask = WarmState.Netmask;
+    OurGateway = WarmState.Gateway;
+  }
+
+  /* Don't rewrite the flash config on every WiFi.begin( ) */
+  WiFi.persistent( false );
+  WiFi.mode( WIFI_STA );
+
   WiFi.macAddress( OurMACAddress );
 
   if ( ( ESPif = eagle_lwip_getif( 0 ) ) != NULL ) {
@@ -185,18 +255,29 @@ void setup( void ) {
     ESPif->input = MyInputFn;
   }  
 
-  Serial.begin( 115200 );
+  SLIPLink->Begin( SLIPBaudRate );
   Serial1.begin( 115200 );
 
-  while ( ! Serial || ! Serial1 )
+  while ( ! Serial1 )
     yield( );
 
   Serial1.println( "\nReady..." );
-  Serial.setTimeout( 0 );
 
-  do {
-    IsConnectedToWiFi = ConnectToWiFi( 10000 );
-  } while ( ! IsConnectedToWiFi );
+  /*
+   * Before WiFi.begin( ) so MyInputFn can't put real frames in the RX ring the
+   * benchmarks use, and before ARP_Init( ) since it fills the ARP table with junk.
+   */
+  Bench_Run( );
+
+  if ( HaveWarmState ) {
+    if ( ( IsConnectedToWiFi = ConnectToWiFi( WarmStartConnectTimeoutMS, &WarmState ) ) == 0 ) {
+      WarmStart_Invalidate( );
+      HaveWarmState = 0;
+    }
+  }
+
+  while ( ! IsConnectedToWiFi )
+    IsConnectedToWiFi = ConnectToWiFi( 10000, NULL );
 
   Serial1.println( " Connected!" );
   Serial1.print( "Local IP: " );
@@ -206,14 +287,42 @@ void setup( void ) {
   OurIPAddress = WiFi.localIP( );
 
   ARP_Init( );
+  EtherTX_Init( );
+  WarmStart_Save( );
+
+  if ( HaveWarmState )
+    WarmStart_SeedNeighbors( &WarmState );
+
+  Radio_Init( );
+  SplitTCP_Init( );
+  Capture_Start( CaptureMaxSnapLen, CaptureDir_Both );
+  Profiler_Start( ProfilerDefaultHz );
+  TrafficGen_Start( TrafficGenDefaultSide, TrafficGenDefaultSize, TrafficGenDefaultRate, TrafficGenDefaultDurationMS );
 }
 
-void HeartBeat_Tick( void ) {
+void COLDPATH HeartBeat_Tick( void ) {
   static uint32_t NextTick = 0;
   uint32_t Now = millis( );
 
   if ( Now >= NextTick ) {
    DebugPrintf( "%s: RX Bytes Read/Dropped [%d,%d] / TX Bytes Written/Dropped [%d,%d]\n", __FUNCTION__, RXBytesRead, RXBytesDropped, TXBytesSent, TXBytesDropped );
+#if defined ( BRIDGE_VALIDATE_INGRESS )
+   DebugPrintf( "%s: Ingress errors runt/version/IHL/length/checksum [%u,%u,%u,%u,%u]\n", __FUNCTION__, BridgeIngressErrors[ IngressError_Runt ], BridgeIngressErrors[ IngressError_Version ],
+    BridgeIngressErrors[ IngressError_HeaderLength ], BridgeIngressErrors[ IngressError_TotalLength ], BridgeIngressErrors[ IngressError_Checksum ] );
+#endif
+   RXRing_DumpStats( );
+   SLIP_DumpStats( );
+   LinkProbe_DumpStats( );
+   EtherTX_DumpStats( );
+   NextHop_DumpStats( );
+   TXQueue_DumpStats( );
+   Link_DumpStats( );
+   DNS_DumpStats( );
+   SplitTCP_DumpStats( );
+   Radio_DumpStats( );
+   Capture_DumpStats( );
+   Profiler_DumpStats( );
+   TrafficGen_DumpStats( );
    NextTick = Now + SecondsToMS( 10 );
   }
 
@@ -221,18 +330,29 @@ void HeartBeat_Tick( void ) {
 
 void loop( void ) {
   while ( 1 ) {
+    Link_Tick( );
+
+    /* Also drops frames still waiting on the driver when the link goes down */
+    EtherTX_Tick( );
+
     if ( IsConnectedToWiFi ) {
       ARP_Tick( );
+      WarmStart_Tick( );
+      Radio_Tick( );
+      Flow_Tick( );
 
-      while ( PlaybackBuffer( ) ) {
-        SLIP_Tick( );
-        yield( );
-      }
+      PollWiFiRX( );
 
-      HeartBeat_Tick( );
-      SLIP_Tick( );
+      Capture_Tick( );
     }
 
+    /* Keep reading the serial side while WiFi is down so packets get held, not lost */
+    HeartBeat_Tick( );
+    LinkProbe_Tick( );
+    TrafficGen_Tick( );
+    Profiler_Tick( );
+    SLIP_Tick( );
+
     yield( );
   }
 }
@@ -0,0 +1,379 @@
+#include <string.h>
+#include "arq.h"
+
+static const uint16_t ARQCRCTable[ 256 ] = {
+    0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+    0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF,
+    0x1231, 0x0210, 0x3273, 0x2252, 0x52B5, 0x4294, 0x72F7, 0x62D6,
+    0x9339, 0x8318, 0xB37B, 0xA35A, 0xD3BD, 0xC39C, 0xF3FF, 0xE3DE,
+    0x2462, 0x3443, 0x0420, 0x1401, 0x64E6, 0x74C7, 0x44A4, 0x5485,
+    0xA56A, 0xB54B, 0x8528, 0x9509, 0xE5EE, 0xF5CF, 0xC5AC, 0xD58D,
+    0x3653, 0x2672, 0x1611, 0x0630, 0x76D7, 0x66F6, 0x5695, 0x46B4,
+    0xB75B, 0xA77A, 0x9719, 0x8738, 0xF7DF, 0xE7FE, 0xD79D, 0xC7BC,
+    0x48C4, 0x58E5, 0x6886, 0x78A7, 0x0840, 0x1861, 0x2802, 0x3823,
+    0xC9CC, 0xD9ED, 0xE98E, 0xF9AF, 0x8948, 0x9969, 0xA90A, 0xB92B,
+    0x5AF5, 0x4AD4, 0x7AB7, 0x6A96, 0x1A71, 0x0A50, 0x3A33, 0x2A12,
+    0xDBFD, 0xCBDC, 0xFBBF, 0xEB9E, 0x9B79, 0x8B58, 0xBB3B, 0xAB1A,
+    0x6CA6, 0x7C87, 0x4CE4, 0x5CC5, 0x2C22, 0x3C03, 0x0C60, 0x1C41,
+    0xEDAE, 0xFD8F, 0xCDEC, 0xDDCD, 0xAD2A, 0xBD0B, 0x8D68, 0x9D49,
+    0x7E97, 0x6EB6, 0x5ED5, 0x4EF4, 0x3E13, 0x2E32, 0x1E51, 0x0E70,
+    0xFF9F, 0xEFBE, 0xDFDD, 0xCFFC, 0xBF1B, 0xAF3A, 0x9F59, 0x8F78,
+    0x9188, 0x81A9, 0xB1CA, 0xA1EB, 0xD10C, 0xC12D, 0xF14E, 0xE16F,
+    0x1080, 0x00A1, 0x30C2, 0x20E3, 0x5004, 0x4025, 0x7046, 0x6067,
+    0x83B9, 0x9398, 0xA3FB, 0xB3DA, 0xC33D, 0xD31C, 0xE37F, 0xF35E,
+    0x02B1, 0x1290, 0x22F3, 0x32D2, 0x4235, 0x5214, 0x6277, 0x7256,
+    0xB5EA, 0xA5CB, 0x95A8, 0x8589, 0xF56E, 0xE54F, 0xD52C, 0xC50D,
+    0x34E2, 0x24C3, 0x14A0, 0x0481, 0x7466, 0x6447, 0x5424, 0x4405,
+    0xA7DB, 0xB7FA, 0x8799, 0x97B8, 0xE75F, 0xF77E, 0xC71D, 0xD73C,
+    0x26D3, 0x36F2, 0x0691, 0x16B0, 0x6657, 0x7676, 0x4615, 0x5634,
+    0xD94C, 0xC96D, 0xF90E, 0xE92F, 0x99C8, 0x89E9, 0xB98A, 0xA9AB,
+    0x5844, 0x4865, 0x7806, 0x6827, 0x18C0, 0x08E1, 0x3882, 0x28A3,
+    0xCB7D, 0xDB5C, 0xEB3F, 0xFB1E, 0x8BF9, 0x9BD8, 0xABBB, 0xBB9A,
+    0x4A75, 0x5A54, 0x6A37, 0x7A16, 0x0AF1, 0x1AD0, 0x2AB3, 0x3A92,
+    0xFD2E, 0xED0F, 0xDD6C, 0xCD4D, 0xBDAA, 0xAD8B, 0x9DE8, 0x8DC9,
+    0x7C26, 0x6C07, 0x5C64, 0x4C45, 0x3CA2, 0x2C83, 0x1CE0, 0x0CC1,
+    0xEF1F, 0xFF3E, 0xCF5D, 0xDF7C, 0xAF9B, 0xBFBA, 0x8FD9, 0x9FF8,
+    0x6E17, 0x7E36, 0x4E55, 0x5E74, 0x2E93, 0x3EB2, 0x0ED1, 0x1EF0
+};
+
+/*
+ * CRC-16/CCITT-FALSE of Length bytes.
+ */
+uint16_t ARQ_CRC16( const uint8_t* Data, int Length ) {
+    uint16_t CRC = 0xFFFF;
+    int i = 0;
+
+    for ( i = 0; i < Length; i++ )
+        CRC = ( uint16_t ) ( ( CRC << 8 ) ^ ARQCRCTable[ ( ( CRC >> 8 ) ^ Data[ i ] ) & 0xFF ] );
+
+    return CRC;
+}
+
+/*
+ * Resets both directions, BaudRate is used to work out retransmit timeouts.
+ */
+void ARQ_Init( struct ARQContext* Context, uint32_t BaudRate ) {
+    memset( Context, 0, sizeof( struct ARQContext ) );
+
+    Context->BaudRate = BaudRate ? BaudRate : 115200;
+}
+
+/*
+ * Returns 1 if Frame looks like an ARQ frame, the CRC isn't checked here.
+ */
+int ARQ_IsFrame( const uint8_t* Frame, int Length ) {
+    return ( Length > 0 && Frame[ 0 ] == ARQMarker ) ? 1 : 0;
+}
+
+/*
+ * Returns 1 if there is room in the window for another frame.
+ */
+int ARQ_CanSend( const struct ARQContext* Context ) {
+    return ( uint8_t ) ( Context->NextSeq - Context->SendBase ) < ARQWindowSize ? 1 : 0;
+}
+
+/*
+ * How long to wait for the ack of a Length byte payload: its own time on the
+ * wire plus a full frame the other side may be in the middle of sending.
+ */
+static uint32_t ARQ_Timeout( const struct ARQContext* Context, int Length ) {
+    uint32_t Bytes = ( uint32_t ) Length + ARQMaxPayload + ( 2 * ARQOverhead );
+
+    /* 10 bits per byte, SLIP escapes are left to the slack */
+    return ( ( Bytes * 10000 ) / Context->BaudRate ) + ARQRetransmitSlackMS;
+}
+
+/*
+ * Bitmap of the frames after RecvNext we are already holding.
+ */
+static uint8_t ARQ_SACK( const struct ARQContext* Context ) {
+    uint8_t Bits = 0;
+    int i = 0;
+
+    for ( i = 0; i < ARQWindowSize - 1; i++ ) {
+        if ( Context->RX[ ( uint8_t ) ( Context->RecvNext + 1 + i ) % ARQWindowSize ].IsUsed )
+            Bits|= 1 << i;
+    }
+
+    return ( uint8_t ) ( ( Bits << ARQFlag_SACKShift ) & ARQFlag_SACKMask );
+}
+
+static int ARQ_BuildFrame( struct ARQContext* Context, uint8_t Flags, uint8_t Seq, const uint8_t* Payload, int Length, uint8_t* Out, int MaxOut ) {
+    uint16_t CRC = 0;
+
+    if ( ( Length + ARQOverhead ) > MaxOut )
+        return 0;
+
+    if ( ( Flags & ARQFlag_AckOnly ) == 0 ) {
+        Flags|= ( ( uint8_t ) ( Seq - Context->SendBase ) << ARQFlag_BaseShift ) & ARQFlag_BaseMask;
+
+        if ( Context->IsTXSynced == 0 )
+            Flags|= ARQFlag_Sync;
+    }
+
+    Out[ 0 ] = ARQMarker;
+    Out[ 1 ] = Flags | ARQ_SACK( Context );
+    Out[ 2 ] = Seq;
+    Out[ 3 ] = Context->RecvNext;
+
+    if ( Length > 0 )
+        memcpy( &Out[ ARQHeaderLen ], Payload, Length );
+
+    CRC = ARQ_CRC16( Out, ARQHeaderLen + Length );
+
+    Out[ ARQHeaderLen + Length ] = ( uint8_t ) ( CRC >> 8 );
+    Out[ ARQHeaderLen + Length + 1 ] = ( uint8_t ) CRC;
+
+    /* Whatever we send carries our acks */
+    Context->AckPending = 0;
+
+    return Length + ARQOverhead;
+}
+
+static void ARQ_AdvanceSendBase( struct ARQContext* Context ) {
+    struct ARQSlot* Slot = NULL;
+
+    while ( Context->SendBase != Context->NextSeq ) {
+        Slot = &Context->TX[ Context->SendBase % ARQWindowSize ];
+
+        if ( Slot->IsAcked == 0 )
+            break;
+
+        Slot->IsUsed = 0;
+        Context->SendBase++;
+    }
+}
+
+/*
+ * Keeps a copy of Payload for retransmission and builds its frame in Out.
+ * Returns the frame length, 0 if the window is full or it doesn't fit.
+ */
+int ARQ_Send( struct ARQContext* Context, uint32_t Now, const uint8_t* Payload, int Length, uint8_t* Out, int MaxOut ) {
+    struct ARQSlot* Slot = &Context->TX[ Context->NextSeq % ARQWindowSize ];
+    int FrameLength = 0;
+
+    if ( ARQ_CanSend( Context ) == 0 || Length > ARQMaxPayload )
+        return 0;
+
+    if ( ( FrameLength = ARQ_BuildFrame( Context, 0, Context->NextSeq, Payload, Length, Out, MaxOut ) ) == 0 )
+        return 0;
+
+    memcpy( Slot->Payload, Payload, Length );
+
+    Slot->Length = ( uint16_t ) Length;
+    Slot->SentAt = Now;
+    Slot->IsUsed = 1;
+    Slot->IsAcked = 0;
+    Slot->Retries = 0;
+    Slot->FastRetransmitted = 0;
+
+    Context->NextSeq++;
+    Context->FramesSent++;
+
+    return FrameLength;
+}
+
+/*
+ * Builds the next frame that needs to go again, either because it was
+ * reported missing or it timed out. Returns the frame length or 0.
+ */
+int ARQ_Retransmit( struct ARQContext* Context, uint32_t Now, uint8_t* Out, int MaxOut ) {
+    struct ARQSlot* Slot = NULL;
+    uint8_t Seq = 0;
+
+    for ( Seq = Context->SendBase; Seq != Context->NextSeq; Seq++ ) {
+        Slot = &Context->TX[ Seq % ARQWindowSize ];
+
+        if ( Slot->IsAcked )
+            continue;
+
+        /* 1 is a fast retransmit asked for by a gap in the other side's acks, only ever done once */
+        if ( Slot->FastRetransmitted == 1 ) {
+            Slot->FastRetransmitted = 2;
+            Context->FastRetransmits++;
+        } else {
+            if ( ( uint32_t ) ( Now - Slot->SentAt ) < ARQ_Timeout( Context, Slot->Length ) )
+                continue;
+
+            /* Drop it, the next frame we send tells the receiver not to wait for it */
+            if ( ++Slot->Retries > ARQMaxRetries ) {
+                Slot->IsAcked = 1;
+                Context->GiveUps++;
+
+                continue;
+            }
+        }
+
+        Slot->SentAt = Now;
+        Context->Retransmits++;
+
+        return ARQ_BuildFrame( Context, 0, Seq, Slot->Payload, Slot->Length, Out, MaxOut );
+    }
+
+    ARQ_AdvanceSendBase( Context );
+    return 0;
+}
+
+/*
+ * Builds a frame that only carries our acks if we owe the other side one.
+ * Returns the frame length or 0.
+ */
+int ARQ_Ack( struct ARQContext* Context, uint8_t* Out, int MaxOut ) {
+    if ( Context->AckPending == 0 )
+        return 0;
+
+    return ARQ_BuildFrame( Context, ARQFlag_AckOnly, Context->NextSeq, NULL, 0, Out, MaxOut );
+}
+
+static void ARQ_OnAck( struct ARQContext* Context, uint8_t Ack, uint8_t Flags ) {
+    uint8_t InFlight = ( uint8_t ) ( Context->NextSeq - Context->SendBase );
+    uint8_t Seq = 0;
+    struct ARQSlot* Slot = NULL;
+    int HasSACK = 0;
+    int i = 0;
+
+    /* Stale, or from before one of us restarted */
+    if ( ( uint8_t ) ( Ack - Context->SendBase ) > InFlight )
+        return;
+
+    for ( Seq = Context->SendBase; Seq != Ack; Seq++ ) {
+        Context->TX[ Seq % ARQWindowSize ].IsAcked = 1;
+        Context->IsTXSynced = 1;
+    }
+
+    for ( i = 0; i < ARQWindowSize - 1; i++ ) {
+        Seq = ( uint8_t ) ( Ack + 1 + i );
+
+        if ( ( Flags & ( 1 << ( ARQFlag_SACKShift + i ) ) ) && ( uint8_t ) ( Seq - Context->SendBase ) < InFlight ) {
+            Context->TX[ Seq % ARQWindowSize ].IsAcked = 1;
+            Context->IsTXSynced = 1;
+
+            HasSACK = 1;
+        }
+    }
+
+    /* Something sent after Ack made it across, so Ack itself didn't */
+    if ( HasSACK && ( uint8_t ) ( Ack - Context->SendBase ) < InFlight ) {
+        Slot = &Context->TX[ Ack % ARQWindowSize ];
+
+        if ( Slot->IsAcked == 0 && Slot->FastRetransmitted == 0 )
+            Slot->FastRetransmitted = 1;
+    }
+
+    ARQ_AdvanceSendBase( Context );
+}
+
+/*
+ * Moves RecvNext up to Seq, handing over whatever was waiting on the way and skipping the gaps.
+ */
+static int ARQ_SkipTo( struct ARQContext* Context, uint8_t Seq, ARQDeliverFn Deliver, void* User ) {
+    struct ARQSlot* Slot = NULL;
+    int Delivered = 0;
+
+    while ( Context->RecvNext != Seq ) {
+        Slot = &Context->RX[ Context->RecvNext % ARQWindowSize ];
+        Context->RecvNext++;
+
+        if ( Slot->IsUsed ) {
+            Slot->IsUsed = 0;
+
+            Deliver( User, Slot->Payload, Slot->Length );
+            Delivered++;
+        } else {
+            Context->Skipped++;
+        }
+    }
+
+    return Delivered;
+}
+
+/*
+ * Handles a received ARQ frame, calling Deliver for every payload that is now in order.
+ * Returns the number of payloads delivered, or -1 if the frame was damaged.
+ */
+int ARQ_Receive( struct ARQContext* Context, const uint8_t* Frame, int Length, ARQDeliverFn Deliver, void* User ) {
+    int PayloadLength = Length - ARQOverhead;
+    struct ARQSlot* Slot = NULL;
+    uint8_t Distance = 0;
+    uint8_t Flags = 0;
+    uint8_t Seq = 0;
+    uint8_t Base = 0;
+    int Delivered = 0;
+    int i = 0;
+
+    if ( ARQ_IsFrame( Frame, Length ) == 0 || PayloadLength < 0 || PayloadLength > ARQMaxPayload ||
+        ( ( ( uint16_t ) Frame[ Length - 2 ] << 8 ) | Frame[ Length - 1 ] ) != ARQ_CRC16( Frame, Length - 2 ) ) {
+        Context->CRCErrors++;
+        return -1;
+    }
+
+    Flags = Frame[ 1 ];
+    Seq = Frame[ 2 ];
+
+    ARQ_OnAck( Context, Frame[ 3 ], Flags );
+
+    if ( Flags & ARQFlag_AckOnly )
+        return 0;
+
+    Context->AckPending = 1;
+    Base = ( uint8_t ) ( Seq - ( ( Flags & ARQFlag_BaseMask ) >> ARQFlag_BaseShift ) );
+
+    /* A sender that restarted or gave up on a frame, unless this is just a late copy of something we have */
+    if ( Context->IsRXSynced == 0 || ( ( Flags & ARQFlag_Sync ) && ( uint8_t ) ( Base - Context->RecvNext ) >= ARQWindowSize && ( uint8_t ) ( Context->RecvNext - Base ) > ARQWindowSize ) ) {
+        for ( i = 0; i < ARQWindowSize; i++ )
+            Context->RX[ i ].IsUsed = 0;
+
+        Context->RecvNext = Base;
+        Context->IsRXSynced = 1;
+        Context->Resyncs++;
+    }
+
+    /* The sender has nothing older than Base any more, acked or given up on */
+    if ( ( uint8_t ) ( Base - Context->RecvNext ) < 128 )
+        Delivered+= ARQ_SkipTo( Context, Base, Deliver, User );
+
+    Distance = ( uint8_t ) ( Seq - Context->RecvNext );
+
+    /* Already delivered, our ack must have been lost */
+    if ( Distance >= ARQWindowSize ) {
+        Context->Duplicates++;
+        Context->FramesDelivered+= Delivered;
+
+        return Delivered;
+    }
+
+    if ( Distance > 0 ) {
+        Slot = &Context->RX[ Seq % ARQWindowSize ];
+
+        if ( Slot->IsUsed ) {
+            Context->Duplicates++;
+        } else {
+            memcpy( Slot->Payload, &Frame[ ARQHeaderLen ], PayloadLength );
+
+            Slot->Length = ( uint16_t ) PayloadLength;
+            Slot->IsUsed = 1;
+
+            Context->OutOfOrder++;
+        }
+
+        Context->FramesDelivered+= Delivered;
+        return Delivered;
+    }
+
+    Context->RecvNext++;
+    Deliver( User, &Frame[ ARQHeaderLen ], PayloadLength );
+    Delivered++;
+
+    /* The gap is filled, hand over everything that was waiting behind it */
+    while ( Context->RX[ Context->RecvNext % ARQWindowSize ].IsUsed ) {
+        Slot = &Context->RX[ Context->RecvNext % ARQWindowSize ];
+        Slot->IsUsed = 0;
+
+        Context->RecvNext++;
+        Deliver( User, Slot->Payload, Slot->Length );
+        Delivered++;
+    }
+
+    Context->FramesDelivered+= Delivered;
+    return Delivered;
+}
@@ -0,0 +1,155 @@
+#ifndef _ARQ_H_
+#define _ARQ_H_
+
+/*
+ * Selective repeat ARQ for the serial link.
+ * Plain C with no Arduino dependencies so the host side (tools/slipz.c)
+ * builds the exact same file.
+ *
+ * Every frame inside the SLIP framing looks like:
+ *
+ *   Marker | Flags | Seq | Ack | Payload ... | CRC-16 (big endian)
+ *
+ * Ack is the next sequence number we expect and Flags carries a bitmap of
+ * the (ARQWindowSize - 1) frames after it that we already hold, so every
+ * frame in either direction acknowledges everything we have. The CRC is
+ * CRC-16/CCITT-FALSE over everything before it.
+ *
+ * A frame that fails the CRC is dropped. When later frames arrive the
+ * bitmap shows the gap and the sender repeats just the missing frame
+ * straight away, otherwise it goes again after a timeout worked out from
+ * the baud rate. Frames are delivered in order.
+ *
+ * Data frames also say how far they are past the oldest frame the sender
+ * still holds. The receiver never waits for anything older than that, so
+ * a frame the sender gave up on doesn't stall the link. A sender marks its
+ * frames with ARQFlag_Sync until the first ack, which lets a receiver that
+ * still has state from before a restart start over.
+ * The header is 4 bytes so the payload keeps the alignment of the frame.
+ */
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* First byte of an ARQ frame, after IPv4 (0x4X) and compressed frames (0x50) */
+#define ARQMarker 0x51
+
+/* Up to 4 since the selective ack bitmap has 3 bits */
+#define ARQWindowSize 4
+
+#define ARQMaxPayload 1500
+
+#define ARQHeaderLen 4
+#define ARQOverhead ( ARQHeaderLen + 2 )
+
+/* Added to the retransmit timeout on top of the time the frames take on the wire */
+#define ARQRetransmitSlackMS 20
+
+/* A frame is given up on after this many retransmits, the receiver skips it */
+#define ARQMaxRetries 8
+
+enum {
+    ARQFlag_AckOnly = 0x01,
+    ARQFlag_Sync = 0x02,
+
+    /* How far this frame is past the oldest one the sender still holds, so a resync starts there */
+    ARQFlag_BaseShift = 2,
+    ARQFlag_BaseMask = 0x0C,
+
+    /* Bit n set: Ack + 1 + n has been received */
+    ARQFlag_SACKShift = 4,
+    ARQFlag_SACKMask = 0x70
+};
+
+struct ARQSlot {
+    uint8_t Payload[ ARQMaxPayload ];
+    uint32_t SentAt;
+    uint16_t Length;
+    uint8_t IsUsed;
+    uint8_t IsAcked;
+    uint8_t Retries;
+    uint8_t FastRetransmitted;
+} __attribute__( ( aligned( 4 ) ) );
+
+/*
+ * Both directions of one end of the link, about 2 * ARQWindowSize * ARQMaxPayload bytes.
+ */
+struct ARQContext {
+    struct ARQSlot TX[ ARQWindowSize ];
+    struct ARQSlot RX[ ARQWindowSize ];
+
+    uint32_t BaudRate;
+
+    uint8_t SendBase;
+    uint8_t NextSeq;
+    uint8_t RecvNext;
+    uint8_t IsTXSynced;
+    uint8_t IsRXSynced;
+    uint8_t AckPending;
+
+    uint32_t FramesSent;
+    uint32_t FramesDelivered;
+    uint32_t CRCErrors;
+    uint32_t Retransmits;
+    uint32_t FastRetransmits;
+    uint32_t GiveUps;
+    uint32_t Duplicates;
+    uint32_t OutOfOrder;
+    uint32_t Skipped;
+    uint32_t Resyncs;
+};
+
+typedef void ( *ARQDeliverFn ) ( void* User, const uint8_t* Payload, int Length );
+
+/*
+ * Resets both directions, BaudRate is used to work out retransmit timeouts.
+ */
+void ARQ_Init( struct ARQContext* Context, uint32_t BaudRate );
+
+/*
+ * CRC-16/CCITT-FALSE of Length bytes.
+ */
+uint16_t ARQ_CRC16( const uint8_t* Data, int Length );
+
+/*
+ * Returns 1 if Frame looks like an ARQ frame, the CRC isn't checked here.
+ */
+int ARQ_IsFrame( const uint8_t* Frame, int Length );
+
+/*
+ * Returns 1 if there is room in the window for another frame.
+ */
+int ARQ_CanSend( const struct ARQContext* Context );
+
+/*
+ * Keeps a copy of Payload for retransmission and builds its frame in Out.
+ * Returns the frame length, 0 if the window is full or it doesn't fit.
+ */
+int ARQ_Send( struct ARQContext* Context, uint32_t Now, const uint8_t* Payload, int Length, uint8_t* Out, int MaxOut );
+
+/*
+ * Builds the next frame that needs to go again, either because it was
+ * reported missing or it timed out. Returns the frame length or 0.
+ */
+int ARQ_Retransmit( struct ARQContext* Context, uint32_t Now, uint8_t* Out, int MaxOut );
+
+/*
+ * Builds a frame that only carries our acks if we owe the other side one.
+ * Returns the frame length or 0.
+ */
+int ARQ_Ack( struct ARQContext* Context, uint8_t* Out, int MaxOut );
+
+/*
+ * Handles a received ARQ frame, calling Deliver for every payload that is now in order.
+ * Returns the number of payloads delivered, or -1 if the frame was damaged.
+ */
+int ARQ_Receive( struct ARQContext* Context, const uint8_t* Frame, int Length, ARQDeliverFn Deliver, void* User );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
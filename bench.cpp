@@ -0,0 +1,521 @@
+#include <ESP8266WiFi.h>
+#include <lwip/netif.h>
+#include <lwip/err.h>
+#include "ether.h"
+#include "ipv4.h"
+#include "util.h"
+#include "slip.h"
+#include "mydebug.h"
+#include "hdrview.h"
+#include "txqueue.h"
+#include "rxring.h"
+#include "bench.h"
+#include "lzss.h"
+#include "nexthop.h"
+#include "hotpath.h"
+
+#if defined ( BENCHMARKS )
+
+extern "C" {
+#include <lwip/inet_chksum.h>
+}
+
+/* Packet sizes: minimum TCP ACK, default IPv4 MSS, full SLIP MTU */
+static const int BenchPacketSizes[ ] = { 40, 576, SLIPMaxPacketLen };
+
+/* Percentage of bytes that are SLIP_END/SLIP_ESC and have to be escaped */
+static const int BenchEscapeDensities[ ] = { 0, 1, 10, 50 };
+
+#define ArrayCount( x ) ( int ) ( sizeof( x ) / sizeof( x[ 0 ] ) )
+
+static uint8_t BenchPacket[ TXQueueMaxPacketLen ] __attribute__( ( aligned( 4 ) ) );
+static uint8_t BenchEncoded[ TXQueueMaxPacketLen * 2 + 2 ] __attribute__( ( aligned( 4 ) ) );
+static uint8_t BenchDecoded[ TXQueueMaxPacketLen * 2 ] __attribute__( ( aligned( 4 ) ) );
+static uint32_t BenchSeed = 1;
+
+static uint8_t BenchFrame[ EtherFrameHeadroom + 64 ] __attribute__( ( aligned( 4 ) ) );
+static volatile uint32_t BenchSink = 0;
+
+static struct LZSSContext BenchLZSS;
+
+/* Never used for anything but pushing the forwarding path out of the flash cache */
+static const uint32_t BenchCacheEvict[ BenchCacheEvictBytes / 4 ] PROGMEM = { 1 };
+
+static uint8_t BenchRXBuffer[ SLIPMaxPacketLen ] __attribute__( ( aligned( 4 ) ) );
+static struct SLIPDecoder BenchDecoder;
+static struct COBSDecoder BenchCOBSDecoder;
+
+/* Typical payloads for the compression benchmark, the last one is the worst case */
+static const char* const BenchTextPayloads[ ] = {
+    "HTTP/1.1 200 OK\r\nDate: Mon, 19 Oct 2026 10:00:00 GMT\r\nServer: nginx\r\nContent-Type: text/html; charset=UTF-8\r\n"
+    "Content-Length: 1432\r\nConnection: close\r\n\r\n<!DOCTYPE html><html><head><title>Index</title></head><body>",
+    ":nick!~user@host.example.net PRIVMSG #retro :anyone got a spare 3c509 lying around?\r\n"
+    ":other!~them@dialup.example.org PRIVMSG #retro :check the parts bin at the swap meet\r\n",
+    NULL
+};
+
+static void Bench_Report( const char* Name, uint32_t Cycles, int Iterations ) {
+    DebugPrintf( "BENCH: %-32s %6u cycles/op (%u us/op @ %uMHz)\n", Name, Cycles / Iterations, ( Cycles / Iterations ) / ESP.getCpuFreqMHz( ), ESP.getCpuFreqMHz( ) );
+}
+
+static uint32_t Bench_Random( void ) {
+    BenchSeed = BenchSeed * 1103515245 + 12345;
+    return BenchSeed >> 8;
+}
+
+/*
+ * Fills the packet buffer with random bytes, EscapePercent of them being
+ * bytes that the SLIP encoder has to escape.
+ */
+static void Bench_FillPacket( int Length, int EscapePercent ) {
+    uint8_t Data = 0;
+    int i = 0;
+
+    for ( i = 0; i < Length; i++ ) {
+        if ( ( int ) ( Bench_Random( ) % 100 ) < EscapePercent ) {
+            Data = ( Bench_Random( ) & 1 ) ? SLIP_END : SLIP_ESC;
+        } else {
+            do {
+                Data = Bench_Random( ) & 0xFF;
+            } while ( Data == SLIP_END || Data == SLIP_ESC );
+        }
+
+        BenchPacket[ i ] = Data;
+    }
+}
+
+/*
+ * Prints cycles per byte with two decimals.
+ */
+static void Bench_ReportBytes( const char* Name, int Size, int Escapes, uint32_t Cycles, int Iterations ) {
+    uint32_t CyclesPer100Bytes = ( uint32_t ) ( ( ( uint64_t ) Cycles * 100 ) / ( ( uint64_t ) Iterations * Size ) );
+
+    DebugPrintf( "BENCH: %-10s %4d bytes %2d%% esc %4u.%02u cycles/byte\n", Name, Size, Escapes, CyclesPer100Bytes / 100, CyclesPer100Bytes % 100 );
+}
+
+/*
+ * SLIP( ) and UnSLIP( ), then COBS, over every size and escape density.
+ */
+static void Bench_SLIPCodec( void ) {
+    uint32_t Start = 0;
+    uint32_t Cycles = 0;
+    int EncodedLength = 0;
+    int FrameLength = 0;
+    int Size = 0;
+    int Escapes = 0;
+    int s = 0;
+    int e = 0;
+    int i = 0;
+
+    COBSDecoder_Init( &BenchCOBSDecoder, BenchDecoded, sizeof( BenchDecoded ) );
+
+    for ( s = 0; s < ArrayCount( BenchPacketSizes ); s++ ) {
+        for ( e = 0; e < ArrayCount( BenchEscapeDensities ); e++ ) {
+            Size = BenchPacketSizes[ s ];
+            Escapes = BenchEscapeDensities[ e ];
+
+            Bench_FillPacket( Size, Escapes );
+
+            Start = ESP.getCycleCount( );
+
+            for ( i = 0; i < BenchPacketIterations; i++ )
+                EncodedLength = SLIP( BenchPacket, Size, BenchEncoded, sizeof( BenchEncoded ) );
+
+            Cycles = ESP.getCycleCount( ) - Start;
+            Bench_ReportBytes( "SLIP", Size, Escapes, Cycles, BenchPacketIterations );
+
+            /* UnSLIP( ) takes the frame without the END bytes, same as SLIP_Tick */
+            Start = ESP.getCycleCount( );
+
+            for ( i = 0; i < BenchPacketIterations; i++ )
+                BenchSink+= UnSLIP( &BenchEncoded[ 1 ], BenchDecoded, EncodedLength - 2 );
+
+            Cycles = ESP.getCycleCount( ) - Start;
+            Bench_ReportBytes( "UnSLIP", Size, Escapes, Cycles, BenchPacketIterations );
+
+            /* Same data through COBS, its cost doesn't depend on how much SLIP would escape */
+            Start = ESP.getCycleCount( );
+
+            for ( i = 0; i < BenchPacketIterations; i++ )
+                EncodedLength = COBS_Encode( BenchPacket, Size, BenchEncoded, sizeof( BenchEncoded ) );
+
+            Cycles = ESP.getCycleCount( ) - Start;
+            Bench_ReportBytes( "COBS", Size, Escapes, Cycles, BenchPacketIterations );
+
+            Start = ESP.getCycleCount( );
+
+            for ( i = 0; i < BenchPacketIterations; i++ ) {
+                COBSDecoder_Feed( &BenchCOBSDecoder, BenchEncoded, EncodedLength, &FrameLength );
+                BenchSink+= FrameLength;
+            }
+
+            Cycles = ESP.getCycleCount( ) - Start;
+            Bench_ReportBytes( "UnCOBS", Size, Escapes, Cycles, BenchPacketIterations );
+        }
+    }
+}
+
+/*
+ * inet_chksum( ) over a header and whole packets, and CRC32( ).
+ */
+static void Bench_Checksums( void ) {
+    uint32_t Start = 0;
+    int Size = 0;
+    int s = 0;
+    int i = 0;
+
+    Bench_FillPacket( TXQueueMaxPacketLen, 0 );
+
+    for ( s = 0; s < ArrayCount( BenchPacketSizes ); s++ ) {
+        Size = BenchPacketSizes[ s ];
+        Start = ESP.getCycleCount( );
+
+        for ( i = 0; i < BenchPacketIterations; i++ )
+            BenchSink+= inet_chksum( BenchPacket, Size );
+
+        Bench_ReportBytes( "inet_chksum", Size, 0, ESP.getCycleCount( ) - Start, BenchPacketIterations );
+        Start = ESP.getCycleCount( );
+
+        for ( i = 0; i < BenchPacketIterations; i++ )
+            BenchSink+= CRC32( BenchPacket, Size );
+
+        Bench_ReportBytes( "CRC32", Size, 0, ESP.getCycleCount( ) - Start, BenchPacketIterations );
+    }
+}
+
+/*
+ * Building the ethernet/IP/UDP headers for a locally generated packet.
+ */
+static void Bench_HeaderBuild( void ) {
+    uint8_t* Frame = &BenchFrame[ EtherFrameHeadroom ];
+    uint32_t Start = 0;
+    int i = 0;
+
+    Start = ESP.getCycleCount( );
+
+    for ( i = 0; i < BenchIterations; i++ )
+        BenchSink+= PrepareEthernetHeader( ( struct EtherFrame* ) Frame, OurMACAddress, BroadcastMACAddress, EtherType_IPv4 );
+
+    Bench_Report( "PrepareEthernetHeader", ESP.getCycleCount( ) - Start, BenchIterations );
+    Start = ESP.getCycleCount( );
+
+    for ( i = 0; i < BenchIterations; i++ )
+        BenchSink+= PrepareTCPHeader( ( struct ip_packet* ) &Frame[ sizeof( struct EtherFrame ) ], OurIPAddress, OurGateway, 512, 0, IP_PROTO_UDP );
+
+    Bench_Report( "PrepareTCPHeader", ESP.getCycleCount( ) - Start, BenchIterations );
+}
+
+/*
+ * ARP table lookups with a full table: first entry, last entry and a miss.
+ */
+static void Bench_ARPLookup( void ) {
+    uint8_t MAC[ MACAddressLen ] = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x00 };
+    uint32_t BaseIP = ( uint32_t ) IPAddress( 10, 0, 0, 0 );
+    uint32_t FirstIP = 0;
+    uint32_t LastIP = 0;
+    uint32_t Start = 0;
+    int i = 0;
+
+    ARP_ClearTable( );
+
+    /* Fill every slot, the first one added lands in the first slot and so on */
+    for ( i = 1; ARP_FindFreeEntry( )->Set == 0; i++ ) {
+        MAC[ 5 ] = i;
+        LastIP = BaseIP | ( ( uint32_t ) i << 24 );
+
+        ARP_AddToTable( MAC, LastIP );
+
+        if ( FirstIP == 0 )
+            FirstIP = LastIP;
+    }
+
+    Start = ESP.getCycleCount( );
+
+    for ( i = 0; i < BenchIterations; i++ )
+        BenchSink+= ( uint32_t ) ( uintptr_t ) ARP_FindEntryByIP( FirstIP );
+
+    Bench_Report( "ARP_FindEntryByIP (first)", ESP.getCycleCount( ) - Start, BenchIterations );
+    Start = ESP.getCycleCount( );
+
+    for ( i = 0; i < BenchIterations; i++ )
+        BenchSink+= ( uint32_t ) ( uintptr_t ) ARP_FindEntryByIP( LastIP );
+
+    Bench_Report( "ARP_FindEntryByIP (last)", ESP.getCycleCount( ) - Start, BenchIterations );
+    Start = ESP.getCycleCount( );
+
+    for ( i = 0; i < BenchIterations; i++ )
+        BenchSink+= ( uint32_t ) ( uintptr_t ) ARP_FindEntryByIP( 0xFFFFFFFE );
+
+    Bench_Report( "ARP_FindEntryByIP (miss)", ESP.getCycleCount( ) - Start, BenchIterations );
+
+    /* Off subnet so it goes through the gateway, the first call fills the cache */
+    ARP_ClearTable( );
+    ARP_AddToTable( MAC, OurGateway );
+    NextHop_PrepareHeader( LastIP, BenchFrame );
+
+    Start = ESP.getCycleCount( );
+
+    for ( i = 0; i < BenchIterations; i++ )
+        BenchSink+= NextHop_PrepareHeader( LastIP, BenchFrame );
+
+    Bench_Report( "NextHop_PrepareHeader (hit)", ESP.getCycleCount( ) - Start, BenchIterations );
+
+    ARP_ClearTable( );
+}
+
+/*
+ * Transmit queue enqueue + CoDel dequeue with a mix of packet sizes.
+ * Nothing is using the queue yet, it is emptied and its counters cleared afterwards.
+ */
+static void Bench_TXQueue( void ) {
+    uint32_t Start = 0;
+    int s = 0;
+    int i = 0;
+
+    Bench_FillPacket( TXQueueMaxPacketLen, 0 );
+    TXQueue_Reset( );
+
+    for ( s = 0; s < ArrayCount( BenchPacketSizes ); s++ ) {
+        Start = ESP.getCycleCount( );
+
+        for ( i = 0; i < BenchPacketIterations; i++ ) {
+            TXQueue_Enqueue( BenchPacket, BenchPacketSizes[ s ] );
+            BenchSink+= ( uint32_t ) ( uintptr_t ) TXQueue_Dequeue( );
+        }
+
+        Bench_ReportBytes( "TXQueue", BenchPacketSizes[ s ], 0, ESP.getCycleCount( ) - Start, BenchPacketIterations );
+    }
+
+    TXQueue_Reset( );
+}
+
+/*
+ * Write, peek and release through the RX ring, and how many frames of each
+ * size it can hold. Bench_Run is called before WiFi.begin( ) so the ring
+ * starts and ends empty and nothing else is writing to it.
+ */
+static void Bench_RXRing( void ) {
+    static const int FrameSizes[ ] = { 60, 590, TXQueueMaxPacketLen };
+    uint32_t Start = 0;
+    int Length = 0;
+    int Count = 0;
+    int s = 0;
+    int i = 0;
+
+    Bench_FillPacket( TXQueueMaxPacketLen, 0 );
+
+    for ( s = 0; s < ArrayCount( FrameSizes ); s++ ) {
+        Start = ESP.getCycleCount( );
+
+        for ( i = 0; i < BenchPacketIterations; i++ ) {
+            RXRing_Write( BenchPacket, FrameSizes[ s ] );
+            BenchSink+= ( uint32_t ) ( uintptr_t ) RXRing_Peek( &Length );
+            RXRing_Release( );
+        }
+
+        Bench_ReportBytes( "RXRing", FrameSizes[ s ], 0, ESP.getCycleCount( ) - Start, BenchPacketIterations );
+
+        /* Same rounding as the ring itself: length header, frame, pad to 4 */
+        Count = RXRingSize / ( ( EtherFrameHeadroom + FrameSizes[ s ] + 3 ) & ~3 );
+
+        DebugPrintf( "BENCH: RXRing holds %d frames of %d bytes\n", Count, FrameSizes[ s ] );
+    }
+}
+
+/*
+ * Reads through BenchCacheEvict so none of the code we're about to time is left in the cache.
+ */
+static void Bench_EvictCache( void ) {
+    volatile const uint32_t* Ptr = BenchCacheEvict;
+    uint32_t Sum = 0;
+    int i = 0;
+
+    for ( i = 0; i < ( int ) ( BenchCacheEvictBytes / 4 ); i++ )
+        Sum+= Ptr[ i ];
+
+    BenchSink+= Sum;
+}
+
+/*
+ * One packet through the per packet kernels of both directions: into and
+ * out of the RX ring, SLIP encoded for the host and decoded coming back.
+ */
+static void Bench_ForwardPacket( int Size ) {
+    int EncodedLength = 0;
+    int FrameLength = 0;
+    int Length = 0;
+
+    RXRing_Write( BenchPacket, Size );
+    BenchSink+= ( uint32_t ) ( uintptr_t ) RXRing_Peek( &Length );
+    RXRing_Release( );
+
+    EncodedLength = SLIP( BenchPacket, Size, BenchEncoded, sizeof( BenchEncoded ) );
+    BenchSink+= SLIPDecoder_Feed( &BenchDecoder, BenchEncoded, EncodedLength, &FrameLength );
+    BenchSink+= FrameLength;
+}
+
+/*
+ * Cycles per packet through Bench_ForwardPacket with the flash cache
+ * flushed before every packet and with it already warm. Build with and
+ * without IRAM_HOTPATH_PROFILE (hotpath.h) to compare the placements.
+ */
+static void Bench_CachePlacement( void ) {
+    uint32_t Start = 0;
+    uint32_t ColdCycles = 0;
+    uint32_t WarmCycles = 0;
+    uint32_t MissCycles = 0;
+    int Size = 0;
+    int s = 0;
+    int i = 0;
+
+    SLIPDecoder_Init( &BenchDecoder, BenchRXBuffer, sizeof( BenchRXBuffer ) );
+    Bench_FillPacket( TXQueueMaxPacketLen, 1 );
+
+#if defined ( IRAM_HOTPATH_PROFILE )
+    DebugPrintf( "BENCH: Cache placement, hot path in IRAM\n" );
+#else
+    DebugPrintf( "BENCH: Cache placement, hot path in flash\n" );
+#endif
+
+    for ( s = 0; s < ArrayCount( BenchPacketSizes ); s++ ) {
+        Size = BenchPacketSizes[ s ];
+        ColdCycles = 0;
+
+        for ( i = 0; i < BenchPacketIterations; i++ ) {
+            Bench_EvictCache( );
+
+            Start = ESP.getCycleCount( );
+            Bench_ForwardPacket( Size );
+            ColdCycles+= ESP.getCycleCount( ) - Start;
+        }
+
+        Bench_ForwardPacket( Size );
+        Start = ESP.getCycleCount( );
+
+        for ( i = 0; i < BenchPacketIterations; i++ )
+            Bench_ForwardPacket( Size );
+
+        WarmCycles = ESP.getCycleCount( ) - Start;
+        MissCycles = ColdCycles > WarmCycles ? ColdCycles - WarmCycles : 0;
+
+        DebugPrintf( "BENCH: Forward %4d bytes cold %6u cycles/packet, warm %6u cycles/packet (%u us lost to misses @ %uMHz)\n", Size,
+            ColdCycles / BenchPacketIterations, WarmCycles / BenchPacketIterations,
+            ( MissCycles / BenchPacketIterations ) / ESP.getCpuFreqMHz( ), ESP.getCpuFreqMHz( ) );
+    }
+}
+
+/*
+ * Reads the fields the forwarding path looks at (ethertype, dest/source IP,
+ * protocol, length) using the packed structs versus the header views.
+ */
+static void Bench_HeaderParse( void ) {
+    const uint8_t* Frame = &BenchFrame[ EtherFrameHeadroom ];
+    const uint8_t* IP = &Frame[ sizeof( struct EtherFrame ) ];
+    const struct EtherFrame* EHeader = ( const struct EtherFrame* ) Frame;
+    const struct ip_packet* IPHeader = ( const struct ip_packet* ) IP;
+    uint32_t Start = 0;
+    uint32_t Sum = 0;
+    int i = 0;
+
+    PrepareEthernetHeader( ( struct EtherFrame* ) Frame, OurMACAddress, BroadcastMACAddress, EtherType_IPv4 );
+    PrepareTCPHeader( ( struct ip_packet* ) IP, IPAddress( 192, 168, 2, 1 ), IPAddress( 192, 168, 2, 177 ), 0, 0, IP_PROTO_UDP );
+
+    Start = ESP.getCycleCount( );
+
+    for ( i = 0; i < BenchIterations; i++ )
+        Sum+= ntohs( EHeader->LengthOrType ) + IPHeader->DestIP + IPHeader->SourceIP + IPHeader->Protocol + ntohs( IPHeader->Length );
+
+    Bench_Report( "Header parse (packed struct)", ESP.getCycleCount( ) - Start, BenchIterations );
+    Start = ESP.getCycleCount( );
+
+    for ( i = 0; i < BenchIterations; i++ )
+        Sum+= RXEtherView::Type( Frame ) + RXIPv4View::DestIP( IP ) + RXIPv4View::SourceIP( IP ) + RXIPv4View::Protocol( IP ) + RXIPv4View::Length( IP );
+
+    Bench_Report( "Header parse (aligned view)", ESP.getCycleCount( ) - Start, BenchIterations );
+    Start = ESP.getCycleCount( );
+
+    for ( i = 0; i < BenchIterations; i++ )
+        Sum+= UnalignedIPv4View::DestIP( IP ) + UnalignedIPv4View::SourceIP( IP ) + UnalignedIPv4View::Protocol( IP ) + UnalignedIPv4View::Length( IP );
+
+    Bench_Report( "Header parse (unaligned view)", ESP.getCycleCount( ) - Start, BenchIterations );
+
+    BenchSink = Sum;
+}
+
+/*
+ * Effective throughput of the serial link with and without compression:
+ * the slower of wire time and compression time bounds each packet.
+ */
+static void Bench_Compression( void ) {
+    uint32_t Start = 0;
+    uint32_t CompressCycles = 0;
+    uint32_t ExpandCycles = 0;
+    uint32_t RawWireUS = 0;
+    uint32_t WireUS = 0;
+    uint32_t CPUUS = 0;
+    int CompressedLength = 0;
+    int Length = 0;
+    int p = 0;
+    int i = 0;
+
+    LZSS_Init( &BenchLZSS, LZSSDict_ToHost, LZSSDict_ToHostLen );
+
+    for ( p = 0; p < ArrayCount( BenchTextPayloads ); p++ ) {
+        /* A 40 byte TCP/IP header in front, that part barely compresses */
+        Bench_FillPacket( 40, 0 );
+
+        if ( BenchTextPayloads[ p ] ) {
+            Length = 40 + strlen( BenchTextPayloads[ p ] );
+            memcpy( &BenchPacket[ 40 ], BenchTextPayloads[ p ], Length - 40 );
+        } else {
+            Length = 576;
+            Bench_FillPacket( Length, 0 );
+        }
+
+        Start = ESP.getCycleCount( );
+
+        for ( i = 0; i < BenchPacketIterations; i++ )
+            CompressedLength = LZSS_Compress( &BenchLZSS, BenchPacket, Length, BenchEncoded, sizeof( BenchEncoded ) );
+
+        CompressCycles = ( ESP.getCycleCount( ) - Start ) / BenchPacketIterations;
+        Start = ESP.getCycleCount( );
+
+        for ( i = 0; i < BenchPacketIterations && CompressedLength > 0; i++ )
+            BenchSink+= LZSS_Decompress( LZSSDict_ToHost, LZSSDict_ToHostLen, BenchEncoded, CompressedLength, BenchDecoded, sizeof( BenchDecoded ) );
+
+        ExpandCycles = ( ESP.getCycleCount( ) - Start ) / BenchPacketIterations;
+
+        RawWireUS = ( uint32_t ) ( ( ( uint64_t ) SLIP( BenchPacket, Length, BenchDecoded, sizeof( BenchDecoded ) ) * 10 * 1000000 ) / BenchSerialBaud );
+
+        /* Sent as is when it doesn't compress, plus the marker byte when it does */
+        if ( CompressedLength > 0 )
+            WireUS = ( uint32_t ) ( ( ( uint64_t ) ( SLIP( BenchEncoded, CompressedLength, BenchDecoded, sizeof( BenchDecoded ) ) + 1 ) * 10 * 1000000 ) / BenchSerialBaud );
+        else
+            WireUS = RawWireUS;
+
+        CPUUS = CompressCycles / ESP.getCpuFreqMHz( );
+
+        DebugPrintf( "BENCH: LZSS %4d -> %4d bytes, compress/expand %6u/%6u cycles, raw %5u B/s, compressed %5u B/s\n", Length, CompressedLength ? CompressedLength + 1 : Length,
+            CompressCycles, ExpandCycles, ( uint32_t ) ( ( ( uint64_t ) Length * 1000000 ) / RawWireUS ), ( uint32_t ) ( ( ( uint64_t ) Length * 1000000 ) / ( WireUS > CPUUS ? WireUS : CPUUS ) ) );
+    }
+}
+
+/*
+ * Runs every benchmark and prints the results.
+ * Call it before WiFi.begin( ), the RX ring and ARP table benchmarks use the live ones.
+ */
+void Bench_Run( void ) {
+    DebugPrintf( "BENCH: Running at %uMHz\n", ESP.getCpuFreqMHz( ) );
+
+    Bench_HeaderParse( );
+    Bench_HeaderBuild( );
+    Bench_SLIPCodec( );
+    Bench_Checksums( );
+    Bench_Compression( );
+    Bench_ARPLookup( );
+    Bench_TXQueue( );
+    Bench_RXRing( );
+    Bench_CachePlacement( );
+}
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef _BENCH_H_
+#define _BENCH_H_
+
+/*
+ * On target micro-benchmarks, timed with the CPU cycle counter.
+ * Results are written to the debug console once during setup( ), run it
+ * at both 80 and 160MHz to see how much of a kernel is flash/memory bound.
+ *
+ * The plain C codecs (SLIP, COBS, LZSS, the ARQ CRC) can also be timed on
+ * the host with tools/slipbench.c.
+ */
+
+// #define BENCHMARKS
+
+#define BenchIterations 1000
+
+/* Fewer iterations for the kernels that touch a whole packet */
+#define BenchPacketIterations 50
+
+/* Serial link speed the throughput figures are worked out for */
+#define BenchSerialBaud SLIPBaudRate
+
+/* Flash read between cold cache runs, at least the size of the instruction cache */
+#define BenchCacheEvictBytes 32768
+
+#if defined ( BENCHMARKS )
+
+/*
+ * Runs every benchmark and prints the results.
+ * Call it before WiFi.begin( ), the RX ring and ARP table benchmarks use the live ones.
+ */
+void Bench_Run( void );
+
+#else
+
+#define Bench_Run( )
+
+#endif
+
+#endif
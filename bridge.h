@@ -0,0 +1,211 @@
+#ifndef _BRIDGE_H_
+#define _BRIDGE_H_
+
+/*
+ * The per-packet bridge logic, put together at compile time from policies.
+ * Everything here is inlined into OnDataReceived/SLIP_PacketComplete, so
+ * a policy that isn't selected costs no code and no branches.
+ *
+ * Needs ether.h, ipv4.h, slip.h and hdrview.h included first.
+ */
+
+/* Addressing mode */
+#define BRIDGE_ADDRESSING_SHAREDIP
+// #define BRIDGE_ADDRESSING_PROXYARP
+
+/* What to do with packets going to the serial side */
+// #define BRIDGE_QUEUE_DIRECT
+#define BRIDGE_QUEUE_SLIPQUEUE
+
+/* Dump every forwarded IPv4 packet to the debug sink picked in mydebug.h */
+// #define BRIDGE_DISSECT_PACKETS
+
+/*
+ * Drop packets from the serial side that aren't sane IPv4 (version, header
+ * length, total length against the frame, header checksum) before they
+ * cost any airtime.
+ */
+#define BRIDGE_VALIDATE_INGRESS
+
+/* Address of the serial host in proxy ARP mode, must be on our subnet */
+#define BridgeHostIPAddress IPAddress( 192, 168, 2, 178 )
+
+extern "C" {
+#include <lwip/inet_chksum.h>
+}
+
+enum {
+    IngressError_Runt = 0,
+    IngressError_Version,
+    IngressError_HeaderLength,
+    IngressError_TotalLength,
+    IngressError_Checksum,
+    IngressError_Count
+};
+
+/* Packets dropped by the bridge policies themselves, by reason */
+extern uint32_t BridgeIngressErrors[ IngressError_Count ];
+
+/*
+ * Shared IP: the serial host uses the same IP address as we do and
+ * everything addressed to it goes down the serial line.
+ */
+struct SharedIPAddressing {
+    static inline uint32_t SerialHostIP( void ) { return ( uint32_t ) OurIPAddress; }
+    static inline int IsForSerialHost( uint32_t DestIP ) { return DestIP == ( uint32_t ) OurIPAddress ? 1 : 0; }
+    static inline int ShouldAnswerARP( uint32_t TargetIP ) { return TargetIP == ( uint32_t ) OurIPAddress ? 1 : 0; }
+};
+
+/*
+ * Proxy ARP: the serial host has its own address on our subnet and we
+ * answer ARP requests for it with our MAC address.
+ */
+struct ProxyARPAddressing {
+    static inline uint32_t SerialHostIP( void ) { return ( uint32_t ) BridgeHostIPAddress; }
+    static inline int IsForSerialHost( uint32_t DestIP ) { return DestIP == ( uint32_t ) BridgeHostIPAddress ? 1 : 0; }
+    static inline int ShouldAnswerARP( uint32_t TargetIP ) { return ( TargetIP == ( uint32_t ) OurIPAddress || TargetIP == ( uint32_t ) BridgeHostIPAddress ) ? 1 : 0; }
+};
+
+/*
+ * Write to the serial port from the WiFi receive path, as much as the transport
+ * will take right now, without waiting for SLIP_Tick to drain the queue.
+ */
+struct DirectQueueing {
+    static inline void ToSerial( const uint8_t* Packet, int Length ) { SLIP_WritePacket( Packet, Length ); }
+};
+
+/*
+ * Hand the packet to the SLIP transmit queue (CoDel managed) and let SLIP_Tick drain it.
+ */
+struct SLIPQueueing {
+    static inline void ToSerial( const uint8_t* Packet, int Length ) { SLIP_QueuePacketForWrite( Packet, Length ); }
+};
+
+struct NoDissection {
+    static inline void OnForward( const uint8_t* Packet, int Length, const uint8_t* Frame ) { }
+};
+
+struct DebugDissection {
+    static inline void OnForward( const uint8_t* Packet, int Length, const uint8_t* Frame ) { OnIPv4Packet( Packet, Length, ( const struct EtherFrame* ) Frame ); }
+};
+
+struct NoIngressValidation {
+    static inline int Validate( const uint8_t* Packet, int Length ) { return Length; }
+};
+
+struct IPv4IngressValidation {
+    /*
+     * Returns the IPv4 total length if Packet is sane, otherwise 0 with
+     * the reason in *Reason. Doesn't count anything.
+     */
+    static inline int Check( const uint8_t* Packet, int Length, int* Reason ) {
+        int HeaderLength = 0;
+        int TotalLength = 0;
+
+        if ( Length < ( int ) sizeof( struct ip_packet ) ) {
+            *Reason = IngressError_Runt;
+            return 0;
+        }
+
+        if ( SLIPIPv4View::Version( Packet ) != 4 ) {
+            *Reason = IngressError_Version;
+            return 0;
+        }
+
+        HeaderLength = SLIPIPv4View::HeaderLength( Packet );
+
+        if ( HeaderLength < ( int ) sizeof( struct ip_packet ) || HeaderLength > Length ) {
+            *Reason = IngressError_HeaderLength;
+            return 0;
+        }
+
+        TotalLength = SLIPIPv4View::Length( Packet );
+
+        if ( TotalLength < HeaderLength || TotalLength > Length ) {
+            *Reason = IngressError_TotalLength;
+            return 0;
+        }
+
+        if ( inet_chksum( ( void* ) Packet, HeaderLength ) != 0 ) {
+            *Reason = IngressError_Checksum;
+            return 0;
+        }
+
+        return TotalLength;
+    }
+
+    /*
+     * Returns the length to forward, anything past the IPv4 total length
+     * (line noise before the END) is trimmed off. Returns 0 to drop it.
+     */
+    static inline int Validate( const uint8_t* Packet, int Length ) {
+        int Reason = 0;
+        int TotalLength = 0;
+
+        if ( ( TotalLength = Check( Packet, Length, &Reason ) ) == 0 )
+            BridgeIngressErrors[ Reason ]++;
+
+        return TotalLength;
+    }
+};
+
+template <class Addressing, class Queueing, class Dissection, class Validation>
+struct BridgeEngine {
+    /*
+     * An IPv4 frame came in over WiFi, Frame must sit (EtherFrameHeadroom) bytes past a 4 byte boundary.
+     * Returns 1 if it was forwarded to the serial host.
+     */
+    static inline int OnIPv4FromWiFi( const uint8_t* Frame, int Length ) {
+        const uint8_t* Packet = &Frame[ sizeof( struct EtherFrame ) ];
+        int PacketLength = Length - sizeof( struct EtherFrame );
+
+        if ( Addressing::IsForSerialHost( RXIPv4View::DestIP( Packet ) ) ) {
+            Dissection::OnForward( Packet, PacketLength, Frame );
+            Queueing::ToSerial( Packet, PacketLength );
+
+            return 1;
+        }
+
+        return 0;
+    }
+
+    /*
+     * A complete IPv4 packet came in over the serial line, Packet must be 4 byte aligned.
+     * Returns the length to forward, or 0 if the packet should be dropped.
+     */
+    static inline int AcceptFromSerial( const uint8_t* Packet, int Length ) {
+        return Validation::Validate( Packet, Length );
+    }
+
+    static inline int ShouldAnswerARP( uint32_t TargetIP ) {
+        return Addressing::ShouldAnswerARP( TargetIP );
+    }
+};
+
+#if defined ( BRIDGE_ADDRESSING_PROXYARP )
+typedef ProxyARPAddressing BridgeAddressing;
+#else
+typedef SharedIPAddressing BridgeAddressing;
+#endif
+
+#if defined ( BRIDGE_QUEUE_SLIPQUEUE )
+typedef SLIPQueueing BridgeQueueing;
+#else
+typedef DirectQueueing BridgeQueueing;
+#endif
+
+#if defined ( BRIDGE_DISSECT_PACKETS )
+typedef DebugDissection BridgeDissection;
+#else
+typedef NoDissection BridgeDissection;
+#endif
+
+#if defined ( BRIDGE_VALIDATE_INGRESS )
+typedef IPv4IngressValidation BridgeValidation;
+#else
+typedef NoIngressValidation BridgeValidation;
+#endif
+
+typedef BridgeEngine<BridgeAddressing, BridgeQueueing, BridgeDissection, BridgeValidation> Bridge;
+
+#endif
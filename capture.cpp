@@ -0,0 +1,198 @@
+#include <ESP8266WiFi.h>
+#include <lwip/netif.h>
+#include <lwip/err.h>
+#include "ether.h"
+#include "ipv4.h"
+#include "util.h"
+#include "slip.h"
+#include "mydebug.h"
+#include "capture.h"
+
+#if defined ( CAPTURE_ENABLED )
+
+struct PcapGlobalHeader {
+    uint32_t Magic;
+    uint16_t VersionMajor;
+    uint16_t VersionMinor;
+    int32_t ThisZone;
+    uint32_t SigFigs;
+    uint32_t SnapLen;
+    uint32_t LinkType;
+} __attribute__( ( packed ) );
+
+struct PcapRecordHeader {
+    uint32_t Seconds;
+    uint32_t Microseconds;
+    uint32_t CapturedLength;
+    uint32_t OriginalLength;
+} __attribute__( ( packed ) );
+
+struct CaptureEntry {
+    struct PcapRecordHeader Header;
+    uint8_t Data[ CaptureMaxSnapLen ];
+};
+
+/*
+ * Single producer (the forwarding path) and single consumer (Capture_Tick).
+ * Head and Tail only ever increase, the slot is (Index & (CaptureRingEntries - 1)).
+ */
+static struct CaptureEntry CaptureRing[ CaptureRingEntries ];
+static volatile uint32_t CaptureHead = 0;
+static volatile uint32_t CaptureTail = 0;
+
+static int CaptureSnapLen = 0;
+static int CaptureDirections = 0;
+static int IsEmitting = 0;
+
+#if defined ( CAPTURE_OUTPUT_UDP )
+static struct PcapGlobalHeader GlobalHeader;
+static int IsGlobalHeaderPending = 0;
+#endif
+
+static uint32_t CapturedCount = 0;
+static uint32_t CaptureDropped = 0;
+
+/*
+ * Starts capturing frames in the given direction(s), truncated to SnapLen bytes.
+ * The pcap global header is written first, over UDP it is sent on its own before any records.
+ */
+void Capture_Start( int SnapLen, int DirectionMask ) {
+    struct PcapGlobalHeader Header;
+
+    if ( SnapLen <= 0 || SnapLen > CaptureMaxSnapLen )
+        SnapLen = CaptureMaxSnapLen;
+
+    Header.Magic = 0xA1B2C3D4;
+    Header.VersionMajor = 2;
+    Header.VersionMinor = 4;
+    Header.ThisZone = 0;
+    Header.SigFigs = 0;
+    Header.SnapLen = SnapLen;
+    Header.LinkType = CaptureLinkType;
+
+#if defined ( CAPTURE_OUTPUT_UART )
+    Serial1.write( ( const uint8_t* ) &Header, sizeof( Header ) );
+#elif defined ( CAPTURE_OUTPUT_UDP )
+    /* WiFi may not be able to take it yet, Capture_Tick sends it */
+    GlobalHeader = Header;
+    IsGlobalHeaderPending = 1;
+#endif
+
+    CaptureSnapLen = SnapLen;
+    CaptureDirections = DirectionMask;
+}
+
+/*
+ * Stops capturing, anything already in the ring will still be sent.
+ */
+void Capture_Stop( void ) {
+    CaptureDirections = 0;
+}
+
+/*
+ * Copies the headers of a frame into the capture ring if there is room.
+ */
+void Capture_Packet( int Direction, const uint8_t* Frame, int Length ) {
+    Capture_PacketParts( Direction, Frame, Length, NULL, 0 );
+}
+
+/*
+ * Same as Capture_Packet for a frame that is still in two pieces.
+ */
+void Capture_PacketParts( int Direction, const uint8_t* Header, int HeaderLength, const uint8_t* Payload, int PayloadLength ) {
+    struct CaptureEntry* Entry = NULL;
+    uint64_t Now = 0;
+    int Length = HeaderLength + PayloadLength;
+    int BytesToCopy = 0;
+
+    if ( ( CaptureDirections & Direction ) == 0 || IsEmitting || Length <= 0 )
+        return;
+
+    if ( ( CaptureHead - CaptureTail ) >= CaptureRingEntries ) {
+        CaptureDropped++;
+        return;
+    }
+
+    Entry = &CaptureRing[ CaptureHead & ( CaptureRingEntries - 1 ) ];
+    BytesToCopy = Length > CaptureSnapLen ? CaptureSnapLen : Length;
+    Now = micros64( );
+
+    Entry->Header.Seconds = ( uint32_t ) ( Now / 1000000 );
+    Entry->Header.Microseconds = ( uint32_t ) ( Now % 1000000 );
+    Entry->Header.CapturedLength = BytesToCopy;
+    Entry->Header.OriginalLength = Length;
+
+    if ( BytesToCopy <= HeaderLength ) {
+        memcpy( Entry->Data, Header, BytesToCopy );
+    } else {
+        memcpy( Entry->Data, Header, HeaderLength );
+        memcpy( &Entry->Data[ HeaderLength ], Payload, BytesToCopy - HeaderLength );
+    }
+
+    /* Only publish the entry once it has been completely filled in */
+    CaptureHead = CaptureHead + 1;
+    CapturedCount++;
+}
+
+/*
+ * Sends a single record, returns 0 if the output can't take it right now.
+ */
+static int Capture_EmitRecord( struct CaptureEntry* Entry ) {
+    int RecordLength = sizeof( struct PcapRecordHeader ) + Entry->Header.CapturedLength;
+
+#if defined ( CAPTURE_OUTPUT_UART )
+    if ( Serial1.availableForWrite( ) < RecordLength )
+        return 0;
+
+    Serial1.write( ( const uint8_t* ) Entry, RecordLength );
+#elif defined ( CAPTURE_OUTPUT_UDP )
+    err_t Result = ERR_OK;
+
+    /* Collector not resolved yet (ERR_RTE) or transmit pool full (ERR_MEM), the record stays queued */
+    IsEmitting = 1;
+    Result = UDP_BuildOutgoingPacket( OurIPAddress, CaptureCollectorIP, CaptureCollectorPort, ( const uint8_t* ) Entry, RecordLength );
+    IsEmitting = 0;
+
+    if ( Result != ERR_OK )
+        return 0;
+#endif
+
+    return 1;
+}
+
+/*
+ * Called every "frame" or run through the main loop.
+ * Sends as many queued records as the output can take without blocking.
+ */
+void Capture_Tick( void ) {
+#if defined ( CAPTURE_OUTPUT_UDP )
+    /* Records without the global header in front are no use to the collector */
+    if ( IsGlobalHeaderPending ) {
+        IsEmitting = 1;
+
+        if ( UDP_BuildOutgoingPacket( OurIPAddress, CaptureCollectorIP, CaptureCollectorPort, ( const uint8_t* ) &GlobalHeader, sizeof( GlobalHeader ) ) == ERR_OK )
+            IsGlobalHeaderPending = 0;
+
+        IsEmitting = 0;
+
+        if ( IsGlobalHeaderPending )
+            return;
+    }
+#endif
+
+    while ( CaptureTail != CaptureHead ) {
+        if ( Capture_EmitRecord( &CaptureRing[ CaptureTail & ( CaptureRingEntries - 1 ) ] ) == 0 )
+            break;
+
+        CaptureTail = CaptureTail + 1;
+    }
+}
+
+/*
+ * Writes the capture counters to the debug console.
+ */
+void Capture_DumpStats( void ) {
+    DebugPrintf( "%s: Captured %u / Dropped %u / Queued %u\n", __FUNCTION__, CapturedCount, CaptureDropped, ( unsigned ) ( CaptureHead - CaptureTail ) );
+}
+
+#endif
@@ -0,0 +1,88 @@
+#ifndef _CAPTURE_H_
+#define _CAPTURE_H_
+
+/*
+ * Packet capture tap.
+ * Copies the first (SnapLen) bytes of every ethernet frame crossing the bridge
+ * into a fixed ring and streams them out later as pcap records from the main loop.
+ * If the ring is full the capture is dropped and counted, forwarding never waits on it.
+ */
+
+// #define CAPTURE_ENABLED
+#define CAPTURE_OUTPUT_UART
+// #define CAPTURE_OUTPUT_UDP
+
+#if defined ( CAPTURE_ENABLED ) && defined ( CAPTURE_OUTPUT_UART ) && defined ( DEBUG_UART )
+#warning "CAPTURE_OUTPUT_UART and DEBUG_UART both write to Serial1, the pcap stream will be corrupted."
+#endif
+
+/* Largest snap length we reserve room for, this is also the per-record buffer size */
+#define CaptureMaxSnapLen 96
+
+/* Must be a power of two */
+#define CaptureRingEntries 32
+
+/*
+ * UDP output goes to the subnet broadcast address by default, set this to
+ * IPAddress( ... ) to send to a single collector instead.
+ * The pcap global header is sent on its own as the first datagram, a
+ * collector started after the ESP has to write that header itself.
+ */
+#define CaptureCollectorIP SubnetBroadcastIP( )
+#define CaptureCollectorPort 7811
+
+/* LINKTYPE_ETHERNET */
+#define CaptureLinkType 1
+
+enum {
+    CaptureDir_FromWiFi = 1,
+    CaptureDir_ToWiFi = 2,
+    CaptureDir_Both = CaptureDir_FromWiFi | CaptureDir_ToWiFi
+};
+
+#if defined ( CAPTURE_ENABLED )
+
+/*
+ * Starts capturing frames in the given direction(s), truncated to SnapLen bytes.
+ * The pcap global header is written first, over UDP it is sent on its own before any records.
+ */
+void Capture_Start( int SnapLen, int DirectionMask );
+
+/*
+ * Stops capturing, anything already in the ring will still be sent.
+ */
+void Capture_Stop( void );
+
+/*
+ * Copies the headers of a frame into the capture ring if there is room.
+ */
+void Capture_Packet( int Direction, const uint8_t* Frame, int Length );
+
+/*
+ * Same as Capture_Packet for a frame that is still in two pieces.
+ */
+void Capture_PacketParts( int Direction, const uint8_t* Header, int HeaderLength, const uint8_t* Payload, int PayloadLength );
+
+/*
+ * Called every "frame" or run through the main loop.
+ * Sends as many queued records as the output can take without blocking.
+ */
+void Capture_Tick( void );
+
+/*
+ * Writes the capture counters to the debug console.
+ */
+void Capture_DumpStats( void );
+
+#else
+
+#define Capture_Start( a, b )
+#define Capture_Stop( )
+#define Capture_Packet( a, b, c )
+#define Capture_PacketParts( a, b, c, d, e )
+#define Capture_Tick( )
+#define Capture_DumpStats( )
+
+#endif
+
+#endif
@@ -0,0 +1,141 @@
+#include <string.h>
+#include "cobs.h"
+#include "hotpath.h"
+
+/*
+ * Sets up a decoder writing frames of up to MaxLength bytes into Buffer.
+ */
+void COBSDecoder_Init( struct COBSDecoder* Decoder, uint8_t* Buffer, int MaxLength ) {
+    memset( Decoder, 0, sizeof( struct COBSDecoder ) );
+
+    Decoder->Buffer = Buffer;
+    Decoder->MaxLength = MaxLength;
+    Decoder->IsDiscarding = 1;
+}
+
+static void COBSDecoder_Reset( struct COBSDecoder* Decoder ) {
+    Decoder->Length = 0;
+    Decoder->Remaining = 0;
+    Decoder->IsZeroPending = 0;
+    Decoder->IsDiscarding = 0;
+}
+
+/*
+ * Decodes Data, stopping as soon as a frame is complete.
+ * Returns how many bytes were used, *FrameLength is set to the length of
+ * the frame in Buffer if one completed, 0 otherwise. The frame stays in
+ * Buffer until the next call.
+ */
+int FASTPATH COBSDecoder_Feed( struct COBSDecoder* Decoder, const uint8_t* Data, int Length, int* FrameLength ) {
+    const uint8_t* Delim = NULL;
+    int Complete = 0;
+    int Count = 0;
+    int i = 0;
+
+    *FrameLength = 0;
+
+    while ( i < Length ) {
+        /* Inside a block, the code byte said how many data bytes are left */
+        if ( Decoder->Remaining > 0 ) {
+            Count = Length - i;
+
+            if ( Count > Decoder->Remaining )
+                Count = Decoder->Remaining;
+
+            /* A delimiter here means the frame was cut short */
+            if ( ( Delim = ( const uint8_t* ) memchr( &Data[ i ], COBS_DELIM, Count ) ) != NULL ) {
+                if ( Decoder->IsDiscarding == 0 )
+                    Decoder->FramingErrors++;
+
+                COBSDecoder_Reset( Decoder );
+                i = ( int ) ( Delim - Data ) + 1;
+                continue;
+            }
+
+            if ( Decoder->IsDiscarding == 0 ) {
+                if ( ( Decoder->Length + Count ) > Decoder->MaxLength ) {
+                    Decoder->FrameOverruns++;
+                    Decoder->IsDiscarding = 1;
+                } else {
+                    memcpy( &Decoder->Buffer[ Decoder->Length ], &Data[ i ], Count );
+                    Decoder->Length+= Count;
+                }
+            }
+
+            Decoder->Remaining-= Count;
+            i+= Count;
+            continue;
+        }
+
+        if ( Data[ i ] == COBS_DELIM ) {
+            Complete = Decoder->IsDiscarding ? 0 : Decoder->Length;
+            COBSDecoder_Reset( Decoder );
+
+            /* Back to back delimiters are just the start of the next frame */
+            if ( Complete > 0 ) {
+                Decoder->FramesReceived++;
+
+                *FrameLength = Complete;
+                return i + 1;
+            }
+
+            i++;
+            continue;
+        }
+
+        /* A new code byte, the zero implied by the last block goes in before its data */
+        if ( Decoder->IsZeroPending && Decoder->IsDiscarding == 0 ) {
+            if ( Decoder->Length >= Decoder->MaxLength ) {
+                Decoder->FrameOverruns++;
+                Decoder->IsDiscarding = 1;
+            } else {
+                Decoder->Buffer[ Decoder->Length++ ] = 0;
+            }
+        }
+
+        Decoder->Remaining = Data[ i ] - 1;
+        Decoder->IsZeroPending = Data[ i ] < COBSMaxCode;
+        i++;
+    }
+
+    return Length;
+}
+
+/*
+ * COBS encodes Src into Dest, including the leading and trailing delimiters.
+ * Returns the encoded length, or 0 if MaxDestLen is less than COBSMaxEncodedLen( SrcLen ).
+ */
+int FASTPATH COBS_Encode( const uint8_t* Src, int SrcLen, uint8_t* Dest, int MaxDestLen ) {
+    int OutLength = 0;
+    int CodeIndex = 0;
+    int Code = 1;
+    int i = 0;
+
+    if ( MaxDestLen < COBSMaxEncodedLen( SrcLen ) )
+        return 0;
+
+    Dest[ OutLength++ ] = COBS_DELIM;
+    CodeIndex = OutLength++;
+
+    for ( i = 0; i < SrcLen; i++ ) {
+        if ( Src[ i ] == 0 ) {
+            Dest[ CodeIndex ] = Code;
+            CodeIndex = OutLength++;
+            Code = 1;
+            continue;
+        }
+
+        Dest[ OutLength++ ] = Src[ i ];
+
+        if ( ++Code == COBSMaxCode ) {
+            Dest[ CodeIndex ] = Code;
+            CodeIndex = OutLength++;
+            Code = 1;
+        }
+    }
+
+    Dest[ CodeIndex ] = Code;
+    Dest[ OutLength++ ] = COBS_DELIM;
+
+    return OutLength;
+}
@@ -0,0 +1,71 @@
+#ifndef _COBS_H_
+#define _COBS_H_
+
+/*
+ * Consistent Overhead Byte Stuffing framing.
+ * Each block starts with a code byte saying how far it is to the next
+ * zero, so zeros never appear inside a frame and 0x00 delimits frames.
+ * Overhead is one byte per 254 whatever the data, against up to double
+ * for SLIP escaping, and the decoder copies whole blocks instead of
+ * looking at every byte.
+ *
+ * Frames are written as 00 <blocks> 00, the leading delimiter flushes
+ * any line noise the same way SLIP's leading END does. Plain C so the
+ * host side tools build the same file.
+ */
+
+#include <stdint.h>
+
+#define COBS_DELIM 0x00
+
+/* Longest block, 254 data bytes and no implied zero */
+#define COBSMaxCode 0xFF
+
+/* Worst case encoded length of an n byte frame, including both delimiters */
+#define COBSMaxEncodedLen( n ) ( ( n ) + ( ( n ) / 254 ) + 1 + 2 )
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Same contract as struct SLIPDecoder (see slipcodec.h).
+ */
+struct COBSDecoder {
+    uint8_t* Buffer;
+    int MaxLength;
+
+    int Length;
+    int Remaining;
+    int IsZeroPending;
+    int IsDiscarding;
+
+    uint32_t FramesReceived;
+    uint32_t FrameOverruns;
+    uint32_t FramingErrors;
+};
+
+/*
+ * Sets up a decoder writing frames of up to MaxLength bytes into Buffer.
+ */
+void COBSDecoder_Init( struct COBSDecoder* Decoder, uint8_t* Buffer, int MaxLength );
+
+/*
+ * Decodes Data, stopping as soon as a frame is complete.
+ * Returns how many bytes were used, *FrameLength is set to the length of
+ * the frame in Buffer if one completed, 0 otherwise. The frame stays in
+ * Buffer until the next call.
+ */
+int COBSDecoder_Feed( struct COBSDecoder* Decoder, const uint8_t* Data, int Length, int* FrameLength );
+
+/*
+ * COBS encodes Src into Dest, including the leading and trailing delimiters.
+ * Returns the encoded length, or 0 if MaxDestLen is less than COBSMaxEncodedLen( SrcLen ).
+ */
+int COBS_Encode( const uint8_t* Src, int SrcLen, uint8_t* Dest, int MaxDestLen );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
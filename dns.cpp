@@ -0,0 +1,383 @@
+#include <ESP8266WiFi.h>
+#include <lwip/netif.h>
+#include <lwip/err.h>
+#include "ether.h"
+#include "ipv4.h"
+#include "util.h"
+#include "slip.h"
+#include "mydebug.h"
+#include "hdrview.h"
+#include "bridge.h"
+#include "dns.h"
+
+#if defined ( DNS_CACHE_ENABLED )
+
+#define DNSHeaderLen 12
+#define DNSMaxQuestionLen 260
+#define DNSMaxMessageLen 512
+
+#define DNSFlag_QR 0x8000
+#define DNSFlag_TC 0x0200
+#define DNSOpcodeMask 0x7800
+#define DNSRCodeMask 0x000F
+
+#define DNSType_OPT 41
+
+struct DNSCacheEntry {
+    uint32_t KeyHash;
+    uint32_t InsertTime;
+    uint32_t TTL;
+    uint16_t Offset;
+    uint16_t KeyLength;
+    uint16_t MessageLength;
+    uint8_t Set;
+};
+
+static struct DNSCacheEntry DNSCache[ DNSCacheEntries ];
+static uint8_t DNSArena[ DNSCacheArenaSize ];
+static int DNSArenaHead = 0;
+
+static uint8_t DNSReplyBuffer[ sizeof( struct ip_packet ) + sizeof( struct udp_packet ) + DNSMaxMessageLen ] __attribute__( ( aligned( 4 ) ) );
+
+static uint32_t DNSHits = 0;
+static uint32_t DNSMisses = 0;
+static uint32_t DNSInserts = 0;
+static uint32_t DNSEvictions = 0;
+static uint32_t DNSUncacheable = 0;
+
+static inline uint16_t DNS_Read16( const uint8_t* p ) {
+    return ( uint16_t ) ( ( p[ 0 ] << 8 ) | p[ 1 ] );
+}
+
+static inline uint32_t DNS_Read32( const uint8_t* p ) {
+    return ( ( uint32_t ) p[ 0 ] << 24 ) | ( ( uint32_t ) p[ 1 ] << 16 ) | ( ( uint32_t ) p[ 2 ] << 8 ) | p[ 3 ];
+}
+
+static inline void DNS_Write32( uint8_t* p, uint32_t Value ) {
+    p[ 0 ] = Value >> 24;
+    p[ 1 ] = Value >> 16;
+    p[ 2 ] = Value >> 8;
+    p[ 3 ] = Value;
+}
+
+/*
+ * Returns the offset just past the (possibly compressed) name at Offset, or -1 if it runs off the end.
+ */
+static int DNS_SkipName( const uint8_t* Message, int Length, int Offset ) {
+    while ( Offset < Length ) {
+        if ( Message[ Offset ] == 0 )
+            return Offset + 1;
+
+        if ( ( Message[ Offset ] & 0xC0 ) == 0xC0 )
+            return ( Offset + 2 ) <= Length ? Offset + 2 : -1;
+
+        Offset+= Message[ Offset ] + 1;
+    }
+
+    return -1;
+}
+
+/*
+ * Copies the first question (name, type and class) lowercased into Key,
+ * returns the key length or 0 if it isn't something we can cache.
+ */
+static int DNS_BuildKey( const uint8_t* Message, int Length, uint8_t* Key ) {
+    int Offset = DNSHeaderLen;
+    int End = 0;
+    int i = 0;
+
+    if ( DNS_Read16( &Message[ 4 ] ) != 1 )
+        return 0;
+
+    /* Walk the labels ourselves, a compressed name in the question isn't worth the trouble */
+    while ( Offset < Length && Message[ Offset ] != 0 ) {
+        if ( ( Message[ Offset ] & 0xC0 ) != 0 )
+            return 0;
+
+        Offset+= Message[ Offset ] + 1;
+    }
+
+    End = Offset + 1 + 4;
+
+    if ( End > Length || ( End - DNSHeaderLen ) > DNSMaxQuestionLen )
+        return 0;
+
+    for ( i = DNSHeaderLen; i < End; i++ )
+        Key[ i - DNSHeaderLen ] = ( Message[ i ] >= 'A' && Message[ i ] <= 'Z' ) ? Message[ i ] + 32 : Message[ i ];
+
+    return End - DNSHeaderLen;
+}
+
+static struct DNSCacheEntry* DNS_Find( const uint8_t* Key, int KeyLength, uint32_t KeyHash, uint32_t Now ) {
+    struct DNSCacheEntry* Entry = NULL;
+    int i = 0;
+
+    for ( i = 0; i < DNSCacheEntries; i++ ) {
+        Entry = &DNSCache[ i ];
+
+        if ( Entry->Set && Entry->KeyHash == KeyHash && Entry->KeyLength == KeyLength && memcmp( &DNSArena[ Entry->Offset ], Key, KeyLength ) == 0 ) {
+            if ( ( Now - Entry->InsertTime ) >= SecondsToMS( Entry->TTL ) ) {
+                Entry->Set = 0;
+                return NULL;
+            }
+
+            return Entry;
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * Walks every resource record after the question section and either finds the
+ * smallest TTL (Elapsed < 0) or counts every TTL down by Elapsed seconds.
+ * Returns the smallest TTL, or 0 if the message doesn't parse.
+ */
+static uint32_t DNS_WalkTTLs( uint8_t* Message, int Length, int Elapsed ) {
+    uint32_t MinTTL = 0xFFFFFFFF;
+    uint32_t TTL = 0;
+    int Records = DNS_Read16( &Message[ 6 ] ) + DNS_Read16( &Message[ 8 ] ) + DNS_Read16( &Message[ 10 ] );
+    int Offset = DNSHeaderLen;
+    int i = 0;
+
+    if ( ( Offset = DNS_SkipName( Message, Length, Offset ) ) < 0 )
+        return 0;
+
+    Offset+= 4;
+
+    for ( i = 0; i < Records; i++ ) {
+        if ( ( Offset = DNS_SkipName( Message, Length, Offset ) ) < 0 || ( Offset + 10 ) > Length )
+            return 0;
+
+        /* The OPT pseudo record's "TTL" is flags, leave it alone */
+        if ( DNS_Read16( &Message[ Offset ] ) != DNSType_OPT ) {
+            TTL = DNS_Read32( &Message[ Offset + 4 ] );
+
+            if ( Elapsed >= 0 )
+                DNS_Write32( &Message[ Offset + 4 ], TTL > ( uint32_t ) Elapsed ? TTL - Elapsed : 0 );
+            else if ( TTL < MinTTL )
+                MinTTL = TTL;
+        }
+
+        Offset+= 10 + DNS_Read16( &Message[ Offset + 8 ] );
+
+        if ( Offset > Length )
+            return 0;
+    }
+
+    return MinTTL == 0xFFFFFFFF ? 0 : MinTTL;
+}
+
+/*
+ * Makes room for Size bytes in the arena, anything in the way gets evicted.
+ */
+static int DNS_ArenaAlloc( int Size ) {
+    int Offset = 0;
+    int i = 0;
+
+    if ( ( DNSArenaHead + Size ) > DNSCacheArenaSize )
+        DNSArenaHead = 0;
+
+    Offset = DNSArenaHead;
+
+    for ( i = 0; i < DNSCacheEntries; i++ ) {
+        if ( DNSCache[ i ].Set && DNSCache[ i ].Offset < ( Offset + Size ) && ( DNSCache[ i ].Offset + DNSCache[ i ].KeyLength + DNSCache[ i ].MessageLength ) > Offset ) {
+            DNSCache[ i ].Set = 0;
+            DNSEvictions++;
+        }
+    }
+
+    DNSArenaHead+= Size;
+    return Offset;
+}
+
+static struct DNSCacheEntry* DNS_FindFreeEntry( void ) {
+    struct DNSCacheEntry* Oldest = &DNSCache[ 0 ];
+    int i = 0;
+
+    for ( i = 0; i < DNSCacheEntries; i++ ) {
+        if ( DNSCache[ i ].Set == 0 )
+            return &DNSCache[ i ];
+
+        if ( ( int32_t ) ( DNSCache[ i ].InsertTime - Oldest->InsertTime ) < 0 )
+            Oldest = &DNSCache[ i ];
+    }
+
+    DNSEvictions++;
+    return Oldest;
+}
+
+/*
+ * Returns the UDP payload of a UDP/IPv4 packet from (FromServer) or to port 53,
+ * or NULL if it isn't one.
+ */
+static const uint8_t* DNS_GetPayload( const uint8_t* Packet, int Length, int FromServer, int* PayloadLength ) {
+    const uint8_t* UDP = NULL;
+    int HeaderLength = 0;
+    int UDPLength = 0;
+    int Port = 0;
+
+    if ( Length < ( int ) ( sizeof( struct ip_packet ) + sizeof( struct udp_packet ) ) || SLIPIPv4View::Protocol( Packet ) != IP_PROTO_UDP )
+        return NULL;
+
+    /* Fragments are not our problem */
+    if ( SLIPIPv4View::View::LoadBE16<6>( Packet ) & 0x3FFF )
+        return NULL;
+
+    HeaderLength = SLIPIPv4View::HeaderLength( Packet );
+    UDP = &Packet[ HeaderLength ];
+
+    if ( ( HeaderLength + ( int ) sizeof( struct udp_packet ) ) > Length )
+        return NULL;
+
+    if ( FromServer )
+        Port = SLIPIPv4View::View::LoadBE16<UDPOffset_SourcePort>( UDP );
+    else
+        Port = SLIPIPv4View::View::LoadBE16<UDPOffset_DestPort>( UDP );
+
+    if ( Port != DNSPort )
+        return NULL;
+
+    UDPLength = SLIPIPv4View::View::LoadBE16<UDPOffset_Length>( UDP );
+
+    if ( UDPLength < ( int ) ( sizeof( struct udp_packet ) + DNSHeaderLen ) || ( HeaderLength + UDPLength ) > Length )
+        return NULL;
+
+    *PayloadLength = UDPLength - sizeof( struct udp_packet );
+    return UDP + sizeof( struct udp_packet );
+}
+
+/*
+ * Sends the cached answer back to the serial host with the query's ID and the TTLs counted down.
+ */
+static void DNS_SendReply( const uint8_t* Query, const uint8_t* QueryMessage, const struct DNSCacheEntry* Entry, uint32_t Now ) {
+    struct ip_packet* IPHeader = ( struct ip_packet* ) DNSReplyBuffer;
+    struct udp_packet* UDPHeader = ( struct udp_packet* ) &DNSReplyBuffer[ sizeof( struct ip_packet ) ];
+    uint8_t* Message = &DNSReplyBuffer[ sizeof( struct ip_packet ) + sizeof( struct udp_packet ) ];
+    const uint8_t* QueryUDP = &Query[ SLIPIPv4View::HeaderLength( Query ) ];
+
+    memcpy( Message, &DNSArena[ Entry->Offset + Entry->KeyLength ], Entry->MessageLength );
+
+    /* Same transaction ID as the question, and the question exactly as it was asked */
+    Message[ 0 ] = QueryMessage[ 0 ];
+    Message[ 1 ] = QueryMessage[ 1 ];
+    memcpy( &Message[ DNSHeaderLen ], &QueryMessage[ DNSHeaderLen ], Entry->KeyLength );
+
+    DNS_WalkTTLs( Message, Entry->MessageLength, ( Now - Entry->InsertTime ) / 1000 );
+
+    UDPHeader->SourcePort = htons( DNSPort );
+    UDPHeader->DestPort = htons( SLIPIPv4View::View::LoadBE16<UDPOffset_SourcePort>( QueryUDP ) );
+    UDPHeader->Length = htons( sizeof( struct udp_packet ) + Entry->MessageLength );
+    UDPHeader->Checksum = 0;
+
+    PrepareTCPHeader( IPHeader, SLIPIPv4View::DestIP( Query ), SLIPIPv4View::SourceIP( Query ), Entry->MessageLength, 0, IP_PROTO_UDP );
+
+    BridgeQueueing::ToSerial( DNSReplyBuffer, sizeof( struct ip_packet ) + sizeof( struct udp_packet ) + Entry->MessageLength );
+}
+
+/*
+ * Looks at a packet from the serial host, if it is a DNS query we have a
+ * cached answer for the answer is sent back down the serial line.
+ * Returns 1 if the query was answered and should not be forwarded.
+ * Packet must be 4 byte aligned.
+ */
+int DNS_OnQueryFromSerial( const uint8_t* Packet, int Length ) {
+    struct DNSCacheEntry* Entry = NULL;
+    const uint8_t* Message = NULL;
+    uint8_t Key[ DNSMaxQuestionLen ];
+    uint32_t Now = millis( );
+    int MessageLength = 0;
+    int KeyLength = 0;
+
+    if ( ( Message = DNS_GetPayload( Packet, Length, 0, &MessageLength ) ) == NULL )
+        return 0;
+
+    if ( ( DNS_Read16( &Message[ 2 ] ) & ( DNSFlag_QR | DNSOpcodeMask ) ) != 0 )
+        return 0;
+
+    if ( ( KeyLength = DNS_BuildKey( Message, MessageLength, Key ) ) == 0 )
+        return 0;
+
+    if ( ( Entry = DNS_Find( Key, KeyLength, CRC32( Key, KeyLength ), Now ) ) == NULL ) {
+        DNSMisses++;
+        return 0;
+    }
+
+    DNS_SendReply( Packet, Message, Entry, Now );
+    DNSHits++;
+
+    return 1;
+}
+
+/*
+ * Looks at a packet going to the serial host and caches it if it's a DNS answer.
+ * Packet must be 4 byte aligned.
+ */
+void DNS_OnPacketFromWiFi( const uint8_t* Packet, int Length ) {
+    struct DNSCacheEntry* Entry = NULL;
+    const uint8_t* Message = NULL;
+    uint8_t Key[ DNSMaxQuestionLen ];
+    uint32_t KeyHash = 0;
+    uint32_t Now = millis( );
+    uint32_t TTL = 0;
+    uint16_t Flags = 0;
+    int MessageLength = 0;
+    int KeyLength = 0;
+
+    if ( ( Message = DNS_GetPayload( Packet, Length, 1, &MessageLength ) ) == NULL )
+        return;
+
+    Flags = DNS_Read16( &Message[ 2 ] );
+
+    /* Only complete, successful answers with something in them */
+    if ( ( Flags & DNSFlag_QR ) == 0 || ( Flags & ( DNSFlag_TC | DNSOpcodeMask | DNSRCodeMask ) ) != 0 || DNS_Read16( &Message[ 6 ] ) == 0 ) {
+        DNSUncacheable++;
+        return;
+    }
+
+    if ( MessageLength > DNSMaxMessageLen || ( KeyLength = DNS_BuildKey( Message, MessageLength, Key ) ) == 0 ) {
+        DNSUncacheable++;
+        return;
+    }
+
+    KeyHash = CRC32( Key, KeyLength );
+
+    /* Already have it */
+    if ( DNS_Find( Key, KeyLength, KeyHash, Now ) != NULL )
+        return;
+
+    if ( ( TTL = DNS_WalkTTLs( ( uint8_t* ) Message, MessageLength, -1 ) ) == 0 ) {
+        DNSUncacheable++;
+        return;
+    }
+
+    if ( ( KeyLength + MessageLength ) > DNSCacheArenaSize ) {
+        DNSUncacheable++;
+        return;
+    }
+
+    Entry = DNS_FindFreeEntry( );
+    Entry->Set = 0;
+
+    Entry->Offset = DNS_ArenaAlloc( KeyLength + MessageLength );
+    Entry->KeyHash = KeyHash;
+    Entry->KeyLength = KeyLength;
+    Entry->MessageLength = MessageLength;
+    Entry->InsertTime = Now;
+    Entry->TTL = TTL > DNSCacheMaxTTL ? DNSCacheMaxTTL : TTL;
+
+    memcpy( &DNSArena[ Entry->Offset ], Key, KeyLength );
+    memcpy( &DNSArena[ Entry->Offset + KeyLength ], Message, MessageLength );
+
+    Entry->Set = 1;
+    DNSInserts++;
+}
+
+/*
+ * Writes the cache counters to the debug console.
+ */
+void DNS_DumpStats( void ) {
+    DebugPrintf( "%s: Hits/Misses [%u,%u] / Inserts %u / Evictions %u / Uncacheable %u\n", __FUNCTION__, DNSHits, DNSMisses, DNSInserts, DNSEvictions, DNSUncacheable );
+}
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef _DNS_H_
+#define _DNS_H_
+
+/*
+ * Caching DNS forwarder for the serial host.
+ * UDP/53 queries coming off the serial line are answered straight from the
+ * cache when we can, otherwise they go out as usual and the answer is cached
+ * on the way back. Entries live in a fixed size arena and expire with the
+ * smallest TTL in the answer, the TTLs handed out are counted down to match.
+ * Answers from the cache go out with a zero UDP checksum.
+ */
+
+// #define DNS_CACHE_ENABLED
+
+#define DNSCacheEntries 16
+#define DNSCacheArenaSize 3072
+
+/* Don't hold on to anything longer than this no matter what the TTL says */
+#define DNSCacheMaxTTL 3600
+
+#define DNSPort 53
+
+#if defined ( DNS_CACHE_ENABLED )
+
+/*
+ * Looks at a packet from the serial host, if it is a DNS query we have a
+ * cached answer for the answer is sent back down the serial line.
+ * Returns 1 if the query was answered and should not be forwarded.
+ * Packet must be 4 byte aligned.
+ */
+int DNS_OnQueryFromSerial( const uint8_t* Packet, int Length );
+
+/*
+ * Looks at a packet going to the serial host and caches it if it's a DNS answer.
+ * Packet must be 4 byte aligned.
+ */
+void DNS_OnPacketFromWiFi( const uint8_t* Packet, int Length );
+
+/*
+ * Writes the cache counters to the debug console.
+ */
+void DNS_DumpStats( void );
+
+#else
+
+#define DNS_OnQueryFromSerial( a, b ) 0
+#define DNS_OnPacketFromWiFi( a, b )
+#define DNS_DumpStats( )
+
+#endif
+
+#endif
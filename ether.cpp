@@ -6,6 +6,15 @@
 #include "util.h"
 #include "slip.h"
 #include "mydebug.h"
+#include "hdrview.h"
+#include "bridge.h"
+#include "flows.h"
+#include "dns.h"
+#include "capture.h"
+#include "splittcp.h"
+#include "ethertx.h"
+#include "trafficgen.h"
+#include "hotpath.h"
 
 extern "C" {
 #include <netif/wlan_lwip_if.h>
@@ -17,7 +26,9 @@ extern "C" {
 
 static struct ARPEntry ARPTable[ ARPTableEntries ];
 
-extern netif_linkoutput_fn OriginalLinkoutputFn;
+/* Bumped whenever the table changes so anything derived from it knows to rebuild */
+static uint32_t ARPTableGeneration = 1;
+
 extern netif_output_fn OriginalOutputFn;
 extern struct netif* ESPif;
 
@@ -26,6 +37,8 @@ static void ARP_RespondToRequest( struct ARPHeader* ARP );
 
 uint8_t BroadcastMACAddress[ MACAddressLen ] = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
 
+uint32_t BridgeIngressErrors[ IngressError_Count ];
+
 /*
  * Returns 1 if the given IP is on the same subnet as us. 
  */
@@ -36,6 +49,13 @@ int AreWeOnTheSameSubnet( uint32_t IPAddress ) {
   return A == B ? 1 : 0;
 }
 
+/*
+ * Returns the broadcast address of our subnet (network byte order).
+ */
+uint32_t SubnetBroadcastIP( void ) {
+  return ( uint32_t ) OurIPAddress | ~( uint32_t ) OurNetmask;
+}
+
 /*
  * Sets up an ethernet frame header, pretty straightforward. 
  */
@@ -49,18 +69,27 @@ int PrepareEthernetHeader( struct EtherFrame* FrameHeader, const uint8_t* Source
 
 /*
  * Called when the network interface receives an ethernet frame. 
+ * Data must sit (EtherFrameHeadroom) bytes past a 4 byte boundary.
  */
-void OnDataReceived( const uint8_t* Data, int Length ) {
-  struct EtherFrame* EHeader = ( struct EtherFrame* ) Data;
-  struct ip_packet* IPHeader = ( struct ip_packet* ) &Data[ sizeof( struct EtherFrame ) ];
+void FASTPATH OnDataReceived( const uint8_t* Data, int Length ) {
+  Capture_Packet( CaptureDir_FromWiFi, Data, Length );
 
-  switch ( htons( EHeader->LengthOrType ) ) {
+  /* Belongs to one of the split TCP proxy's upstream connections */
+  if ( SplitTCP_OnFrameFromWiFi( Data, Length ) )
+    return;
+
+  switch ( RXEtherView::Type( Data ) ) {
     case EtherType_IPv4: {
-      if ( IPHeader->DestIP == OurIPAddress )
-        SLIP_WritePacket( &Data[ sizeof( struct EtherFrame ) ], Length - sizeof( struct EtherFrame ) );
+      if ( Length >= ( int ) ( sizeof( struct EtherFrame ) + sizeof( struct ip_packet ) ) ) {
+        if ( TrafficGen_OnPacketFromWiFi( &Data[ sizeof( struct EtherFrame ) ], Length - sizeof( struct EtherFrame ) ) )
+          break;
+
+        if ( Bridge::OnIPv4FromWiFi( Data, Length ) ) {
+          Flow_Account( FlowDir_FromWiFi, &Data[ sizeof( struct EtherFrame ) ], Length - sizeof( struct EtherFrame ) );
+          DNS_OnPacketFromWiFi( &Data[ sizeof( struct EtherFrame ) ], Length - sizeof( struct EtherFrame ) );
+        }
+      }
 
-      //SLIP_QueuePacketForWrite( &Data[ sizeof( struct EtherFrame ) ], Length - sizeof( struct EtherFrame ) );
-      //OnIPv4Packet( &Data[ sizeof( struct EtherFrame ) ], Length, ( const struct EtherFrame* ) Data );
       break;
     }
     case EtherType_ARP: {
@@ -76,27 +105,26 @@ void OnDataReceived( const uint8_t* Data, int Length ) {
 /*
  * Writes the given ethernet frame to the network interface. 
  */
-err_t EtherWrite( void* Data, int Length ) {
-  struct pbuf* OutPBuf = NULL;
-  err_t Result = ERR_OK;
+err_t FASTPATH EtherWrite( void* Data, int Length ) {
+  Capture_Packet( CaptureDir_ToWiFi, ( const uint8_t* ) Data, Length );
 
-  OutPBuf = pbuf_alloc( PBUF_LINK, Length, PBUF_RAM );
-
-  if ( OutPBuf ) {
-    memcpy( OutPBuf->payload, Data, Length );
+  return EtherTX_Write( ( const uint8_t* ) Data, Length );
+}
 
-    Result = OriginalLinkoutputFn( ESPif, OutPBuf );
-    pbuf_free( OutPBuf );
-  }
+/*
+ * Writes a frame we built ourselves as a header and a payload.
+ */
+err_t FASTPATH EtherWriteParts( const uint8_t* Header, int HeaderLength, const uint8_t* Payload, int PayloadLength ) {
+  Capture_PacketParts( CaptureDir_ToWiFi, Header, HeaderLength, Payload, PayloadLength );
 
-  return Result;
+  return EtherTX_WriteParts( Header, HeaderLength, Payload, PayloadLength );
 }
 
 /*
  * Simple enough, call this to respond to an ARP request. 
  */
 static void ARP_RespondToRequest( struct ARPHeader* ARP ) {
-    uint8_t Buffer[ 512 ];
+    uint8_t Buffer[ sizeof( struct EtherFrame ) + sizeof( struct ARPHeader ) ];
     struct ARPHeader* Response = ( struct ARPHeader* ) &Buffer[ sizeof( struct EtherFrame ) ];
     struct EtherFrame* Frame = ( struct EtherFrame* ) Buffer;
 
@@ -113,10 +141,11 @@ static void ARP_RespondToRequest( struct ARPHeader* ARP ) {
     memcpy( Response->TargetMAC, ARP->SenderMAC, MACAddressLen );
     memcpy( Response->SenderMAC, OurMACAddress, MACAddressLen );
 
-    Response->SenderIP = OurIPAddress;
+    /* In proxy ARP mode this isn't necessarily our own address */
+    Response->SenderIP = ARP->TargetIP;
     Response->TargetIP = ARP->SenderIP;
 
-    EtherWrite( Buffer, sizeof( struct EtherFrame ) + sizeof( struct ARPHeader ) );
+    EtherWriteParts( Buffer, sizeof( Buffer ), NULL, 0 );
 }
 
 /*
@@ -130,7 +159,7 @@ static void OnARPPacket( struct ARPHeader* ARP ) {
    * If so, send a timely response. 
    */
   if ( IsRequest ) {
-    if ( ARP->TargetIP == OurIPAddress ) {
+    if ( Bridge::ShouldAnswerARP( ARP->TargetIP ) ) {
       ARP_RespondToRequest( ARP );
     }
   }
@@ -151,7 +180,7 @@ static void ARP_AddDefaultRoutes( void ) {
 /*
  * Zeroes the ARP table and adds a static entry for ourself. 
  */
-void ARP_Init( void ) {
+void COLDPATH ARP_Init( void ) {
     ARP_ClearTable( );
     ARP_AddDefaultRoutes( );
 }
@@ -168,6 +197,7 @@ struct ARPEntry* ARP_AddStaticRoute( uint32_t IP, uint8_t* MACAddress ) {
     Entry->Set = 1;
 
     memcpy( Entry->MACAddress, MACAddress, MACAddressLen );
+    ARPTableGeneration++;
   }
 
   return Entry;
@@ -180,6 +210,10 @@ void ARP_Tick( void ) {
     static uint32_t NextFlush = 0;
     uint32_t Now = millis( );
 
+    /* Don't throw away entries seeded during setup on the very first tick */
+    if ( NextFlush == 0 )
+      NextFlush = Now + TimeToFlushARP;
+
     if ( Now >= NextFlush ) {
       NextFlush = Now + TimeToFlushARP;
 
@@ -193,6 +227,14 @@ void ARP_Tick( void ) {
  */
 void ARP_ClearTable( void ) {
   memset( ARPTable, 0, sizeof( ARPTable ) );
+  ARPTableGeneration++;
+}
+
+/*
+ * Returns a number that changes every time an entry is added, replaced or cleared.
+ */
+uint32_t ARP_Generation( void ) {
+  return ARPTableGeneration;
 }
 
 /*
@@ -273,6 +315,8 @@ struct ARPEntry* ARP_AddToTable( const uint8_t* MAC, uint32_t IP ) {
                 Ptr->TimeAdded = millis( );
                 Ptr->IPAddress = IP;
                 Ptr->Set = 1;
+
+                ARPTableGeneration++;
             }
         }
     }
@@ -282,7 +326,7 @@ struct ARPEntry* ARP_AddToTable( const uint8_t* MAC, uint32_t IP ) {
 /*
  * Writes the ARP table contents to the console. 
  */
-void ARP_DumpTableToConsole( void ) {
+void COLDPATH ARP_DumpTableToConsole( void ) {
 #if 0
     static char Text[ 256 ];
     char MACString[ 32 ];
@@ -341,7 +385,7 @@ void ARP_RequestMACFromIP( uint32_t IP ) {
     ARPPacket->TargetIP = IP;                   /* Who we're lookin' for */
     ARPPacket->SenderIP = WiFi.localIP( );      /* Who we are */
 
-    EtherWrite( Buffer, sizeof( Buffer ) );
+    EtherWriteParts( Buffer, sizeof( Buffer ), NULL, 0 );
 }
 
 /*
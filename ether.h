@@ -44,6 +44,11 @@ struct ARPEntry {
  */
 int AreWeOnTheSameSubnet( uint32_t IPAddress );
 
+/*
+ * Returns the broadcast address of our subnet (network byte order).
+ */
+uint32_t SubnetBroadcastIP( void );
+
 /*
  * Sets up an ethernet frame header, pretty straightforward. 
  */
@@ -51,6 +56,7 @@ int PrepareEthernetHeader( struct EtherFrame* FrameHeader, const uint8_t* Source
 
 /*
  * Called when the network interface receives an ethernet frame. 
+ * Data must sit (EtherFrameHeadroom) bytes past a 4 byte boundary.
  */
 void OnDataReceived( const uint8_t* Data, int Length );
 
@@ -58,6 +64,7 @@ void OnDataReceived( const uint8_t* Data, int Length );
  * Writes the given ethernet frame to the network interface. 
  */
 err_t EtherWrite( void* Data, int Length );
+err_t EtherWriteParts( const uint8_t* Header, int HeaderLength, const uint8_t* Payload, int PayloadLength );
 
 /*
  * Finds the oldest entry in the ARP table so it can be reused. 
@@ -69,6 +76,11 @@ struct ARPEntry* ARP_FindOldestEntry( void );
  */
 void ARP_ClearTable( void );
 
+/*
+ * Returns a number that changes every time an entry is added, replaced or cleared.
+ */
+uint32_t ARP_Generation( void );
+
 /* Looks for an unused "slot" in the ARP table, returns a pointer
  * to it if found, otherwise NULL. 
  */
@@ -0,0 +1,283 @@
+#include <ESP8266WiFi.h>
+#include <lwip/netif.h>
+#include <lwip/err.h>
+#include "ether.h"
+#include "ipv4.h"
+#include "util.h"
+#include "slip.h"
+#include "mydebug.h"
+#include "ethertx.h"
+#include "hotpath.h"
+
+struct EtherTXSlot {
+    struct pbuf* PBuf;
+
+    /* Where the payload started, the driver may move it with pbuf_header */
+    void* Payload;
+};
+
+/* Holds its own reference on the pbuf so the slot isn't handed out again */
+struct EtherTXRetry {
+    struct pbuf* PBuf;
+    uint32_t FirstTry;
+};
+
+extern netif_linkoutput_fn OriginalLinkoutputFn;
+extern struct netif* ESPif;
+extern int IsConnectedToWiFi;
+
+static struct EtherTXSlot Pool[ EtherTXPoolSize ];
+static struct EtherTXSlot HeaderPool[ EtherTXHeaderPoolSize ];
+static int PoolReady = 0;
+
+static struct EtherTXRetry RetryQueue[ EtherTXRetryQueueLen ];
+static int RetryHead = 0;
+static int RetryCount = 0;
+
+static uint32_t FramesSent = 0;
+static uint32_t FramesRetried = 0;
+static uint32_t RetrySuccesses = 0;
+static uint32_t RetryTimeouts = 0;
+static uint32_t RetryFlushed = 0;
+static uint32_t PoolExhausted = 0;
+static uint32_t DriverErrors = 0;
+static uint32_t TooBig = 0;
+static uint32_t PartsCopied = 0;
+
+static void EtherTX_AllocPool( struct EtherTXSlot* Slots, int Count, int Length ) {
+    int i = 0;
+
+    for ( i = 0; i < Count; i++ ) {
+        if ( ( Slots[ i ].PBuf = pbuf_alloc( PBUF_LINK, Length, PBUF_RAM ) ) == NULL ) {
+            DebugPrintf( "%s: Only got %d of %d pbufs.\n", __FUNCTION__, i, Count );
+            break;
+        }
+
+        Slots[ i ].Payload = Slots[ i ].PBuf->payload;
+    }
+}
+
+/*
+ * Allocates the pbuf pools.
+ */
+void COLDPATH EtherTX_Init( void ) {
+    if ( PoolReady )
+        return;
+
+    EtherTX_AllocPool( Pool, EtherTXPoolSize, EtherTXMaxFrameLen );
+    EtherTX_AllocPool( HeaderPool, EtherTXHeaderPoolSize, EtherTXHeaderBufLen );
+
+    PoolReady = 1;
+}
+
+/*
+ * Returns a slot the driver is done with, or NULL if they're all busy.
+ */
+static FASTPATH struct EtherTXSlot* EtherTX_TakeSlot( struct EtherTXSlot* Slots, int Count, int Length ) {
+    struct EtherTXSlot* Slot = NULL;
+    int i = 0;
+
+    for ( i = 0; i < Count; i++ ) {
+        Slot = &Slots[ i ];
+
+        if ( Slot->PBuf && Slot->PBuf->ref == 1 ) {
+            Slot->PBuf->payload = Slot->Payload;
+            Slot->PBuf->len = Length;
+            Slot->PBuf->tot_len = Length;
+
+            return Slot;
+        }
+    }
+
+    return NULL;
+}
+
+static err_t FASTPATH EtherTX_Send( struct pbuf* PBuf ) {
+    err_t Result = OriginalLinkoutputFn( ESPif, PBuf );
+
+    if ( Result == ERR_OK )
+        FramesSent++;
+    else if ( Result != ERR_MEM )
+        DriverErrors++;
+
+    return Result;
+}
+
+static void EtherTX_QueueRetry( struct pbuf* PBuf ) {
+    struct EtherTXRetry* Retry = &RetryQueue[ ( RetryHead + RetryCount ) % EtherTXRetryQueueLen ];
+
+    pbuf_ref( PBuf );
+
+    Retry->PBuf = PBuf;
+    Retry->FirstTry = millis( );
+
+    RetryCount++;
+    FramesRetried++;
+}
+
+static void EtherTX_PopRetry( void ) {
+    pbuf_free( RetryQueue[ RetryHead ].PBuf );
+
+    RetryHead = ( RetryHead + 1 ) % EtherTXRetryQueueLen;
+    RetryCount--;
+}
+
+/*
+ * Hands a filled in frame to the driver, or queues it behind frames already waiting.
+ */
+static err_t FASTPATH EtherTX_Submit( struct pbuf* PBuf ) {
+    err_t Result = ERR_OK;
+
+    if ( RetryCount > 0 ) {
+        if ( RetryCount >= EtherTXRetryQueueLen ) {
+            PoolExhausted++;
+            return ERR_MEM;
+        }
+
+        EtherTX_QueueRetry( PBuf );
+        return ERR_OK;
+    }
+
+    if ( ( Result = EtherTX_Send( PBuf ) ) == ERR_MEM ) {
+        EtherTX_QueueRetry( PBuf );
+        return ERR_OK;
+    }
+
+    return Result;
+}
+
+/*
+ * Copies an ethernet frame into a pool pbuf and hands it to the driver,
+ * queueing it for another try if the driver is out of memory.
+ * Returns ERR_OK if it was sent or queued.
+ */
+err_t FASTPATH EtherTX_Write( const uint8_t* Frame, int Length ) {
+    struct EtherTXSlot* Slot = NULL;
+
+    if ( PoolReady == 0 )
+        EtherTX_Init( );
+
+    if ( Length > EtherTXMaxFrameLen ) {
+        TooBig++;
+        return ERR_BUF;
+    }
+
+    /* Older frames get another go first so they stay in order */
+    EtherTX_Tick( );
+
+    if ( ( Slot = EtherTX_TakeSlot( Pool, EtherTXPoolSize, Length ) ) == NULL ) {
+        PoolExhausted++;
+        return ERR_MEM;
+    }
+
+    memcpy( Slot->PBuf->payload, Frame, Length );
+
+    return EtherTX_Submit( Slot->PBuf );
+}
+
+/*
+ * Sends a frame made of a header (the ethernet header and whatever follows it)
+ * and a payload without assembling them in a buffer first.
+ * Returns ERR_OK if it was sent or queued.
+ */
+err_t FASTPATH EtherTX_WriteParts( const uint8_t* Header, int HeaderLength, const uint8_t* Payload, int PayloadLength ) {
+    struct EtherTXSlot* Slot = NULL;
+    int Length = HeaderLength + PayloadLength;
+
+    if ( PoolReady == 0 )
+        EtherTX_Init( );
+
+    if ( Length > EtherTXMaxFrameLen ) {
+        TooBig++;
+        return ERR_BUF;
+    }
+
+    EtherTX_Tick( );
+
+    /* Keep the forwarding pool for forwarding when the whole frame fits in a header pbuf */
+    if ( Length > EtherTXHeaderBufLen || ( Slot = EtherTX_TakeSlot( HeaderPool, EtherTXHeaderPoolSize, Length ) ) == NULL ) {
+        if ( ( Slot = EtherTX_TakeSlot( Pool, EtherTXPoolSize, Length ) ) == NULL ) {
+            PoolExhausted++;
+            return ERR_MEM;
+        }
+    }
+
+    memcpy( Slot->PBuf->payload, Header, HeaderLength );
+
+    if ( PayloadLength > 0 )
+        memcpy( ( uint8_t* ) Slot->PBuf->payload + HeaderLength, Payload, PayloadLength );
+
+    PartsCopied++;
+    return EtherTX_Submit( Slot->PBuf );
+}
+
+/*
+ * Called every "frame" or run through the main loop, retries queued frames.
+ * Runs whether or not WiFi is up, queued frames are dropped while it's down.
+ */
+void EtherTX_Tick( void ) {
+    struct EtherTXRetry* Retry = NULL;
+    err_t Result = ERR_OK;
+
+    /* The driver won't take anything until the AP is back, don't sit on the frames for the whole outage */
+    if ( IsConnectedToWiFi == 0 ) {
+        while ( RetryCount > 0 ) {
+            RetryFlushed++;
+            EtherTX_PopRetry( );
+        }
+
+        return;
+    }
+
+    while ( RetryCount > 0 ) {
+        Retry = &RetryQueue[ RetryHead ];
+
+        if ( ( millis( ) - Retry->FirstTry ) >= EtherTXRetryTimeoutMS ) {
+            RetryTimeouts++;
+            EtherTX_PopRetry( );
+
+            continue;
+        }
+
+        /* Driver is still full, try again next time */
+        if ( ( Result = EtherTX_Send( Retry->PBuf ) ) == ERR_MEM )
+            break;
+
+        if ( Result == ERR_OK )
+            RetrySuccesses++;
+
+        EtherTX_PopRetry( );
+    }
+}
+
+/*
+ * Returns 1 if frames are waiting for the driver or no pool pbuf is free,
+ * the SLIP reader should leave bytes in the UART until this clears.
+ * Always 0 while WiFi is down, the link hold queue takes over then.
+ */
+int EtherTX_IsBackedUp( void ) {
+    int i = 0;
+
+    /* While the link is down packets go to the hold queue, not to us */
+    if ( IsConnectedToWiFi == 0 )
+        return 0;
+
+    if ( RetryCount > 0 )
+        return 1;
+
+    for ( i = 0; i < EtherTXPoolSize; i++ ) {
+        if ( Pool[ i ].PBuf && Pool[ i ].PBuf->ref == 1 )
+            return 0;
+    }
+
+    return PoolReady;
+}
+
+/*
+ * Writes the transmit counters to the debug console.
+ */
+void EtherTX_DumpStats( void ) {
+    DebugPrintf( "%s: Sent %u / ERR_MEM retried/recovered/timed out/flushed [%u,%u,%u,%u] / Pool exhausted %u / Driver errors %u / Too big %u\n", __FUNCTION__,
+        FramesSent, FramesRetried, RetrySuccesses, RetryTimeouts, RetryFlushed, PoolExhausted, DriverErrors, TooBig );
+    DebugPrintf( "%s: Frames sent in parts %u\n", __FUNCTION__, PartsCopied );
+}
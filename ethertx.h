@@ -0,0 +1,62 @@
+#ifndef _ETHERTX_H_
+#define _ETHERTX_H_
+
+/*
+ * Transmit side of the WiFi interface.
+ * Frames go out in pbufs from a pool allocated once at startup. A pool
+ * pbuf is ours again once the driver has dropped its reference (ref back
+ * to 1). When the driver says ERR_MEM the frame is kept in a short retry
+ * queue instead of being lost, and the SLIP reader is held off until
+ * the queue drains.
+ */
+
+#define EtherTXPoolSize 6
+#define EtherTXMaxFrameLen 1514
+
+/* Header pool, enough for ARP and a UDP/IPv4 header with a short payload */
+#define EtherTXHeaderPoolSize 4
+#define EtherTXHeaderBufLen 128
+
+#define EtherTXRetryQueueLen 4
+
+/* A frame that still can't go out after this long is dropped */
+#define EtherTXRetryTimeoutMS 200
+
+/*
+ * Allocates the pbuf pools.
+ */
+void EtherTX_Init( void );
+
+/*
+ * Copies an ethernet frame into a pool pbuf and hands it to the driver,
+ * queueing it for another try if the driver is out of memory.
+ * Returns ERR_OK if it was sent or queued.
+ */
+err_t EtherTX_Write( const uint8_t* Frame, int Length );
+
+/*
+ * Sends a frame made of a header (the ethernet header and whatever follows it)
+ * and a payload without assembling them in a buffer first.
+ * Returns ERR_OK if it was sent or queued.
+ */
+err_t EtherTX_WriteParts( const uint8_t* Header, int HeaderLength, const uint8_t* Payload, int PayloadLength );
+
+/*
+ * Called every "frame" or run through the main loop, retries queued frames.
+ * Runs whether or not WiFi is up, queued frames are dropped while it's down.
+ */
+void EtherTX_Tick( void );
+
+/*
+ * Returns 1 if frames are waiting for the driver or no pool pbuf is free,
+ * the SLIP reader should leave bytes in the UART until this clears.
+ * Always 0 while WiFi is down, the link hold queue takes over then.
+ */
+int EtherTX_IsBackedUp( void );
+
+/*
+ * Writes the transmit counters to the debug console.
+ */
+void EtherTX_DumpStats( void );
+
+#endif
@@ -0,0 +1,213 @@
+#include <ESP8266WiFi.h>
+#include <lwip/netif.h>
+#include <lwip/err.h>
+#include "ether.h"
+#include "ipv4.h"
+#include "util.h"
+#include "slip.h"
+#include "mydebug.h"
+#include "hdrview.h"
+#include "flows.h"
+
+#define IP_PROTO_TCP 0x06
+
+/* Keeps 5-tuples and remote IPs apart in the shared sketch */
+#define FlowKeyTag_Tuple 0x5F10
+#define FlowKeyTag_Remote 0x4E07
+
+static uint32_t FlowSketch[ FlowSketchDepth ][ FlowSketchWidth ];
+static struct FlowEntry TopFlows[ FlowTopEntries ];
+static struct FlowEntry TopRemotes[ FlowTopEntries ];
+
+static const uint32_t FlowSketchSeeds[ FlowSketchDepth ] = { 0x9E3779B1, 0x85EBCA77, 0xC2B2AE3D };
+
+static uint32_t FlowTotalBytes[ FlowDir_Count ];
+static uint32_t FlowTotalPackets[ FlowDir_Count ];
+
+static inline uint32_t Flow_Mix( uint32_t h ) {
+    h^= h >> 16;
+    h*= 0x85EBCA6B;
+    h^= h >> 13;
+    h*= 0xC2B2AE35;
+    h^= h >> 16;
+
+    return h;
+}
+
+static inline uint32_t Flow_HashKey( const struct FlowKey* Key, uint32_t Tag ) {
+    uint32_t h = Tag;
+
+    h = Flow_Mix( h ^ Key->SourceIP );
+    h = Flow_Mix( h ^ Key->DestIP );
+    h = Flow_Mix( h ^ ( ( ( uint32_t ) Key->SourcePort << 16 ) | Key->DestPort ) );
+    h = Flow_Mix( h ^ ( ( ( uint32_t ) Key->Protocol << 8 ) | Key->Direction ) );
+
+    return h;
+}
+
+/*
+ * Adds Bytes to every row of the sketch and returns the new (over)estimate for the key.
+ */
+static uint32_t Flow_SketchAdd( uint32_t Hash, uint32_t Bytes ) {
+    uint32_t Estimate = 0xFFFFFFFF;
+    uint32_t* Counter = NULL;
+    int i = 0;
+
+    for ( i = 0; i < FlowSketchDepth; i++ ) {
+        Counter = &FlowSketch[ i ][ Flow_Mix( Hash ^ FlowSketchSeeds[ i ] ) & ( FlowSketchWidth - 1 ) ];
+        *Counter+= Bytes;
+
+        if ( *Counter < Estimate )
+            Estimate = *Counter;
+    }
+
+    return Estimate;
+}
+
+/*
+ * Updates a heavy hitter table, if the key isn't in it it replaces the
+ * smallest entry once the sketch says it has grown bigger than that.
+ */
+static void Flow_UpdateTop( struct FlowEntry* Table, const struct FlowKey* Key, uint32_t Estimate, uint32_t Bytes ) {
+    struct FlowEntry* Smallest = &Table[ 0 ];
+    int i = 0;
+
+    for ( i = 0; i < FlowTopEntries; i++ ) {
+        if ( Table[ i ].Set && memcmp( &Table[ i ].Key, Key, sizeof( struct FlowKey ) ) == 0 ) {
+            Table[ i ].Bytes+= Bytes;
+            Table[ i ].Packets++;
+            return;
+        }
+
+        if ( Table[ i ].Set == 0 || Table[ i ].Bytes < Smallest->Bytes )
+            Smallest = &Table[ i ];
+    }
+
+    if ( Smallest->Set == 0 || Estimate > Smallest->Bytes ) {
+        memcpy( &Smallest->Key, Key, sizeof( struct FlowKey ) );
+
+        Smallest->Bytes = Estimate;
+        Smallest->Packets = 1;
+        Smallest->Set = 1;
+    }
+}
+
+/*
+ * Accounts for an IPv4 packet crossing the bridge, Packet must be 4 byte aligned.
+ */
+void Flow_Account( int Direction, const uint8_t* Packet, int Length ) {
+    struct FlowKey Key;
+    uint32_t Bytes = 0;
+    int HeaderLength = 0;
+
+    if ( Length < ( int ) sizeof( struct ip_packet ) )
+        return;
+
+    HeaderLength = SLIPIPv4View::HeaderLength( Packet );
+    Bytes = SLIPIPv4View::Length( Packet );
+
+    memset( &Key, 0, sizeof( Key ) );
+
+    Key.SourceIP = SLIPIPv4View::SourceIP( Packet );
+    Key.DestIP = SLIPIPv4View::DestIP( Packet );
+    Key.Protocol = SLIPIPv4View::Protocol( Packet );
+    Key.Direction = Direction;
+
+    if ( ( Key.Protocol == IP_PROTO_TCP || Key.Protocol == IP_PROTO_UDP ) && ( HeaderLength + 4 ) <= Length ) {
+        Key.SourcePort = SLIPIPv4View::View::LoadBE16<UDPOffset_SourcePort>( &Packet[ HeaderLength ] );
+        Key.DestPort = SLIPIPv4View::View::LoadBE16<UDPOffset_DestPort>( &Packet[ HeaderLength ] );
+    }
+
+    FlowTotalBytes[ Direction ]+= Bytes;
+    FlowTotalPackets[ Direction ]++;
+
+    Flow_UpdateTop( TopFlows, &Key, Flow_SketchAdd( Flow_HashKey( &Key, FlowKeyTag_Tuple ), Bytes ), Bytes );
+
+    /* The remote end is whoever isn't the serial host */
+    if ( Direction == FlowDir_FromWiFi )
+        Key.DestIP = 0;
+    else
+        Key.SourceIP = 0;
+
+    Key.SourcePort = Key.DestPort = 0;
+    Key.Protocol = 0;
+
+    Flow_UpdateTop( TopRemotes, &Key, Flow_SketchAdd( Flow_HashKey( &Key, FlowKeyTag_Remote ), Bytes ), Bytes );
+}
+
+static void Flow_DumpTable( const char* Title, const struct FlowEntry* Table ) {
+    char SourceIPStr[ 32 ];
+    char DestIPStr[ 32 ];
+    int i = 0;
+
+    DebugPrintf( "%s:\n", Title );
+
+    for ( i = 0; i < FlowTopEntries; i++ ) {
+        if ( Table[ i ].Set == 0 )
+            continue;
+
+        IPsprintf( Table[ i ].Key.SourceIP, SourceIPStr, sizeof( SourceIPStr ) );
+        IPsprintf( Table[ i ].Key.DestIP, DestIPStr, sizeof( DestIPStr ) );
+
+        DebugPrintf( "  %s %s:%u -> %s:%u [Proto:%02X] %u bytes / %u packets\n", Table[ i ].Key.Direction == FlowDir_FromWiFi ? "IN " : "OUT",
+            SourceIPStr, Table[ i ].Key.SourcePort, DestIPStr, Table[ i ].Key.DestPort, Table[ i ].Key.Protocol, Table[ i ].Bytes, Table[ i ].Packets );
+    }
+}
+
+/*
+ * Writes the top flows and top remote hosts to the debug console.
+ */
+void Flow_DumpTopTalkers( void ) {
+    DebugPrintf( "%s: IN %u bytes / %u packets, OUT %u bytes / %u packets\n", __FUNCTION__,
+        FlowTotalBytes[ FlowDir_FromWiFi ], FlowTotalPackets[ FlowDir_FromWiFi ], FlowTotalBytes[ FlowDir_ToWiFi ], FlowTotalPackets[ FlowDir_ToWiFi ] );
+
+    Flow_DumpTable( "Top flows", TopFlows );
+    Flow_DumpTable( "Top remote hosts", TopRemotes );
+}
+
+/*
+ * Clears the sketch and the heavy hitter tables.
+ */
+void Flow_Reset( void ) {
+    memset( FlowSketch, 0, sizeof( FlowSketch ) );
+    memset( TopFlows, 0, sizeof( TopFlows ) );
+    memset( TopRemotes, 0, sizeof( TopRemotes ) );
+    memset( FlowTotalBytes, 0, sizeof( FlowTotalBytes ) );
+    memset( FlowTotalPackets, 0, sizeof( FlowTotalPackets ) );
+}
+
+/*
+ * Halves every counter, old heavy hitters fade out instead of sticking around forever.
+ */
+static void Flow_Decay( void ) {
+    int i = 0;
+    int j = 0;
+
+    for ( i = 0; i < FlowSketchDepth; i++ ) {
+        for ( j = 0; j < FlowSketchWidth; j++ )
+            FlowSketch[ i ][ j ]>>= 1;
+    }
+
+    for ( i = 0; i < FlowTopEntries; i++ ) {
+        TopFlows[ i ].Bytes>>= 1;
+        TopRemotes[ i ].Bytes>>= 1;
+    }
+}
+
+/*
+ * Called every "frame" or run through the main loop.
+ */
+void Flow_Tick( void ) {
+    static uint32_t NextDecay = 0;
+    uint32_t Now = millis( );
+
+    if ( NextDecay == 0 )
+        NextDecay = Now + FlowDecayIntervalMS;
+
+    if ( Now >= NextDecay ) {
+        NextDecay = Now + FlowDecayIntervalMS;
+
+        Flow_DumpTopTalkers( );
+        Flow_Decay( );
+    }
+}
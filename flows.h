@@ -0,0 +1,62 @@
+#ifndef _FLOWS_H_
+#define _FLOWS_H_
+
+/*
+ * Fixed memory top talker accounting.
+ * Bytes for every 5-tuple and remote IP go into a count-min sketch, and the
+ * keys with the largest estimates are kept in two small heavy hitter tables.
+ * The cost per packet is a few hashes and a scan of FlowTopEntries entries
+ * no matter how many flows there are.
+ */
+
+#define FlowSketchDepth 3
+#define FlowSketchWidth 256
+#define FlowTopEntries 8
+
+/* Counters are halved this often so the tables follow current traffic */
+#define FlowDecayIntervalMS SecondsToMS( 60 )
+
+enum {
+    FlowDir_FromWiFi = 0,
+    FlowDir_ToWiFi,
+    FlowDir_Count
+};
+
+struct FlowKey {
+    uint32_t SourceIP;
+    uint32_t DestIP;
+    uint16_t SourcePort;
+    uint16_t DestPort;
+    uint8_t Protocol;
+    uint8_t Direction;
+    uint8_t Pad[ 2 ];
+};
+
+struct FlowEntry {
+    struct FlowKey Key;
+    uint32_t Bytes;
+    uint32_t Packets;
+    int Set;
+};
+
+/*
+ * Accounts for an IPv4 packet crossing the bridge, Packet must be 4 byte aligned.
+ */
+void Flow_Account( int Direction, const uint8_t* Packet, int Length );
+
+/*
+ * Writes the top flows and top remote hosts to the debug console.
+ */
+void Flow_DumpTopTalkers( void );
+
+/*
+ * Clears the sketch and the heavy hitter tables.
+ */
+void Flow_Reset( void );
+
+/*
+ * Called every "frame" or run through the main loop.
+ */
+void Flow_Tick( void );
+
+#endif
@@ -0,0 +1,156 @@
+#ifndef _HDRVIEW_H_
+#define _HDRVIEW_H_
+
+/*
+ * Alignment aware protocol header accessors.
+ *
+ * Casting the packed structs in ether.h/ipv4.h onto a buffer works, but since the
+ * compiler can't know where the buffer is it has to read every multi-byte field
+ * a byte at a time (an aligned-looking 32 bit load on a misaligned address is a
+ * LoadStoreAlignment exception on the lx106).
+ *
+ * These views are told at compile time that the buffer address is (Misalign)
+ * bytes past an (Align) byte boundary, so for every field they pick the widest
+ * load that is actually safe at that offset. With 2 bytes of headroom in front
+ * of an ethernet frame the IPv4 header lands on a 4 byte boundary and the
+ * address fields become single 32 bit loads.
+ *
+ * Load32/Load16 return the field as it sits in memory (network byte order),
+ * same as reading the struct member. LoadBE16 returns it in host byte order.
+ */
+
+#define EtherOffset_DestMAC 0
+#define EtherOffset_SourceMAC 6
+#define EtherOffset_Type 12
+
+#define IPv4Offset_VersionIHL 0
+#define IPv4Offset_TypeOfService 1
+#define IPv4Offset_Length 2
+#define IPv4Offset_Protocol 9
+#define IPv4Offset_HeaderChecksum 10
+#define IPv4Offset_SourceIP 12
+#define IPv4Offset_DestIP 16
+
+#define UDPOffset_SourcePort 0
+#define UDPOffset_DestPort 2
+#define UDPOffset_Length 4
+
+/* Bytes in front of a received ethernet frame so that the IP header is 4 byte aligned */
+#define EtherFrameHeadroom 2
+
+/*
+ * Largest power of two (up to Align) that divides (Misalign + Offset).
+ */
+static constexpr int Header_FieldAlignment( int Align, int Position ) {
+    return Align <= 1 ? 1 : ( ( Position % Align ) == 0 ? Align : Header_FieldAlignment( Align / 2, Position ) );
+}
+
+template <int Alignment>
+struct HeaderRawLoad {
+    static inline uint32_t Load32( const uint8_t* p ) {
+        return ( uint32_t ) p[ 0 ] | ( ( uint32_t ) p[ 1 ] << 8 ) | ( ( uint32_t ) p[ 2 ] << 16 ) | ( ( uint32_t ) p[ 3 ] << 24 );
+    }
+
+    static inline uint16_t Load16( const uint8_t* p ) {
+        return ( uint16_t ) ( p[ 0 ] | ( p[ 1 ] << 8 ) );
+    }
+};
+
+/*
+ * memcpy from a pointer the compiler knows is aligned becomes a single load
+ * and doesn't upset strict aliasing.
+ */
+template <>
+struct HeaderRawLoad<2> {
+    static inline uint32_t Load32( const uint8_t* p ) {
+        uint16_t Lo = 0;
+        uint16_t Hi = 0;
+
+        __builtin_memcpy( &Lo, __builtin_assume_aligned( p, 2 ), 2 );
+        __builtin_memcpy( &Hi, __builtin_assume_aligned( p + 2, 2 ), 2 );
+
+        return ( uint32_t ) Lo | ( ( uint32_t ) Hi << 16 );
+    }
+
+    static inline uint16_t Load16( const uint8_t* p ) {
+        uint16_t Value = 0;
+
+        __builtin_memcpy( &Value, __builtin_assume_aligned( p, 2 ), 2 );
+        return Value;
+    }
+};
+
+template <>
+struct HeaderRawLoad<4> {
+    static inline uint32_t Load32( const uint8_t* p ) {
+        uint32_t Value = 0;
+
+        __builtin_memcpy( &Value, __builtin_assume_aligned( p, 4 ), 4 );
+        return Value;
+    }
+
+    static inline uint16_t Load16( const uint8_t* p ) {
+        return HeaderRawLoad<2>::Load16( p );
+    }
+};
+
+template <int Align, int Misalign>
+struct HeaderView {
+    template <int Offset>
+    static inline uint32_t Load32( const uint8_t* Buffer ) {
+        return HeaderRawLoad<Header_FieldAlignment( Align, Misalign + Offset ) >= 4 ? 4 : Header_FieldAlignment( Align, Misalign + Offset )>::Load32( Buffer + Offset );
+    }
+
+    template <int Offset>
+    static inline uint16_t Load16( const uint8_t* Buffer ) {
+        return HeaderRawLoad<Header_FieldAlignment( Align, Misalign + Offset ) >= 2 ? 2 : 1>::Load16( Buffer + Offset );
+    }
+
+    template <int Offset>
+    static inline uint16_t LoadBE16( const uint8_t* Buffer ) {
+        return ( uint16_t ) ( ( Buffer[ Offset ] << 8 ) | Buffer[ Offset + 1 ] );
+    }
+
+    template <int Offset>
+    static inline uint8_t Load8( const uint8_t* Buffer ) {
+        return Buffer[ Offset ];
+    }
+};
+
+/*
+ * Ethernet frame view, Misalign is where the start of the frame sits.
+ */
+template <int Align, int Misalign>
+struct EtherView : HeaderView<Align, Misalign> {
+    typedef HeaderView<Align, Misalign> View;
+
+    static inline uint16_t Type( const uint8_t* Frame ) { return View::template LoadBE16<EtherOffset_Type>( Frame ); }
+};
+
+/*
+ * IPv4 header view, Misalign is where the start of the IP header sits.
+ */
+template <int Align, int Misalign>
+struct IPv4View : HeaderView<Align, Misalign> {
+    typedef HeaderView<Align, Misalign> View;
+
+    static inline uint8_t Version( const uint8_t* Packet ) { return View::template Load8<IPv4Offset_VersionIHL>( Packet ) >> 4; }
+    static inline int HeaderLength( const uint8_t* Packet ) { return ( View::template Load8<IPv4Offset_VersionIHL>( Packet ) & 0x0F ) * 4; }
+    static inline uint16_t Length( const uint8_t* Packet ) { return View::template LoadBE16<IPv4Offset_Length>( Packet ); }
+    static inline uint8_t Protocol( const uint8_t* Packet ) { return View::template Load8<IPv4Offset_Protocol>( Packet ); }
+    static inline uint32_t SourceIP( const uint8_t* Packet ) { return View::template Load32<IPv4Offset_SourceIP>( Packet ); }
+    static inline uint32_t DestIP( const uint8_t* Packet ) { return View::template Load32<IPv4Offset_DestIP>( Packet ); }
+};
+
+/*
+ * Received frames are stored (EtherFrameHeadroom) bytes past a 4 byte boundary,
+ * SLIP packets are decoded to a 4 byte boundary.
+ */
+typedef EtherView<4, EtherFrameHeadroom> RXEtherView;
+typedef IPv4View<4, ( EtherFrameHeadroom + 14 ) % 4> RXIPv4View;
+typedef IPv4View<4, 0> SLIPIPv4View;
+
+/* For buffers we know nothing about */
+typedef IPv4View<1, 0> UnalignedIPv4View;
+
+#endif
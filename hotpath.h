@@ -0,0 +1,36 @@
+#ifndef _HOTPATH_H_
+#define _HOTPATH_H_
+
+/*
+ * Code placement profile.
+ * Normally everything but the core's own ISRs runs from flash through the
+ * 32KB instruction cache, so a forwarding path that has been evicted by
+ * WiFi, lwIP or a debug dump costs several microseconds in cache misses
+ * per packet, and MyInputFn pays that inside the WiFi callback.
+ *
+ * With IRAM_HOTPATH_PROFILE defined the per packet functions marked
+ * FASTPATH go in IRAM, and the setup, DHCP and debug code marked COLDPATH
+ * stays in flash and is never inlined into them. IRAM is shared with the
+ * core and SDK, check what's left with tools/irammap.py, and compare
+ * cycles per packet with Bench_CachePlacement (bench.h).
+ *
+ * Plain C so slipcodec.c can use it.
+ */
+
+// #define IRAM_HOTPATH_PROFILE
+
+#if defined ( IRAM_HOTPATH_PROFILE ) && defined ( ARDUINO_ARCH_ESP8266 )
+
+#include <c_types.h>
+
+#define FASTPATH ICACHE_RAM_ATTR
+#define COLDPATH ICACHE_FLASH_ATTR __attribute__( ( noinline, cold ) )
+
+#else
+
+#define FASTPATH
+#define COLDPATH
+
+#endif
+
+#endif
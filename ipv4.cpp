@@ -7,6 +7,10 @@
 #include "util.h"
 #include "slip.h"
 #include "mydebug.h"
+#include "hdrview.h"
+#include "flows.h"
+#include "nexthop.h"
+#include "hotpath.h"
 
 extern "C" {
 #include <netif/wlan_lwip_if.h>
@@ -14,27 +18,36 @@ extern "C" {
 #include <user_interface.h>
 }
 
-int UDP_BuildOutgoingPacket( uint32_t SourceIP, uint32_t TargetIP, uint16_t Port, const uint8_t* Data, int DataLength ) {
-    uint8_t TempBuffer[ 2048 ];
+/*
+ * Sends Data as a UDP datagram, only the headers are built here and the
+ * payload is copied once straight into the outgoing pbuf.
+ * Doesn't wait on ARP, returns ERR_RTE if the next hop isn't known yet.
+ */
+err_t UDP_SendDatagram( uint32_t SourceIP, uint16_t SourcePort, uint32_t TargetIP, uint16_t TargetPort, const uint8_t* Data, int DataLength ) {
+    uint8_t Header[ sizeof( struct EtherFrame ) + sizeof( struct ip_packet ) + sizeof( struct udp_packet ) ] __attribute__( ( aligned( 4 ) ) );
     uint8_t DestinationMACAddress[ MACAddressLen ];
-    uint8_t* BufferPtr = TempBuffer;
+    struct udp_packet* UDPHeader = NULL;
     int BytesToWrite = 0;
 
-    if ( Route( TargetIP, DestinationMACAddress ) ) {
-        BytesToWrite+= PrepareEthernetHeader( ( struct EtherFrame* ) TempBuffer, OurMACAddress, DestinationMACAddress, EtherType_IPv4 );
-        BytesToWrite+= PrepareTCPHeader( ( struct ip_packet* ) ( TempBuffer + BytesToWrite ), SourceIP, TargetIP, DataLength, 0, IP_PROTO_UDP );
-        BytesToWrite+= PrepareUDPHeader( ( struct udp_packet* ) ( TempBuffer + BytesToWrite ), Port, DataLength );
+    /* No DebugPrintf here, with DEBUG_UDP it would end up right back in here */
+    if ( Route( TargetIP, DestinationMACAddress ) == 0 )
+        return ERR_RTE;
 
-        memcpy( ( TempBuffer + BytesToWrite ), Data, DataLength );
-        BytesToWrite+= DataLength;
+    BytesToWrite+= PrepareEthernetHeader( ( struct EtherFrame* ) Header, OurMACAddress, DestinationMACAddress, EtherType_IPv4 );
+    BytesToWrite+= PrepareTCPHeader( ( struct ip_packet* ) ( Header + BytesToWrite ), SourceIP, TargetIP, DataLength, 0, IP_PROTO_UDP );
 
-        EtherWrite( TempBuffer, BytesToWrite );
-        return 1;
-    } else {
-        DebugPrintf( "UDP_BuildOutgoingPacket: No route to host.\n" );
-    }
+    UDPHeader = ( struct udp_packet* ) ( Header + BytesToWrite );
+    BytesToWrite+= PrepareUDPHeader( UDPHeader, TargetPort, DataLength );
+    UDPHeader->SourcePort = htons( SourcePort );
 
-    return 0;
+    return EtherWriteParts( Header, BytesToWrite, Data, DataLength );
+}
+
+/*
+ * UDP_SendDatagram from (Port - 11) to Port.
+ */
+err_t UDP_BuildOutgoingPacket( uint32_t SourceIP, uint32_t TargetIP, uint16_t Port, const uint8_t* Data, int DataLength ) {
+    return UDP_SendDatagram( SourceIP, Port - 11, TargetIP, Port, Data, DataLength );
 }
 
 int PrepareTCPHeader( struct ip_packet* IPHeader, const uint32_t SourceIP, const uint32_t DestIP, int DataLength, int DontFragment, int Protocol ) {
@@ -63,33 +76,25 @@ int PrepareUDPHeader( struct udp_packet* UDPHeader, uint16_t Port, int DataLengt
   return sizeof( struct udp_packet );
 }
 
-int TCP_EtherEncapsulate( const uint8_t* Packet, int Length ) {
-  const struct ip_packet* IPHeader = ( const struct ip_packet* ) Packet;
-  uint8_t Buffer[ 2048 ];
-  struct EtherFrame* FrameHeader = ( struct EtherFrame* ) Buffer;
-  int Local = 0;
-
-  Local = AreWeOnTheSameSubnet( IPHeader->DestIP );
-
-  if ( ARP_RequestMACFromIP_Blocking( Local ? IPHeader->DestIP : ( uint32_t ) OurGateway, FrameHeader->DestMAC ) ) {
-    if ( ( Length + sizeof( struct EtherFrame ) ) > sizeof( Buffer ) ) {
-      DebugPrintf( "FATAL: EtherWrite packet overrun!\n" );
-      Length = 0;
-    }
-
-    memcpy( &Buffer[ sizeof( struct EtherFrame ) ], Packet, Length );
-    memcpy( FrameHeader->SourceMAC, OurMACAddress, MACAddressLen );
-
-    FrameHeader->LengthOrType = htons( EtherType_IPv4 );
-    Length+= sizeof( struct EtherFrame );
+/*
+ * Sends a packet from the serial side as the payload behind a cached ethernet header,
+ * the packet itself is only copied once, into the outgoing pbuf.
+ * Returns 1 if it was sent or queued, 0 if the next hop is unknown or the transmit pool is full.
+ */
+int FASTPATH TCP_EtherEncapsulate( const uint8_t* Packet, int Length ) {
+  uint32_t DestIP = SLIPIPv4View::DestIP( Packet );
+  uint8_t Header[ sizeof( struct EtherFrame ) ] __attribute__( ( aligned( 4 ) ) );
 
-    EtherWrite( Buffer, Length );
-    return 1;
-  } else {
+  if ( NextHop_PrepareHeader( DestIP, Header ) == 0 ) {
     DebugPrintf( "Timeout or didn't get target MAC\n" );
+    return 0;
   }
 
-  return 0;
+  if ( EtherWriteParts( Header, sizeof( Header ), Packet, Length ) != ERR_OK )
+    return 0;
+
+  Flow_Account( FlowDir_ToWiFi, Packet, Length );
+  return 1;
 }
 
 /*
@@ -98,11 +103,16 @@ int TCP_EtherEncapsulate( const uint8_t* Packet, int Length ) {
  * This expects the IP and Mask to be in HOST BYTE ORDER. 
  */
 int IsBroadcastIP( uint32_t IP, uint32_t Mask ) {
-    return ( IP & ~Mask ) == 255 ? 1 : 0;
+    return ( IP & ~Mask ) == ~Mask ? 1 : 0;
 }
 
+/*
+ * Finds the MAC address to send IPAddr to, either directly or through the gateway.
+ * Never waits, on an ARP miss a request goes out and 0 is returned.
+ */
 int Route( uint32_t IPAddr, uint8_t* MACAddress ) {
-  int IsLocalAddress = 0;
+  struct ARPEntry* Entry = NULL;
+  uint32_t NextHop = 0;
   int Result = 0;
 
   if ( IsBroadcastIP( ntohl( IPAddr ), ntohl( OurNetmask ) ) ) {
@@ -110,13 +120,22 @@ int Route( uint32_t IPAddr, uint8_t* MACAddress ) {
     Result = 1;
   }
   else {
-    IsLocalAddress = AreWeOnTheSameSubnet( IPAddr );
-    Result = ARP_RequestMACFromIP_Blocking( IsLocalAddress ? IPAddr : ( uint32_t ) OurGateway, MACAddress );
+    NextHop = AreWeOnTheSameSubnet( IPAddr ) ? IPAddr : ( uint32_t ) OurGateway;
+
+    if ( ( Entry = ARP_FindEntryByIP( NextHop ) ) != NULL ) {
+      memcpy( MACAddress, Entry->MACAddress, MACAddressLen );
+      Result = 1;
+    }
+    else {
+      ARP_RequestMACFromIP( NextHop );
+    }
   }
 
   return Result;
 }
 
+#if defined ( DHCP_CLIENT_ENABLED )
+
 #define DHCP_PORT 67
 #define DHCP_Opcode_Request 1
 #define DHCP_Opcode_Reply 2
@@ -167,7 +186,7 @@ struct dhcp_packet {
     uint8_t Options[ 64 ];
 } __attribute__( ( packed ) );
 
-void DHCPRequest( void ) {
+void COLDPATH DHCPRequest( void ) {
     static uint8_t Buffer[ 512 ];
     struct dhcp_packet* Request = ( struct dhcp_packet* ) Buffer;
     struct dhcp_option* Option = NULL;
@@ -217,6 +236,8 @@ void DHCPRequest( void ) {
     UDP_BuildOutgoingPacket( IPAddress( 0, 0, 0, 0 ), IPAddress( 255, 255, 255, 255 ), DHCP_PORT, Buffer, BytesToWrite );
 }
 
+#endif
+
 void OnIPv4Packet( const uint8_t* Data, int Length, const struct EtherFrame* FrameHeader ) {
     struct ip_packet* IPHeader = ( struct ip_packet* ) Data;
     struct udp_packet* UDPHeader = NULL;
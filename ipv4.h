@@ -3,6 +3,12 @@
 
 #define IP_PROTO_UDP 0x11
 
+/*
+ * Unfinished DHCP client, only sends a DHCPDISCOVER and nothing handles the
+ * reply yet. The WiFi side gets its address from the SDK.
+ */
+// #define DHCP_CLIENT_ENABLED
+
 // Copied from netinet/ip.h
 struct ip_packet {
     uint8_t HeaderLengthInWords : 4,
@@ -30,9 +36,21 @@ struct udp_packet {
 
 int PrepareTCPHeader( struct ip_packet* IPHeader, const uint32_t SourceIP, const uint32_t DestIP, int DataLength, int DontFragment, int Protocol );
 int PrepareUDPHeader( struct udp_packet* UDPHeader, uint16_t Port, int DataLength );
+
+/*
+ * Sends a packet from the serial side as the payload behind a cached ethernet header,
+ * the packet itself is only copied once, into the outgoing pbuf.
+ * Returns 1 if it was sent or queued, 0 if the next hop is unknown or the transmit pool is full.
+ */
 int TCP_EtherEncapsulate( const uint8_t* Packet, int Length );
+
 int Route( uint32_t IPAddr, uint8_t* MACAddress );
-int UDP_BuildOutgoingPacket( uint32_t SourceIP, uint32_t TargetIP, uint16_t Port, const uint8_t* Data, int DataLength );
+err_t UDP_SendDatagram( uint32_t SourceIP, uint16_t SourcePort, uint32_t TargetIP, uint16_t TargetPort, const uint8_t* Data, int DataLength );
+err_t UDP_BuildOutgoingPacket( uint32_t SourceIP, uint32_t TargetIP, uint16_t Port, const uint8_t* Data, int DataLength );
 void OnIPv4Packet( const uint8_t* Data, int Length, const struct EtherFrame* FrameHeader );
 
+#if defined ( DHCP_CLIENT_ENABLED )
+void DHCPRequest( void );
+#endif
+
 #endif
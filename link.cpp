@@ -0,0 +1,191 @@
+#include <ESP8266WiFi.h>
+#include <lwip/netif.h>
+#include <lwip/err.h>
+#include "ether.h"
+#include "ipv4.h"
+#include "util.h"
+#include "slip.h"
+#include "mydebug.h"
+#include "warmstart.h"
+#include "ethertx.h"
+#include "hdrview.h"
+#include "link.h"
+
+struct HeldPacket {
+    uint8_t Buffer[ SLIPMaxPacketLen ] __attribute__( ( aligned( 4 ) ) );
+    int Length;
+};
+
+extern int IsConnectedToWiFi;
+
+static struct HeldPacket HeldPackets[ LinkHoldPacketCount ];
+static int HeldHead = 0;
+static int HeldCount = 0;
+
+static int LinkState = LinkState_Up;
+static uint32_t OutageStartTime = 0;
+static uint32_t ConnectStartTime = 0;
+
+static uint32_t Outages = 0;
+static uint32_t LastRecoveryMS = 0;
+static uint32_t MaxRecoveryMS = 0;
+static uint32_t PacketsHeld = 0;
+static uint32_t PacketsReplayed = 0;
+static uint32_t PacketsDropped = 0;
+static uint32_t ReplayFailures = 0;
+static uint32_t ReplayStartTime = 0;
+static uint32_t NextReplayTime = 0;
+static int ReplayRetrying = 0;
+
+/*
+ * Sends the oldest held packet, one per tick so replaying a full
+ * queue doesn't stall the rest of the main loop.
+ * The next hop is resolved with Route( ) so an ARP miss sends the request
+ * and returns, the reply is only processed on a later pass through the loop.
+ * A packet the transmit path won't take yet (ARP miss, pool full) stays
+ * at the head and is tried again every LinkReplayRetryMS, for up to
+ * LinkReplayBudgetMS.
+ */
+static void Link_ReplayOne( uint32_t Now ) {
+    struct HeldPacket* Packet = &HeldPackets[ HeldHead ];
+    uint8_t MAC[ MACAddressLen ];
+
+    if ( EtherTX_IsBackedUp( ) )
+        return;
+
+    if ( ReplayRetrying && ( int32_t ) ( Now - NextReplayTime ) < 0 )
+        return;
+
+    if ( Route( SLIPIPv4View::DestIP( Packet->Buffer ), MAC ) && TCP_EtherEncapsulate( Packet->Buffer, Packet->Length ) ) {
+        PacketsReplayed++;
+    } else {
+        ReplayFailures++;
+
+        if ( ReplayRetrying == 0 ) {
+            ReplayRetrying = 1;
+            ReplayStartTime = Now;
+        }
+
+        if ( ( Now - ReplayStartTime ) < LinkReplayBudgetMS ) {
+            NextReplayTime = Now + LinkReplayRetryMS;
+            return;
+        }
+
+        PacketsDropped++;
+    }
+
+    ReplayRetrying = 0;
+    HeldHead = ( HeldHead + 1 ) % LinkHoldPacketCount;
+    HeldCount--;
+}
+
+static void Link_OnConnected( uint32_t Now ) {
+    LastRecoveryMS = Now - OutageStartTime;
+
+    if ( LastRecoveryMS > MaxRecoveryMS )
+        MaxRecoveryMS = LastRecoveryMS;
+
+    DebugPrintf( "%s: Link back up after %ums, %d packets to replay.\n", __FUNCTION__, LastRecoveryMS, HeldCount );
+
+    IsConnectedToWiFi = 1;
+    LinkState = LinkState_Up;
+    ReplayRetrying = 0;
+
+    WarmStart_Save( );
+}
+
+/*
+ * Called every "frame" or run through the main loop.
+ */
+void Link_Tick( void ) {
+    static uint32_t NextPoll = 0;
+    uint32_t Now = millis( );
+
+    switch ( LinkState ) {
+        case LinkState_Up: {
+            /* Keep polling while replaying, a packet that won't go may mean the link has gone again */
+            if ( HeldCount > 0 )
+                Link_ReplayOne( Now );
+
+            if ( Now < NextPoll )
+                break;
+
+            NextPoll = Now + LinkPollIntervalMS;
+
+            if ( WiFi.status( ) != WL_CONNECTED ) {
+                DebugPrintf( "%s: Lost WiFi connection.\n", __FUNCTION__ );
+
+                IsConnectedToWiFi = 0;
+                OutageStartTime = Now;
+                LinkState = LinkState_Down;
+
+                Outages++;
+            }
+
+            break;
+        }
+        case LinkState_Down: {
+            /* Doesn't block, we just watch WiFi.status( ) from here on */
+            WiFi.reconnect( );
+
+            ConnectStartTime = Now;
+            LinkState = LinkState_Connecting;
+            break;
+        }
+        case LinkState_Connecting: {
+            if ( WiFi.status( ) == WL_CONNECTED )
+                Link_OnConnected( Now );
+            else if ( ( Now - ConnectStartTime ) >= LinkReconnectTimeoutMS )
+                LinkState = LinkState_Down;
+
+            break;
+        }
+        default: break;
+    };
+}
+
+/*
+ * Returns 1 if the WiFi link is up and nothing is waiting to be replayed.
+ */
+int Link_CanForward( void ) {
+    return ( LinkState == LinkState_Up && HeldCount == 0 ) ? 1 : 0;
+}
+
+/*
+ * Returns 1 if there is no room to hold another packet, the SLIP reader
+ * should stop pulling bytes off the serial port until there is.
+ */
+int Link_IsHoldQueueFull( void ) {
+    return HeldCount >= LinkHoldPacketCount ? 1 : 0;
+}
+
+/*
+ * Holds a packet from the SLIP side until the link comes back up.
+ * Returns 0 and counts a drop if there is no room.
+ */
+int Link_HoldPacket( const uint8_t* Packet, int Length ) {
+    struct HeldPacket* Slot = NULL;
+
+    if ( HeldCount >= LinkHoldPacketCount || Length > ( int ) sizeof( Slot->Buffer ) ) {
+        PacketsDropped++;
+        return 0;
+    }
+
+    Slot = &HeldPackets[ ( HeldHead + HeldCount ) % LinkHoldPacketCount ];
+
+    memcpy( Slot->Buffer, Packet, Length );
+    Slot->Length = Length;
+
+    HeldCount++;
+    PacketsHeld++;
+
+    return 1;
+}
+
+/*
+ * Writes the link counters to the debug console.
+ */
+void Link_DumpStats( void ) {
+    DebugPrintf( "%s: Outages %u / Recovery last/max [%u,%u]ms / Held/Replayed/Dropped [%u,%u,%u] / Replay failures %u\n", __FUNCTION__,
+        Outages, LastRecoveryMS, MaxRecoveryMS, PacketsHeld, PacketsReplayed, PacketsDropped, ReplayFailures );
+}
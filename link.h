@@ -0,0 +1,58 @@
+#ifndef _LINK_H_
+#define _LINK_H_
+
+/*
+ * WiFi link state machine.
+ * Notices when the AP goes away, reconnects in the background without blocking
+ * the main loop and holds a bounded number of SLIP side packets while it's down.
+ */
+
+/* How many SLIP side packets to hold while the link is down */
+#define LinkHoldPacketCount 4
+
+/* How long to wait on a reconnect attempt before kicking off another one */
+#define LinkReconnectTimeoutMS 10000
+
+/* A held packet that still can't be sent this long after its first try on reconnect is dropped */
+#define LinkReplayBudgetMS 2000
+
+/* How long to wait before trying a held packet again, an ARP reply needs a few main loop passes */
+#define LinkReplayRetryMS 50
+
+/* How often to look at the WiFi status when the link is up */
+#define LinkPollIntervalMS 100
+
+enum {
+    LinkState_Up = 0,
+    LinkState_Down,
+    LinkState_Connecting
+};
+
+/*
+ * Called every "frame" or run through the main loop.
+ */
+void Link_Tick( void );
+
+/*
+ * Returns 1 if the WiFi link is up and nothing is waiting to be replayed.
+ */
+int Link_CanForward( void );
+
+/*
+ * Returns 1 if there is no room to hold another packet, the SLIP reader
+ * should stop pulling bytes off the serial port until there is.
+ */
+int Link_IsHoldQueueFull( void );
+
+/*
+ * Holds a packet from the SLIP side until the link comes back up.
+ * Returns 0 and counts a drop if there is no room.
+ */
+int Link_HoldPacket( const uint8_t* Packet, int Length );
+
+/*
+ * Writes the link counters to the debug console.
+ */
+void Link_DumpStats( void );
+
+#endif
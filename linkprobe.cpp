@@ -0,0 +1,172 @@
+#include <ESP8266WiFi.h>
+#include <lwip/netif.h>
+#include <lwip/err.h>
+#include "ether.h"
+#include "ipv4.h"
+#include "util.h"
+#include "slip.h"
+#include "mydebug.h"
+#include "hdrview.h"
+#include "bridge.h"
+#include "linkprobe.h"
+
+#define IP_PROTO_ICMP 0x01
+
+#define ICMPType_EchoReply 0
+#define ICMPType_EchoRequest 8
+
+struct ICMPEcho {
+    uint8_t Type;
+    uint8_t Code;
+    uint16_t Checksum;
+    uint16_t Ident;
+    uint16_t Sequence;
+    uint32_t SendTime;
+} __attribute__( ( packed ) );
+
+extern volatile int TXBytesSent;
+extern uint32_t SLIPBytesReceived;
+
+static uint16_t ProbeSequence = 0;
+static uint16_t OutstandingSequence = 0;
+static uint32_t OutstandingSince = 0;
+static int IsOutstanding = 0;
+
+static uint32_t ProbesSent = 0;
+static uint32_t ProbesAnswered = 0;
+static uint32_t ProbesLost = 0;
+static uint32_t LastRTTUS = 0;
+static uint32_t MinRTTUS = 0;
+static uint32_t MaxRTTUS = 0;
+static uint64_t SumRTTUS = 0;
+
+static uint32_t WindowStart = 0;
+static uint32_t WindowTXBytes = 0;
+static uint32_t WindowRXBytes = 0;
+static uint32_t TXUtilisation10 = 0;
+static uint32_t RXUtilisation10 = 0;
+static uint32_t PeakTXUtilisation10 = 0;
+static uint32_t PeakRXUtilisation10 = 0;
+
+static void LinkProbe_Send( uint32_t Now ) {
+    uint8_t Buffer[ sizeof( struct ip_packet ) + sizeof( struct ICMPEcho ) ] __attribute__( ( aligned( 4 ) ) );
+    struct ICMPEcho* Echo = ( struct ICMPEcho* ) &Buffer[ sizeof( struct ip_packet ) ];
+
+    /* PrepareTCPHeader adds 8 bytes for a UDP header, the same size as the ICMP echo header */
+    PrepareTCPHeader( ( struct ip_packet* ) Buffer, OurGateway, BridgeAddressing::SerialHostIP( ), sizeof( Echo->SendTime ), 0, IP_PROTO_ICMP );
+
+    Echo->Type = ICMPType_EchoRequest;
+    Echo->Code = 0;
+    Echo->Checksum = 0;
+    Echo->Ident = htons( LinkProbeIdent );
+    Echo->Sequence = htons( ++ProbeSequence );
+    Echo->SendTime = micros( );
+    Echo->Checksum = inet_chksum( Echo, sizeof( struct ICMPEcho ) );
+
+    BridgeQueueing::ToSerial( Buffer, sizeof( Buffer ) );
+
+    OutstandingSequence = ProbeSequence;
+    OutstandingSince = Now;
+    IsOutstanding = 1;
+
+    ProbesSent++;
+}
+
+/*
+ * Works out line utilisation (in tenths of a percent) since the last call.
+ */
+static void LinkProbe_UpdateUtilisation( uint32_t Now ) {
+    uint32_t Elapsed = Now - WindowStart;
+    uint32_t TXBytes = ( uint32_t ) TXBytesSent;
+    uint32_t RXBytes = SLIPBytesReceived;
+    uint64_t LineBytes = ( ( uint64_t ) SLIPBaudRate / 10 ) * Elapsed;
+
+    if ( Elapsed == 0 )
+        return;
+
+    /* Bytes * 1000 (ms) * 1000 (tenths of a percent) over bytes the line could have carried */
+    TXUtilisation10 = ( uint32_t ) ( ( ( uint64_t ) ( TXBytes - WindowTXBytes ) * 1000000 ) / LineBytes );
+    RXUtilisation10 = ( uint32_t ) ( ( ( uint64_t ) ( RXBytes - WindowRXBytes ) * 1000000 ) / LineBytes );
+
+    if ( TXUtilisation10 > PeakTXUtilisation10 )
+        PeakTXUtilisation10 = TXUtilisation10;
+
+    if ( RXUtilisation10 > PeakRXUtilisation10 )
+        PeakRXUtilisation10 = RXUtilisation10;
+
+    WindowStart = Now;
+    WindowTXBytes = TXBytes;
+    WindowRXBytes = RXBytes;
+}
+
+/*
+ * Called every "frame" or run through the main loop.
+ */
+void LinkProbe_Tick( void ) {
+    static uint32_t NextProbe = 0;
+    uint32_t Now = millis( );
+
+    if ( IsOutstanding && ( Now - OutstandingSince ) >= LinkProbeTimeoutMS ) {
+        IsOutstanding = 0;
+        ProbesLost++;
+    }
+
+    if ( ( int32_t ) ( Now - NextProbe ) < 0 )
+        return;
+
+    NextProbe = Now + LinkProbeIntervalMS;
+    LinkProbe_UpdateUtilisation( Now );
+
+    if ( IsOutstanding == 0 )
+        LinkProbe_Send( Now );
+}
+
+/*
+ * Looks at a packet from the serial host, returns 1 if it was the reply to one of our probes.
+ */
+int LinkProbe_OnPacketFromSerial( const uint8_t* Packet, int Length ) {
+    const struct ICMPEcho* Echo = NULL;
+    int HeaderLength = SLIPIPv4View::HeaderLength( Packet );
+    uint32_t RTT = 0;
+
+    if ( SLIPIPv4View::Protocol( Packet ) != IP_PROTO_ICMP || ( HeaderLength + ( int ) sizeof( struct ICMPEcho ) ) > Length )
+        return 0;
+
+    Echo = ( const struct ICMPEcho* ) &Packet[ HeaderLength ];
+
+    if ( Echo->Type != ICMPType_EchoReply || Echo->Ident != htons( LinkProbeIdent ) || SLIPIPv4View::DestIP( Packet ) != ( uint32_t ) OurGateway )
+        return 0;
+
+    /* A late reply to a probe we already gave up on still isn't for anyone else */
+    if ( IsOutstanding && ntohs( Echo->Sequence ) == OutstandingSequence ) {
+        RTT = micros( ) - Echo->SendTime;
+
+        LastRTTUS = RTT;
+        SumRTTUS+= RTT;
+
+        if ( MinRTTUS == 0 || RTT < MinRTTUS )
+            MinRTTUS = RTT;
+
+        if ( RTT > MaxRTTUS )
+            MaxRTTUS = RTT;
+
+        IsOutstanding = 0;
+        ProbesAnswered++;
+    }
+
+    return 1;
+}
+
+/*
+ * Writes the serial RTT and utilisation to the debug console.
+ */
+void LinkProbe_DumpStats( void ) {
+    uint32_t AverageRTTUS = ProbesAnswered ? ( uint32_t ) ( SumRTTUS / ProbesAnswered ) : 0;
+
+    DebugPrintf( "%s: RTT last/min/avg/max [%u,%u,%u,%u]us / Probes sent/answered/lost [%u,%u,%u]\n", __FUNCTION__,
+        LastRTTUS, MinRTTUS, AverageRTTUS, MaxRTTUS, ProbesSent, ProbesAnswered, ProbesLost );
+
+    DebugPrintf( "%s: Line utilisation @ %u baud TX/RX [%u.%u%%,%u.%u%%] / Peak [%u.%u%%,%u.%u%%]\n", __FUNCTION__, SLIPBaudRate,
+        TXUtilisation10 / 10, TXUtilisation10 % 10, RXUtilisation10 / 10, RXUtilisation10 % 10,
+        PeakTXUtilisation10 / 10, PeakTXUtilisation10 % 10, PeakRXUtilisation10 / 10, PeakRXUtilisation10 % 10 );
+}
@@ -0,0 +1,37 @@
+#ifndef _LINKPROBE_H_
+#define _LINKPROBE_H_
+
+/*
+ * Serial link probe.
+ * Every (LinkProbeIntervalMS) we queue a small ICMP echo request to the
+ * serial host, from the gateway address so the host routes the reply back
+ * to us. The reply is recognised by its identifier and swallowed instead of
+ * being forwarded, giving the round trip time of the serial hop alone
+ * (including time spent in the transmit queue).
+ *
+ * Over the same interval the SLIP byte counts are turned into line
+ * utilisation as a percentage of SLIPBaudRate, 10 bits per byte.
+ */
+
+#define LinkProbeIntervalMS 5000
+#define LinkProbeTimeoutMS 3000
+
+/* ICMP identifier of our echo requests, replies with anything else are forwarded as usual */
+#define LinkProbeIdent 0x5138
+
+/*
+ * Called every "frame" or run through the main loop.
+ */
+void LinkProbe_Tick( void );
+
+/*
+ * Looks at a packet from the serial host, returns 1 if it was the reply to one of our probes.
+ */
+int LinkProbe_OnPacketFromSerial( const uint8_t* Packet, int Length );
+
+/*
+ * Writes the serial RTT and utilisation to the debug console.
+ */
+void LinkProbe_DumpStats( void );
+
+#endif
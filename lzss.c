@@ -0,0 +1,195 @@
+#include <string.h>
+#include "lzss.h"
+
+/*
+ * Strings we expect to see in replies from the network, roughly least
+ * likely first since the most recent bytes are the cheapest to reach.
+ */
+const uint8_t LZSSDict_ToHost[ ] =
+    "<!DOCTYPE html><html><head><title></title></head><body><div class=\"\"><a href=\"http://"
+    "</a></div></p><br></body></html>\r\n"
+    "Set-Cookie: ; path=/; expires=Last-Modified: Expires: ETag: \"Cache-Control: no-cache, max-age="
+    "Transfer-Encoding: chunked\r\nContent-Encoding: gzip\r\n"
+    "Server: Apache nginx\r\nDate: Mon, Tue, Wed, Thu, Fri, Sat, Sun, Jan Feb Mar Apr May Jun Jul Aug Sep Oct Nov Dec 20 GMT\r\n"
+    "Content-Type: text/html; charset=UTF-8\r\nContent-Length: \r\nConnection: close\r\n"
+    "HTTP/1.0 HTTP/1.1 200 OK\r\n301 Moved Permanently\r\nLocation: 404 Not Found\r\n"
+    ":irc. NOTICE * :*** MODE JOIN :# PART QUIT :Ping timeout PING :PRIVMSG #";
+
+/*
+ * Strings we expect the serial host to send.
+ */
+const uint8_t LZSSDict_FromHost[ ] =
+    "USER 0 * :NICK JOIN #PART #QUIT :MODE WHOIS NOTICE PONG :PRIVMSG #"
+    "If-Modified-Since: Accept-Encoding: identity\r\nAccept-Language: en\r\n"
+    "Accept: text/html, */*\r\nUser-Agent: Mozilla/ Lynx/2.8 libwww-FM/\r\nConnection: close\r\nKeep-Alive\r\n"
+    "Content-Type: application/x-www-form-urlencoded\r\nContent-Length: \r\n"
+    "POST / HTTP/1.1\r\nGET / HTTP/1.0\r\nHost: www.";
+
+const int LZSSDict_ToHostLen = sizeof( LZSSDict_ToHost ) - 1;
+const int LZSSDict_FromHostLen = sizeof( LZSSDict_FromHost ) - 1;
+
+static inline uint32_t LZSS_Hash( const uint8_t* Data ) {
+    uint32_t Key = ( ( uint32_t ) Data[ 0 ] << 16 ) | ( ( uint32_t ) Data[ 1 ] << 8 ) | Data[ 2 ];
+
+    return ( Key * 2654435761u ) >> ( 32 - LZSSHashBits );
+}
+
+/*
+ * Sets up a compression context for the given dictionary.
+ */
+void LZSS_Init( struct LZSSContext* Context, const uint8_t* Dict, int DictLength ) {
+    int i = 0;
+
+    if ( DictLength > LZSSMaxDictLen ) {
+        Dict+= DictLength - LZSSMaxDictLen;
+        DictLength = LZSSMaxDictLen;
+    }
+
+    memset( Context->DictHead, 0, sizeof( Context->DictHead ) );
+    memcpy( Context->Window, Dict, DictLength );
+
+    Context->DictLength = DictLength;
+
+    /* Positions are stored plus one so zero means empty */
+    for ( i = 0; ( i + LZSSMinMatch ) <= DictLength; i++ )
+        Context->DictHead[ LZSS_Hash( &Context->Window[ i ] ) ] = i + 1;
+}
+
+/*
+ * Compresses Src into Dest. Returns the compressed length, or 0 if the
+ * result wouldn't be smaller than the input or doesn't fit in Dest.
+ */
+int LZSS_Compress( struct LZSSContext* Context, const uint8_t* Src, int SrcLength, uint8_t* Dest, int MaxDestLength ) {
+    uint8_t* Window = Context->Window;
+    uint16_t* Head = Context->Head;
+    uint32_t Hash = 0;
+    uint8_t Mask = 0;
+    int Candidate = 0;
+    int FlagPos = 0;
+    int BestLength = 0;
+    int BestOffset = 0;
+    int Length = 0;
+    int MaxLength = 0;
+    int OutLength = 0;
+    int Pos = Context->DictLength;
+    int End = Context->DictLength + SrcLength;
+
+    if ( SrcLength <= 0 || SrcLength > LZSSMaxInput )
+        return 0;
+
+    /* Never bother producing something that isn't smaller */
+    if ( MaxDestLength >= SrcLength )
+        MaxDestLength = SrcLength - 1;
+
+    memcpy( &Window[ Pos ], Src, SrcLength );
+    memcpy( Head, Context->DictHead, sizeof( Context->DictHead ) );
+
+    while ( Pos < End ) {
+        if ( Mask == 0 ) {
+            if ( OutLength >= MaxDestLength )
+                return 0;
+
+            FlagPos = OutLength++;
+            Dest[ FlagPos ] = 0;
+            Mask = 1;
+        }
+
+        BestLength = 0;
+        MaxLength = End - Pos;
+
+        if ( MaxLength > LZSSMaxMatch )
+            MaxLength = LZSSMaxMatch;
+
+        if ( MaxLength >= LZSSMinMatch ) {
+            Hash = LZSS_Hash( &Window[ Pos ] );
+            Candidate = ( int ) Head[ Hash ] - 1;
+            Head[ Hash ] = Pos + 1;
+
+            if ( Candidate >= 0 && Candidate < Pos && ( Pos - Candidate ) <= LZSSWindowSize ) {
+                for ( Length = 0; Length < MaxLength && Window[ Candidate + Length ] == Window[ Pos + Length ]; Length++ )
+                    ;
+
+                if ( Length >= LZSSMinMatch ) {
+                    BestLength = Length;
+                    BestOffset = Pos - Candidate;
+                }
+            }
+        }
+
+        if ( BestLength ) {
+            if ( ( OutLength + 2 ) > MaxDestLength )
+                return 0;
+
+            Dest[ FlagPos ]|= Mask;
+            Dest[ OutLength++ ] = ( uint8_t ) ( ( BestOffset - 1 ) >> 4 );
+            Dest[ OutLength++ ] = ( uint8_t ) ( ( ( ( BestOffset - 1 ) & 0x0F ) << 4 ) | ( BestLength - LZSSMinMatch ) );
+
+            /* Keep the hash table current for the bytes we skipped over */
+            for ( Length = 1; Length < BestLength && ( Pos + Length + LZSSMinMatch ) <= End; Length++ )
+                Head[ LZSS_Hash( &Window[ Pos + Length ] ) ] = Pos + Length + 1;
+
+            Pos+= BestLength;
+        } else {
+            if ( OutLength >= MaxDestLength )
+                return 0;
+
+            Dest[ OutLength++ ] = Window[ Pos++ ];
+        }
+
+        Mask<<= 1;
+    }
+
+    return OutLength;
+}
+
+/*
+ * Decompresses Src into Dest using the same dictionary it was compressed with.
+ * Returns the decompressed length, or 0 if the stream is corrupt or doesn't fit.
+ */
+int LZSS_Decompress( const uint8_t* Dict, int DictLength, const uint8_t* Src, int SrcLength, uint8_t* Dest, int MaxDestLength ) {
+    uint8_t Flags = 0;
+    int OutLength = 0;
+    int Offset = 0;
+    int Length = 0;
+    int Ref = 0;
+    int Bit = 0;
+    int i = 0;
+
+    if ( DictLength > LZSSMaxDictLen ) {
+        Dict+= DictLength - LZSSMaxDictLen;
+        DictLength = LZSSMaxDictLen;
+    }
+
+    while ( i < SrcLength ) {
+        Flags = Src[ i++ ];
+
+        for ( Bit = 0; Bit < 8 && i < SrcLength; Bit++ ) {
+            if ( Flags & ( 1 << Bit ) ) {
+                if ( ( i + 2 ) > SrcLength )
+                    return 0;
+
+                Offset = ( ( Src[ i ] << 4 ) | ( Src[ i + 1 ] >> 4 ) ) + 1;
+                Length = ( Src[ i + 1 ] & 0x0F ) + LZSSMinMatch;
+                i+= 2;
+
+                Ref = OutLength - Offset;
+
+                if ( Ref < -DictLength || ( OutLength + Length ) > MaxDestLength )
+                    return 0;
+
+                /* Negative references land in the dictionary, matches may overlap their own output */
+                while ( Length-- > 0 ) {
+                    Dest[ OutLength++ ] = ( Ref < 0 ) ? Dict[ DictLength + Ref ] : Dest[ Ref ];
+                    Ref++;
+                }
+            } else {
+                if ( OutLength >= MaxDestLength )
+                    return 0;
+
+                Dest[ OutLength++ ] = Src[ i++ ];
+            }
+        }
+    }
+
+    return OutLength;
+}
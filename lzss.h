@@ -0,0 +1,75 @@
+#ifndef _LZSS_H_
+#define _LZSS_H_
+
+/*
+ * Small LZSS codec for compressing single packets on the serial link.
+ * Plain C with no Arduino dependencies so the host side (tools/slipz.c)
+ * builds the exact same file.
+ *
+ * Each packet is compressed on its own, but matches can reach back into a
+ * preset dictionary of strings common in that direction (HTTP headers, IRC
+ * commands...). Both ends have the dictionary compiled in, so nothing is
+ * lost when a frame is dropped on the wire.
+ *
+ * Stream format: a flag byte followed by 8 items, bit 0 first. A clear bit
+ * is a literal byte, a set bit a 2 byte match: 12 bits of (offset - 1) and
+ * 4 bits of (length - LZSSMinMatch), most significant first.
+ */
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LZSSWindowSize 4096
+#define LZSSMinMatch 3
+#define LZSSMaxMatch ( LZSSMinMatch + 15 )
+
+#define LZSSHashBits 9
+#define LZSSHashSize ( 1 << LZSSHashBits )
+
+#define LZSSMaxDictLen 640
+#define LZSSMaxInput 1536
+
+/*
+ * Everything the compressor needs, about 4.2KB, nothing is allocated.
+ */
+struct LZSSContext {
+    /* Hash heads with only the dictionary inserted, copied over Head for each packet */
+    uint16_t DictHead[ LZSSHashSize ];
+    uint16_t Head[ LZSSHashSize ];
+
+    /* Dictionary followed by the packet being compressed */
+    uint8_t Window[ LZSSMaxDictLen + LZSSMaxInput ];
+    int DictLength;
+};
+
+/* Preset dictionaries, one for each direction of the link */
+extern const uint8_t LZSSDict_ToHost[ ];
+extern const int LZSSDict_ToHostLen;
+extern const uint8_t LZSSDict_FromHost[ ];
+extern const int LZSSDict_FromHostLen;
+
+/*
+ * Sets up a compression context for the given dictionary.
+ */
+void LZSS_Init( struct LZSSContext* Context, const uint8_t* Dict, int DictLength );
+
+/*
+ * Compresses Src into Dest. Returns the compressed length, or 0 if the
+ * result wouldn't be smaller than the input or doesn't fit in Dest.
+ */
+int LZSS_Compress( struct LZSSContext* Context, const uint8_t* Src, int SrcLength, uint8_t* Dest, int MaxDestLength );
+
+/*
+ * Decompresses Src into Dest using the same dictionary it was compressed with.
+ * Returns the decompressed length, or 0 if the stream is corrupt or doesn't fit.
+ */
+int LZSS_Decompress( const uint8_t* Dict, int DictLength, const uint8_t* Src, int SrcLength, uint8_t* Dest, int MaxDestLength );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -7,6 +7,7 @@
 #include "util.h"
 #include "slip.h"
 #include "mydebug.h"
+#include "hotpath.h"
 
 extern "C" {
 #include <netif/wlan_lwip_if.h>
@@ -17,51 +18,80 @@ extern "C" {
 /*
  * Sends a printf formatted string and arguments to the serial port. 
  */
-int DebugPrintf_UART( const char* Message, ... ) {
+int COLDPATH DebugVPrintf_UART( const char* Message, va_list Argp ) {
     char DebugTextBuffer[ 512 ];
     int Length = 0;
+
+    Length = vsnprintf( DebugTextBuffer, sizeof( DebugTextBuffer ), Message, Argp );
+
+    Serial1.write( DebugTextBuffer );
+    return Length;
+}
+
+int COLDPATH DebugPrintf_UART( const char* Message, ... ) {
+    int Length = 0;
     va_list Argp;
 
     va_start( Argp, Message );
-    Length = vsnprintf( DebugTextBuffer, sizeof( DebugTextBuffer ), Message, Argp );
+    Length = DebugVPrintf_UART( Message, Argp );
     va_end( Argp );
 
-    Serial1.write( DebugTextBuffer );
     return Length;
 }
 
 /*
  * Sends a printf formatted string and arugments over WiFi with an ethertype of 0xBEEF. 
  */
-int DebugPrintf_EtherFrame( const char* Message, ... ) {
+int COLDPATH DebugVPrintf_EtherFrame( const char* Message, va_list Argp ) {
     char DebugTextBuffer[ 512 ];
-    struct EtherFrame* FrameHeader = ( struct EtherFrame* ) DebugTextBuffer;
+    struct EtherFrame FrameHeader;
     int Length = 0;
-    int Offset = 0;
-    va_list Argp;
 
-    Offset = PrepareEthernetHeader( FrameHeader, OurMACAddress, BroadcastMACAddress, 0xBEEF );
+    PrepareEthernetHeader( &FrameHeader, OurMACAddress, BroadcastMACAddress, 0xBEEF );
+
+    Length = vsnprintf( DebugTextBuffer, sizeof( DebugTextBuffer ), Message, Argp );
+
+    if ( Length >= ( int ) sizeof( DebugTextBuffer ) )
+        Length = sizeof( DebugTextBuffer ) - 1;
+
+    EtherWriteParts( ( const uint8_t* ) &FrameHeader, sizeof( FrameHeader ), ( const uint8_t* ) DebugTextBuffer, Length + 1 );
+    return Length;
+}
+
+int COLDPATH DebugPrintf_EtherFrame( const char* Message, ... ) {
+    int Length = 0;
+    va_list Argp;
 
     va_start( Argp, Message );
-    Length = vsnprintf( &DebugTextBuffer[ Offset ], sizeof( DebugTextBuffer ) - Offset, Message, Argp );
+    Length = DebugVPrintf_EtherFrame( Message, Argp );
     va_end( Argp );
 
-    EtherWrite( ( uint8_t* ) DebugTextBuffer, Offset + Length + 1 );
     return Length;
 }
 
 /*
  * Sends a printf formatted string and arguments as a UDP broadcast to port 7810. 
  */
-int DebugPrintf_UDP( const char* Message, ... ) {
+int COLDPATH DebugVPrintf_UDP( const char* Message, va_list Argp ) {
     char DebugTextBuffer[ 512 ];
     int Length = 0;
+
+    Length = vsnprintf( DebugTextBuffer, sizeof( DebugTextBuffer ), Message, Argp );
+
+    if ( Length >= ( int ) sizeof( DebugTextBuffer ) )
+        Length = sizeof( DebugTextBuffer ) - 1;
+
+    UDP_BuildOutgoingPacket( OurIPAddress, SubnetBroadcastIP( ), 7810, ( const uint8_t* ) DebugTextBuffer, Length + 1 );
+    return Length;
+}
+
+int COLDPATH DebugPrintf_UDP( const char* Message, ... ) {
+    int Length = 0;
     va_list Argp;
 
     va_start( Argp, Message );
-    Length = vsnprintf( DebugTextBuffer, sizeof( DebugTextBuffer ), Message, Argp );
+    Length = DebugVPrintf_UDP( Message, Argp );
     va_end( Argp );
 
-    UDP_BuildOutgoingPacket( OurIPAddress, IPAddress( 192, 168, 2, 255 ), 7810, ( const uint8_t* ) DebugTextBuffer, Length + 1 );
     return Length;
 }
@@ -1,33 +1,72 @@
 #ifndef _MYDEBUG_H_
 #define _MYDEBUG_H_
 
+#include <stdarg.h>
+
+/* Where DebugPrintf output goes, pick one or none */
 #define DEBUG_UART
 // #define DEBUG_ETHERFRAME
 // #define DEBUG_UDP
 
-#if defined ( DEBUG_UART )
-#define DebugPrintf DebugPrintf_UART
-#elif defined ( DEBUG_ETHERFRAME )
-#define DebugPrintf DebugPrintf_EtherFrame
-#elif defined ( DEBUG_UDP )
-#define DebugPrintf DebugPrintf_UDP
-#else
-#define DebugPrintf( a, ... )
-#endif
-
 /*
  * Sends a printf formatted string and arguments to the serial port. 
  */
 int DebugPrintf_UART( const char* Message, ... );
+int DebugVPrintf_UART( const char* Message, va_list Argp );
 
 /*
  * Sends a printf formatted string and arugments over WiFi with an ethertype of 0xBEEF. 
  */
 int DebugPrintf_EtherFrame( const char* Message, ... );
+int DebugVPrintf_EtherFrame( const char* Message, va_list Argp );
 
 /*
  * Sends a printf formatted string and arguments as a UDP broadcast to port 7810. 
  */
 int DebugPrintf_UDP( const char* Message, ... );
+int DebugVPrintf_UDP( const char* Message, va_list Argp );
+
+/*
+ * Debug sink policies, same idea as the bridge policies in bridge.h:
+ * DebugPrintf is bound to one of these at compile time.
+ */
+struct UARTDebugSink {
+    static inline int VPrintf( const char* Message, va_list Argp ) { return DebugVPrintf_UART( Message, Argp ); }
+};
+
+struct EtherFrameDebugSink {
+    static inline int VPrintf( const char* Message, va_list Argp ) { return DebugVPrintf_EtherFrame( Message, Argp ); }
+};
+
+struct UDPDebugSink {
+    static inline int VPrintf( const char* Message, va_list Argp ) { return DebugVPrintf_UDP( Message, Argp ); }
+};
+
+template <class Sink>
+static inline int DebugPrintf_Sink( const char* Message, ... ) {
+    int Length = 0;
+    va_list Argp;
+
+    va_start( Argp, Message );
+    Length = Sink::VPrintf( Message, Argp );
+    va_end( Argp );
+
+    return Length;
+}
+
+#if defined ( DEBUG_UART )
+typedef UARTDebugSink DebugSink;
+#elif defined ( DEBUG_ETHERFRAME )
+typedef EtherFrameDebugSink DebugSink;
+#elif defined ( DEBUG_UDP )
+typedef UDPDebugSink DebugSink;
+#endif
+
+/* With no sink the calls and their arguments compile away entirely */
+#if defined ( DEBUG_UART ) || defined ( DEBUG_ETHERFRAME ) || defined ( DEBUG_UDP )
+#define DebugPrintf DebugPrintf_Sink<DebugSink>
+#else
+#define DebugPrintf( a, ... )
+#endif
 
 #endif
@@ -0,0 +1,76 @@
+#include <ESP8266WiFi.h>
+#include <lwip/netif.h>
+#include <lwip/err.h>
+#include "ether.h"
+#include "ipv4.h"
+#include "util.h"
+#include "slip.h"
+#include "mydebug.h"
+#include "nexthop.h"
+#include "hotpath.h"
+
+struct NextHopEntry {
+    uint8_t Header[ sizeof( struct EtherFrame ) ];
+    uint32_t DestIP;
+
+    /* ARP table generation this was built from, 0 is never valid */
+    uint32_t Generation;
+};
+
+static struct NextHopEntry NextHopCache[ NextHopCacheEntries ];
+
+static uint32_t CacheHits = 0;
+static uint32_t CacheMisses = 0;
+static uint32_t CacheUnresolved = 0;
+
+/*
+ * Folds all four octets together so hosts on one subnet spread across the table.
+ */
+static inline int NextHop_Slot( uint32_t DestIP ) {
+    DestIP^= DestIP >> 16;
+    DestIP^= DestIP >> 8;
+
+    return DestIP & ( NextHopCacheEntries - 1 );
+}
+
+/*
+ * Writes the ethernet header for a packet to DestIP at Frame.
+ * On a miss the next hop is resolved through the ARP table (blocking, as before)
+ * and cached. Returns 0 if the next hop's MAC address isn't known.
+ */
+int FASTPATH NextHop_PrepareHeader( uint32_t DestIP, uint8_t* Frame ) {
+    struct NextHopEntry* Entry = &NextHopCache[ NextHop_Slot( DestIP ) ];
+    uint8_t MAC[ MACAddressLen ];
+    uint32_t Generation = ARP_Generation( );
+
+    if ( Entry->DestIP == DestIP && Entry->Generation == Generation ) {
+        memcpy( Frame, Entry->Header, sizeof( Entry->Header ) );
+
+        CacheHits++;
+        return 1;
+    }
+
+    CacheMisses++;
+
+    if ( ARP_RequestMACFromIP_Blocking( AreWeOnTheSameSubnet( DestIP ) ? DestIP : ( uint32_t ) OurGateway, MAC ) == 0 ) {
+        CacheUnresolved++;
+        return 0;
+    }
+
+    PrepareEthernetHeader( ( struct EtherFrame* ) Entry->Header, OurMACAddress, MAC, EtherType_IPv4 );
+
+    Entry->DestIP = DestIP;
+
+    /* Re-read it, a reply that arrived while we waited has already bumped it */
+    Entry->Generation = ARP_Generation( );
+
+    memcpy( Frame, Entry->Header, sizeof( Entry->Header ) );
+    return 1;
+}
+
+/*
+ * Writes the cache counters to the debug console.
+ */
+void NextHop_DumpStats( void ) {
+    DebugPrintf( "%s: Hits %u / Misses %u / Unresolved %u\n", __FUNCTION__, CacheHits, CacheMisses, CacheUnresolved );
+}
@@ -0,0 +1,28 @@
+#ifndef _NEXTHOP_H_
+#define _NEXTHOP_H_
+
+/*
+ * Next hop cache.
+ * A small direct mapped table from destination IP to the finished ethernet
+ * header for it, next hop MAC (the destination itself or the gateway),
+ * our MAC and the IPv4 type. Entries are stamped with the ARP table
+ * generation and any change to the neighbor table makes them all stale,
+ * so there is nothing to invalidate by hand.
+ */
+
+/* Must be a power of two */
+#define NextHopCacheEntries 16
+
+/*
+ * Writes the ethernet header for a packet to DestIP at Frame.
+ * On a miss the next hop is resolved through the ARP table (blocking, as before)
+ * and cached. Returns 0 if the next hop's MAC address isn't known.
+ */
+int NextHop_PrepareHeader( uint32_t DestIP, uint8_t* Frame );
+
+/*
+ * Writes the cache counters to the debug console.
+ */
+void NextHop_DumpStats( void );
+
+#endif
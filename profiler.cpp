@@ -0,0 +1,123 @@
+#include <ESP8266WiFi.h>
+#include <lwip/netif.h>
+#include <lwip/err.h>
+#include "ether.h"
+#include "ipv4.h"
+#include "util.h"
+#include "slip.h"
+#include "mydebug.h"
+#include "profiler.h"
+
+#if defined ( PROFILER_ENABLED )
+
+/* Timer1 counts at 80MHz / 16 */
+#define ProfilerTimerHz 5000000
+
+/*
+ * Single producer (the NMI) and single consumer (Profiler_Tick).
+ * Head and Tail only ever increase, the slot is (Index & (ProfilerRingEntries - 1)).
+ */
+static volatile uint32_t Samples[ ProfilerRingEntries ];
+static volatile uint32_t SampleHead = 0;
+static volatile uint32_t SampleTail = 0;
+static volatile uint32_t SamplesDropped = 0;
+
+static uint32_t SampleRate = 0;
+static uint32_t SamplesTaken = 0;
+static uint32_t LastDropped = 0;
+static int IsRunning = 0;
+
+/*
+ * Runs as an NMI, it must live in IRAM and can't call anything that does not.
+ */
+static void ICACHE_RAM_ATTR Profiler_OnSample( void ) {
+    uint32_t PC = 0;
+
+    __asm__ __volatile__( "rsr %0, epc3" : "=r" ( PC ) );
+
+    /* Acknowledge the timer interrupt */
+    T1I = 0;
+
+    if ( ( SampleHead - SampleTail ) >= ProfilerRingEntries ) {
+        SamplesDropped++;
+        return;
+    }
+
+    Samples[ SampleHead & ( ProfilerRingEntries - 1 ) ] = PC;
+    SampleHead++;
+}
+
+/*
+ * Starts sampling at SampleHz, anything from 1Hz up to about 10kHz.
+ */
+void Profiler_Start( uint32_t SampleHz ) {
+    if ( SampleHz == 0 )
+        SampleHz = ProfilerDefaultHz;
+
+    SampleRate = SampleHz;
+
+    ETS_FRC_TIMER1_NMI_INTR_ATTACH( Profiler_OnSample );
+    timer1_enable( TIM_DIV16, TIM_EDGE, TIM_LOOP );
+    timer1_write( ProfilerTimerHz / SampleHz );
+
+    TM1_EDGE_INT_ENABLE( );
+    ETS_FRC1_INTR_ENABLE( );
+
+    IsRunning = 1;
+    DebugPrintf( "%s: Sampling at %uHz\n", __FUNCTION__, SampleHz );
+}
+
+/*
+ * Stops sampling, samples already in the ring are still written out.
+ */
+void Profiler_Stop( void ) {
+    TM1_EDGE_INT_DISABLE( );
+    ETS_FRC1_INTR_DISABLE( );
+    timer1_disable( );
+
+    IsRunning = 0;
+}
+
+/*
+ * Called every "frame" or run through the main loop, writes out collected samples.
+ */
+void Profiler_Tick( void ) {
+    char Line[ 32 + ( ProfilerSamplesPerLine * 9 ) ];
+    uint32_t Dropped = 0;
+    int Length = 0;
+    int Lines = 0;
+    int i = 0;
+
+    /* Only write full lines while running so each one is worth the overhead */
+    while ( Lines < ProfilerMaxLinesPerTick && ( SampleHead - SampleTail ) >= ( IsRunning ? ProfilerSamplesPerLine : 1 ) ) {
+        Dropped = SamplesDropped;
+        Length = snprintf( Line, sizeof( Line ), "PROF %u %u", SampleRate, Dropped - LastDropped );
+        LastDropped = Dropped;
+
+        for ( i = 0; i < ProfilerSamplesPerLine && SampleTail != SampleHead; i++ ) {
+            Length+= snprintf( &Line[ Length ], sizeof( Line ) - Length, " %08x", Samples[ SampleTail & ( ProfilerRingEntries - 1 ) ] );
+
+            SampleTail++;
+            SamplesTaken++;
+        }
+
+        Length+= snprintf( &Line[ Length ], sizeof( Line ) - Length, "\n" );
+
+#if defined ( PROFILER_OUTPUT_UART )
+        Serial1.write( ( const uint8_t* ) Line, Length );
+#elif defined ( PROFILER_OUTPUT_UDP )
+        UDP_BuildOutgoingPacket( OurIPAddress, ProfilerCollectorIP, ProfilerCollectorPort, ( const uint8_t* ) Line, Length );
+#endif
+
+        Lines++;
+    }
+}
+
+/*
+ * Writes the profiler counters to the debug console.
+ */
+void Profiler_DumpStats( void ) {
+    DebugPrintf( "%s: %s at %uHz / Samples written %u / Dropped %u / Waiting %u\n", __FUNCTION__, IsRunning ? "Running" : "Stopped", SampleRate, SamplesTaken, SamplesDropped, SampleHead - SampleTail );
+}
+
+#endif
@@ -0,0 +1,68 @@
+#ifndef _PROFILER_H_
+#define _PROFILER_H_
+
+/*
+ * Sampling profiler.
+ * Timer1 fires an NMI (SampleHz) times a second and the handler records the
+ * interrupted program counter (EPC3) into a fixed ring. Being an NMI it
+ * still sees code running with interrupts off, like MyInputFn. Samples are
+ * written out from the main loop as text lines:
+ *
+ *   PROF <hz> <dropped> <pc> <pc> ...
+ *
+ * tools/profsym.py turns a log of those into a flat profile and folded
+ * stacks for flamegraph.pl, using the firmware ELF.
+ *
+ * Cost is about 1us per sample plus the dump, so 1kHz is around 0.1%.
+ */
+
+// #define PROFILER_ENABLED
+#define PROFILER_OUTPUT_UART
+// #define PROFILER_OUTPUT_UDP
+
+#define ProfilerDefaultHz 1000
+
+/* Must be a power of two */
+#define ProfilerRingEntries 512
+
+#define ProfilerSamplesPerLine 8
+
+/* Caps how long Profiler_Tick can spend writing in one go */
+#define ProfilerMaxLinesPerTick 4
+
+/* Same as the capture output, the subnet broadcast unless set to IPAddress( ... ) */
+#define ProfilerCollectorIP SubnetBroadcastIP( )
+#define ProfilerCollectorPort 7812
+
+#if defined ( PROFILER_ENABLED )
+
+/*
+ * Starts sampling at SampleHz, anything from 1Hz up to about 10kHz.
+ */
+void Profiler_Start( uint32_t SampleHz );
+
+/*
+ * Stops sampling, samples already in the ring are still written out.
+ */
+void Profiler_Stop( void );
+
+/*
+ * Called every "frame" or run through the main loop, writes out collected samples.
+ */
+void Profiler_Tick( void );
+
+/*
+ * Writes the profiler counters to the debug console.
+ */
+void Profiler_DumpStats( void );
+
+#else
+
+#define Profiler_Start( a )
+#define Profiler_Stop( )
+#define Profiler_Tick( )
+#define Profiler_DumpStats( )
+
+#endif
+
+#endif
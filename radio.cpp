@@ -0,0 +1,172 @@
+#include <ESP8266WiFi.h>
+#include <lwip/netif.h>
+#include <lwip/err.h>
+#include "ether.h"
+#include "ipv4.h"
+#include "util.h"
+#include "slip.h"
+#include "mydebug.h"
+#include "radio.h"
+
+extern "C" {
+#include <user_interface.h>
+}
+
+struct RadioStateInfo {
+    const char* Name;
+    enum sleep_type SleepType;
+    enum phy_mode PhyMode;
+};
+
+static const struct RadioStateInfo RadioStates[ RadioState_Count ] = {
+    { "Active", NONE_SLEEP_T, RadioActivePhyMode },
+    { "Idle", MODEM_SLEEP_T, RadioIdlePhyMode },
+    { "Dormant", LIGHT_SLEEP_T, RadioDormantPhyMode }
+};
+
+static volatile uint32_t RadioPacketCount = 0;
+static volatile uint32_t FirstPacketWhileAsleep = 0;
+
+static int RadioState = RadioState_Idle;
+static uint32_t StateEnteredTime = 0;
+static uint32_t LastPacketTime = 0;
+static uint32_t BelowExitRateSince = 0;
+
+/* Packets seen in each of the last RadioRateSamples intervals, and their sum */
+static uint32_t WindowSamples[ RadioRateSamples ];
+static uint32_t WindowPackets = 0;
+static int WindowIndex = 0;
+
+static uint32_t TimeInState[ RadioState_Count ];
+static uint32_t StateChanges = 0;
+static uint32_t LastWakeLatencyMS = 0;
+static uint32_t MaxWakeLatencyMS = 0;
+
+/*
+ * Counts a packet towards the current rate, cheap enough to call from the WiFi callback.
+ */
+void Radio_CountPacket( void ) {
+    RadioPacketCount++;
+
+    if ( RadioState != RadioState_Active && FirstPacketWhileAsleep == 0 )
+        FirstPacketWhileAsleep = millis( ) | 1;
+}
+
+static void Radio_SetState( int NewState, uint32_t Now ) {
+    const struct RadioStateInfo* Old = &RadioStates[ RadioState ];
+    const struct RadioStateInfo* New = &RadioStates[ NewState ];
+
+    TimeInState[ RadioState ]+= Now - StateEnteredTime;
+
+    if ( Old->PhyMode != New->PhyMode )
+        wifi_set_phy_mode( New->PhyMode );
+
+    wifi_set_sleep_type( New->SleepType );
+
+    /* How long traffic waited on us to notice it and turn the radio all the way on */
+    if ( NewState == RadioState_Active && FirstPacketWhileAsleep ) {
+        LastWakeLatencyMS = Now - FirstPacketWhileAsleep;
+
+        if ( LastWakeLatencyMS > MaxWakeLatencyMS )
+            MaxWakeLatencyMS = LastWakeLatencyMS;
+    }
+
+    FirstPacketWhileAsleep = 0;
+    BelowExitRateSince = 0;
+    StateEnteredTime = Now;
+    RadioState = NewState;
+    StateChanges++;
+}
+
+/*
+ * Puts the radio into the active state.
+ */
+void Radio_Init( void ) {
+    uint32_t Now = millis( );
+
+    memset( TimeInState, 0, sizeof( TimeInState ) );
+    memset( WindowSamples, 0, sizeof( WindowSamples ) );
+    WindowPackets = 0;
+    WindowIndex = 0;
+
+    StateEnteredTime = Now;
+    LastPacketTime = Now;
+
+    Radio_SetState( RadioState_Active, Now );
+    StateChanges = 0;
+}
+
+/*
+ * Called every "frame" or run through the main loop.
+ */
+void Radio_Tick( void ) {
+    static uint32_t NextSample = 0;
+    uint32_t Now = millis( );
+    uint32_t Packets = 0;
+    uint32_t PPS = 0;
+
+    if ( Now < NextSample )
+        return;
+
+    NextSample = Now + RadioSampleIntervalMS;
+
+    /* Also counted from the WiFi callback */
+    noInterrupts( );
+    Packets = RadioPacketCount;
+    RadioPacketCount = 0;
+    interrupts( );
+
+    WindowPackets-= WindowSamples[ WindowIndex ];
+    WindowPackets+= Packets;
+    WindowSamples[ WindowIndex ] = Packets;
+    WindowIndex = ( WindowIndex + 1 ) % RadioRateSamples;
+
+    PPS = ( WindowPackets * 1000 ) / RadioRateWindowMS;
+
+    if ( Packets )
+        LastPacketTime = Now;
+
+    switch ( RadioState ) {
+        case RadioState_Active: {
+            if ( PPS >= RadioActiveExitPPS ) {
+                BelowExitRateSince = 0;
+            } else if ( BelowExitRateSince == 0 ) {
+                BelowExitRateSince = Now;
+            } else if ( ( Now - BelowExitRateSince ) >= RadioIdleAfterMS ) {
+                Radio_SetState( RadioState_Idle, Now );
+            }
+
+            break;
+        }
+        case RadioState_Idle: {
+            if ( PPS >= RadioActiveEnterPPS )
+                Radio_SetState( RadioState_Active, Now );
+            else if ( ( Now - LastPacketTime ) >= RadioDormantAfterMS )
+                Radio_SetState( RadioState_Dormant, Now );
+
+            break;
+        }
+        case RadioState_Dormant: {
+            /* Any traffic at all means someone is back, don't wait for the rate to build */
+            if ( Packets )
+                Radio_SetState( RadioState_Active, Now );
+
+            break;
+        }
+        default: break;
+    };
+}
+
+/*
+ * Writes time spent in each state and the wake latency to the debug console.
+ */
+void Radio_DumpStats( void ) {
+    uint32_t Current = millis( ) - StateEnteredTime;
+
+    DebugPrintf( "%s: %s / Active/Idle/Dormant [%u,%u,%u]ms / Changes %u / Wake latency last/max [%u,%u]ms\n", __FUNCTION__,
+        RadioStates[ RadioState ].Name,
+        TimeInState[ RadioState_Active ] + ( RadioState == RadioState_Active ? Current : 0 ),
+        TimeInState[ RadioState_Idle ] + ( RadioState == RadioState_Idle ? Current : 0 ),
+        TimeInState[ RadioState_Dormant ] + ( RadioState == RadioState_Dormant ? Current : 0 ),
+        StateChanges, LastWakeLatencyMS, MaxWakeLatencyMS );
+}
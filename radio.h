@@ -0,0 +1,67 @@
+#ifndef _RADIO_H_
+#define _RADIO_H_
+
+/*
+ * Adaptive WiFi radio policy.
+ * Watches the packet rate on both sides of the bridge and picks the modem
+ * sleep type (and optionally PHY mode) to match, with hysteresis so we
+ * don't flap between states on every other packet.
+ *
+ * Active:  NONE_SLEEP, lowest latency for interactive traffic.
+ * Idle:    MODEM_SLEEP, the SDK default, radio sleeps between beacons.
+ * Dormant: LIGHT_SLEEP, nothing has happened for a long time.
+ */
+
+#define RadioSampleIntervalMS 250
+
+/*
+ * The rate is the packet count over the last (RadioRateWindowMS), a multiple of RadioSampleIntervalMS.
+ * It has to be at least a second so the rate moves in steps of 1 packet per second or less,
+ * otherwise the enter and exit thresholds below end up meaning the same thing.
+ */
+#define RadioRateWindowMS 1000
+#define RadioRateSamples ( RadioRateWindowMS / RadioSampleIntervalMS )
+
+/* Packets per second needed to go (or stay) active */
+#define RadioActiveEnterPPS 4
+#define RadioActiveExitPPS 1
+
+/* How long the rate has to stay below RadioActiveExitPPS before dropping to idle */
+#define RadioIdleAfterMS SecondsToMS( 5 )
+
+/* How long without a single packet before going dormant */
+#define RadioDormantAfterMS SecondsToMS( 60 )
+
+/* PHY mode for each state, changing it can make the SDK reassociate so they default to the same */
+#define RadioActivePhyMode PHY_MODE_11N
+#define RadioIdlePhyMode PHY_MODE_11N
+#define RadioDormantPhyMode PHY_MODE_11N
+
+enum {
+    RadioState_Active = 0,
+    RadioState_Idle,
+    RadioState_Dormant,
+    RadioState_Count
+};
+
+/*
+ * Counts a packet towards the current rate, cheap enough to call from the WiFi callback.
+ */
+void Radio_CountPacket( void );
+
+/*
+ * Puts the radio into the active state.
+ */
+void Radio_Init( void );
+
+/*
+ * Called every "frame" or run through the main loop.
+ */
+void Radio_Tick( void );
+
+/*
+ * Writes time spent in each state and the wake latency to the debug console.
+ */
+void Radio_DumpStats( void );
+
+#endif
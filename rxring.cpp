@@ -0,0 +1,261 @@
+#include <ESP8266WiFi.h>
+#include <lwip/netif.h>
+#include <lwip/err.h>
+#include "ether.h"
+#include "ipv4.h"
+#include "util.h"
+#include "slip.h"
+#include "mydebug.h"
+#include "hdrview.h"
+#include "rxring.h"
+#include "hotpath.h"
+
+/* Length header plus frame, rounded up so the next record starts 4 byte aligned */
+#define RXRing_RecordSize( Length ) ( ( EtherFrameHeadroom + ( Length ) + 3 ) & ~3 )
+
+static uint8_t Ring[ RXRingSize ] __attribute__( ( aligned( 4 ) ) );
+
+/* Region A is [ AStart, AEnd ), region B when in use is [ 0, BEnd ) */
+static volatile int AStart = 0;
+static volatile int AEnd = 0;
+static volatile int BEnd = 0;
+static volatile int BInUse = 0;
+
+static volatile int Frames = 0;
+static volatile int BytesUsed = 0;
+
+static int PeakFrames = 0;
+static int PeakBytes = 0;
+static uint32_t FramesWritten = 0;
+static uint32_t FramesDropped = 0;
+static uint32_t OccupancySamples = 0;
+static uint64_t OccupancyBytesSum = 0;
+static uint64_t OccupancyFramesSum = 0;
+
+/* Single producer (the receive callback) and single consumer (the main loop), slot is (Index % RXRingMaxDeferred) */
+static struct pbuf* volatile Deferred[ RXRingMaxDeferred ];
+static volatile uint32_t DeferredHead = 0;
+static volatile uint32_t DeferredTail = 0;
+
+static int PeakDeferred = 0;
+static uint32_t FramesDeferred = 0;
+static uint32_t DeferFull = 0;
+
+static uint32_t Callbacks = 0;
+static uint64_t CallbackCycles = 0;
+static uint32_t MaxCallbackCycles = 0;
+
+static uint32_t DrainPasses = 0;
+static uint32_t DrainFrames = 0;
+static uint32_t DrainBudgetHits = 0;
+static int MaxDrainBatch = 0;
+
+/*
+ * Copies a frame into the ring.
+ * Returns 0 if there was no room and the frame was dropped.
+ */
+int FASTPATH RXRing_Write( const uint8_t* Frame, int Length ) {
+    int Size = RXRing_RecordSize( Length );
+    int Offset = -1;
+
+    if ( Length <= 0 || Length > RXRingMaxFrameLen ) {
+        FramesDropped++;
+        return 0;
+    }
+
+    if ( BInUse ) {
+        if ( ( AStart - BEnd ) >= Size )
+            Offset = BEnd;
+    } else if ( ( RXRingSize - AEnd ) >= Size ) {
+        Offset = AEnd;
+    } else if ( AStart >= Size ) {
+        /* No room at the end, start region B at the front */
+        Offset = 0;
+        BEnd = 0;
+        BInUse = 1;
+    }
+
+    if ( Offset < 0 ) {
+        FramesDropped++;
+        return 0;
+    }
+
+    *( ( uint16_t* ) &Ring[ Offset ] ) = Length;
+    memcpy( &Ring[ Offset + EtherFrameHeadroom ], Frame, Length );
+
+    if ( BInUse )
+        BEnd = Offset + Size;
+    else
+        AEnd = Offset + Size;
+
+    Frames++;
+    BytesUsed+= Size;
+    FramesWritten++;
+
+    if ( Frames > PeakFrames )
+        PeakFrames = Frames;
+
+    if ( BytesUsed > PeakBytes )
+        PeakBytes = BytesUsed;
+
+    OccupancySamples++;
+    OccupancyBytesSum+= BytesUsed;
+    OccupancyFramesSum+= Frames;
+
+    return 1;
+}
+
+/*
+ * Returns the oldest frame without removing it, or NULL if the ring is empty.
+ */
+FASTPATH const uint8_t* RXRing_Peek( int* Length ) {
+    if ( AStart == AEnd )
+        return NULL;
+
+    *Length = *( ( const uint16_t* ) &Ring[ AStart ] );
+    return &Ring[ AStart + EtherFrameHeadroom ];
+}
+
+/*
+ * Removes the frame last returned by RXRing_Peek.
+ */
+void FASTPATH RXRing_Release( void ) {
+    int Size = 0;
+
+    noInterrupts( );
+
+    if ( AStart != AEnd ) {
+        Size = RXRing_RecordSize( *( ( const uint16_t* ) &Ring[ AStart ] ) );
+
+        AStart+= Size;
+        BytesUsed-= Size;
+        Frames--;
+
+        /* Region A drained, B (if any) becomes the new A */
+        if ( AStart == AEnd ) {
+            AStart = 0;
+            AEnd = BInUse ? BEnd : 0;
+            BEnd = 0;
+            BInUse = 0;
+        }
+    }
+
+    interrupts( );
+}
+
+/*
+ * Returns the number of frames waiting.
+ */
+int RXRing_Count( void ) {
+    return Frames;
+}
+
+/*
+ * Returns 1 if the receive callback should hand its pbufs to RXRing_Defer instead of copying them.
+ */
+int FASTPATH RXRing_IsDeferring( void ) {
+    return DeferredHead != DeferredTail || BytesUsed >= RXRingHighWater;
+}
+
+/*
+ * Keeps hold of a pbuf chain for the main loop to copy out later.
+ * Returns 0 if there are already (RXRingMaxDeferred) waiting, the caller still owns it then.
+ */
+int FASTPATH RXRing_Defer( struct pbuf* p ) {
+    int Waiting = ( int ) ( DeferredHead - DeferredTail );
+
+    if ( Waiting >= RXRingMaxDeferred ) {
+        DeferFull++;
+        return 0;
+    }
+
+    Deferred[ DeferredHead % RXRingMaxDeferred ] = p;
+    DeferredHead++;
+    FramesDeferred++;
+
+    if ( ++Waiting > PeakDeferred )
+        PeakDeferred = Waiting;
+
+    return 1;
+}
+
+/*
+ * Returns the oldest deferred pbuf chain once the ring is empty, or NULL.
+ * The caller frees it.
+ */
+struct pbuf* FASTPATH RXRing_TakeDeferred( void ) {
+    struct pbuf* p = NULL;
+
+    /* Everything in the ring arrived before the first deferred pbuf */
+    if ( AStart != AEnd || DeferredHead == DeferredTail )
+        return NULL;
+
+    p = Deferred[ DeferredTail % RXRingMaxDeferred ];
+    DeferredTail++;
+
+    return p;
+}
+
+/*
+ * Counts time spent in the receive callback.
+ */
+void FASTPATH RXRing_CountCallback( uint32_t Cycles ) {
+    Callbacks++;
+    CallbackCycles+= Cycles;
+
+    if ( Cycles > MaxCallbackCycles )
+        MaxCallbackCycles = Cycles;
+}
+
+/*
+ * Counts frames handed out in one pass of the main loop.
+ */
+void RXRing_CountDrain( int Count ) {
+    if ( Count == 0 )
+        return;
+
+    DrainPasses++;
+    DrainFrames+= Count;
+
+    if ( Count >= RXDrainBudget )
+        DrainBudgetHits++;
+
+    if ( Count > MaxDrainBatch )
+        MaxDrainBatch = Count;
+}
+
+/*
+ * Writes the ring occupancy counters to the debug console, peaks are reset after.
+ */
+void RXRing_DumpStats( void ) {
+    uint32_t AverageBytes = OccupancySamples ? ( uint32_t ) ( OccupancyBytesSum / OccupancySamples ) : 0;
+    uint32_t AverageFrames100 = OccupancySamples ? ( uint32_t ) ( ( OccupancyFramesSum * 100 ) / OccupancySamples ) : 0;
+    uint32_t AverageCallbackCycles = Callbacks ? ( uint32_t ) ( CallbackCycles / Callbacks ) : 0;
+    uint32_t AverageBatch100 = DrainPasses ? ( uint32_t ) ( ( ( uint64_t ) DrainFrames * 100 ) / DrainPasses ) : 0;
+
+    DebugPrintf( "%s: Frames now/avg/peak [%d,%u.%02u,%d] / Bytes now/avg/peak [%d,%u,%d] of %d / Written/Dropped [%u,%u]\n", __FUNCTION__,
+        Frames, AverageFrames100 / 100, AverageFrames100 % 100, PeakFrames, BytesUsed, AverageBytes, PeakBytes, RXRingSize, FramesWritten, FramesDropped );
+
+    DebugPrintf( "%s: Deferred now/peak [%d,%d] of %d / Total %u / Full %u / Callbacks %u, time avg/max [%u,%u]us\n", __FUNCTION__,
+        ( int ) ( DeferredHead - DeferredTail ), PeakDeferred, RXRingMaxDeferred, FramesDeferred, DeferFull,
+        Callbacks, AverageCallbackCycles / ESP.getCpuFreqMHz( ), MaxCallbackCycles / ESP.getCpuFreqMHz( ) );
+
+    DebugPrintf( "%s: Drain passes %u / Batch avg/max [%u.%02u,%d] of %d / Budget used up %u\n", __FUNCTION__,
+        DrainPasses, AverageBatch100 / 100, AverageBatch100 % 100, MaxDrainBatch, RXDrainBudget, DrainBudgetHits );
+
+    noInterrupts( );
+
+    PeakFrames = Frames;
+    PeakBytes = BytesUsed;
+    OccupancySamples = 0;
+    OccupancyBytesSum = 0;
+    OccupancyFramesSum = 0;
+
+    PeakDeferred = ( int ) ( DeferredHead - DeferredTail );
+    MaxDrainBatch = 0;
+    Callbacks = 0;
+    CallbackCycles = 0;
+    MaxCallbackCycles = 0;
+
+    interrupts( );
+}
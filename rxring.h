@@ -0,0 +1,89 @@
+#ifndef _RXRING_H_
+#define _RXRING_H_
+
+/*
+ * WiFi receive queue, a bip-buffer of variable length records.
+ * Each record is a 2 byte length followed by the frame, padded out to 4
+ * bytes. That puts the frame (EtherFrameHeadroom) bytes past a 4 byte
+ * boundary like the bridge expects, and frames are handed out in place.
+ *
+ * A record never wraps around the end of the ring. When there's no room
+ * left after the current region the writer starts a second one at the
+ * front, and the reader moves over to it once the first one is drained.
+ *
+ * Once the ring is past (RXRingHighWater) the receive callback stops
+ * copying and just keeps hold of the pbufs, up to (RXRingMaxDeferred) of
+ * them. That keeps time spent with interrupts off short while a burst is
+ * coming in, and holding on to the driver's buffers slows the radio down
+ * instead of us dropping frames we already paid to copy. Deferred pbufs
+ * are handed out only after the ring is empty so frames stay in order, and
+ * the callback keeps deferring until they're all gone.
+ *
+ * The main loop drains at most (RXDrainBudget) frames a pass, giving the
+ * serial side a turn after each one.
+ */
+
+struct pbuf;
+
+#define RXRingSize 16384
+#define RXRingMaxFrameLen 2048
+
+#define RXRingHighWater ( ( RXRingSize * 3 ) / 4 )
+#define RXRingMaxDeferred 8
+
+#define RXDrainBudget 8
+
+/*
+ * Copies a frame into the ring.
+ * Returns 0 if there was no room and the frame was dropped.
+ */
+int RXRing_Write( const uint8_t* Frame, int Length );
+
+/*
+ * Returns the oldest frame without removing it, or NULL if the ring is empty.
+ */
+const uint8_t* RXRing_Peek( int* Length );
+
+/*
+ * Removes the frame last returned by RXRing_Peek.
+ */
+void RXRing_Release( void );
+
+/*
+ * Returns the number of frames waiting.
+ */
+int RXRing_Count( void );
+
+/*
+ * Returns 1 if the receive callback should hand its pbufs to RXRing_Defer instead of copying them.
+ */
+int RXRing_IsDeferring( void );
+
+/*
+ * Keeps hold of a pbuf chain for the main loop to copy out later.
+ * Returns 0 if there are already (RXRingMaxDeferred) waiting, the caller still owns it then.
+ */
+int RXRing_Defer( struct pbuf* p );
+
+/*
+ * Returns the oldest deferred pbuf chain once the ring is empty, or NULL.
+ * The caller frees it.
+ */
+struct pbuf* RXRing_TakeDeferred( void );
+
+/*
+ * Counts time spent in the receive callback.
+ */
+void RXRing_CountCallback( uint32_t Cycles );
+
+/*
+ * Counts frames handed out in one pass of the main loop.
+ */
+void RXRing_CountDrain( int Count );
+
+/*
+ * Writes the ring occupancy counters to the debug console, peaks are reset after.
+ */
+void RXRing_DumpStats( void );
+
+#endif
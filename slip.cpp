@@ -6,22 +6,98 @@
 #include "util.h"
 #include "slip.h"
 #include "mydebug.h"
+#include "link.h"
+#include "hdrview.h"
+#include "bridge.h"
+#include "radio.h"
+#include "txqueue.h"
+#include "dns.h"
+#include "splittcp.h"
+#include "lzss.h"
+#include "ethertx.h"
+#include "linkprobe.h"
+#include "arq.h"
+#include "transport.h"
+#include "trafficgen.h"
+#include "hotpath.h"
 
 #define SerialBufferSize 64
 
+#if defined ( SLIP_ARQ_ENABLED )
+#define SLIPFrameOverhead ARQOverhead
+#else
+#define SLIPFrameOverhead 0
+#endif
+
 #define DetailDebug( Message ) DebugPrintf( "%s::%s::%d: %s", __FILE__, __FUNCTION__, __LINE__, Message );
 
 /*
- * HACKHACKHACK
- * I should hope that any de-escaped SLIP packet does not exceed
- * double the size of the maximum SLIP packet length. 
+ * Frames are decoded straight into PacketBuffer as bytes come off the transport.
+ */
+static uint8_t PacketBuffer[ SLIPMaxPacketLen + SLIPFrameOverhead ] __attribute__( ( aligned( 4 ) ) );
+static struct SLIPDecoder Decoder = { PacketBuffer, sizeof( PacketBuffer ), 0, 0, 1 };
+
+#if defined ( SLIP_COBS_ENABLED )
+static struct COBSDecoder COBSFrameDecoder = { PacketBuffer, sizeof( PacketBuffer ), 0, 0, 0, 1 };
+#elif SLIPDefaultFraming == SLIPFraming_COBS
+#error "SLIPDefaultFraming is COBS but SLIP_COBS_ENABLED isn't defined"
+#endif
+
+/*
+ * Framing in use each way. RX switches as soon as the host asks,
+ * TX once the ack has been encoded in the old framing.
  */
-static uint8_t PacketBuffer[ SLIPMaxPacketLen * 2 ];
-static uint8_t SLIPBuffer[ SLIPMaxPacketLen * 2 ];
+static int RXFraming = SLIPDefaultFraming;
+static int TXFraming = SLIPDefaultFraming;
+static uint32_t FramingSwitches = 0;
 
-static uint8_t TXPacketBuffer[ SLIPMaxPacketLen * 2 ];
-static volatile int IsTXPacketQueued = 0;
-static volatile int TXPacketLength = 0;
+/* Answers to management frames, they go out ahead of everything else with the framing ack first */
+static uint8_t ManagementReply[ 3 ];
+static int FramingAckPending = 0;
+static int CompressionAckPending = 0;
+static int ARQAckPending = 0;
+
+/*
+ * Bytes read from the transport in one go, the decoder stops at the end
+ * of each frame so whatever follows waits here for the next SLIP_Tick.
+ */
+static uint8_t RXChunk[ SerialBufferSize ];
+static int RXChunkLength = 0;
+static int RXChunkOffset = 0;
+
+uint32_t SLIPBytesReceived = 0;
+
+/*
+ * The SLIP encoded frame currently going out from the transmit queue,
+ * it is written as the transport has room so SLIP_Tick never blocks on it.
+ */
+static uint8_t TXFrameBuffer[ ( TXQueueMaxPacketLen + SLIPFrameOverhead ) * 2 + 2 ];
+static int TXFrameLength = 0;
+static int TXFrameOffset = 0;
+
+#if defined ( SLIP_COMPRESSION_ENABLED )
+static struct LZSSContext CompressContext;
+static uint8_t ExpandBuffer[ SLIPMaxPacketLen ] __attribute__( ( aligned( 4 ) ) );
+static uint8_t CompressBuffer[ TXQueueMaxPacketLen ];
+static int HostCompresses = 0;
+
+static uint32_t CompressionResets = 0;
+static uint32_t CompressedRX = 0;
+static uint32_t CompressedTX = 0;
+static uint32_t ExpandErrors = 0;
+static uint32_t RXBytesExpanded = 0;
+static uint32_t RXBytesOnWire = 0;
+static uint32_t TXBytesUncompressed = 0;
+static uint32_t TXBytesOnWire = 0;
+#endif
+
+#if defined ( SLIP_ARQ_ENABLED )
+static struct ARQContext ARQ;
+static uint8_t ARQFrameBuffer[ TXQueueMaxPacketLen + ARQOverhead ];
+static int HostUsesARQ = 0;
+static int ARQReady = 0;
+static uint32_t ARQFallbacks = 0;
+#endif
 
 uint32_t PacketStartTime = 0;
 uint32_t PacketEndTime = 0;
@@ -29,9 +105,263 @@ uint32_t PacketEndTime = 0;
 extern volatile int TXBytesSent;
 extern volatile int TXBytesDropped;
 
-void SLIP_PacketComplete( const uint8_t* Packet, int Length ) {
-    if ( Length > 0 )
-        TCP_EtherEncapsulate( Packet, Length );
+void FASTPATH SLIP_PacketComplete( const uint8_t* Packet, int Length ) {
+    if ( Length <= 0 || ( Length = Bridge::AcceptFromSerial( Packet, Length ) ) == 0 )
+        return;
+
+    /* Reply to our own link probe */
+    if ( LinkProbe_OnPacketFromSerial( Packet, Length ) )
+        return;
+
+    /* Only host traffic counts towards the radio policy, management, bare ARQ acks and probe replies don't get this far */
+    Radio_CountPacket( );
+
+    /* Built in iperf generator and sink */
+    if ( TrafficGen_OnPacketFromSerial( Packet, Length ) )
+        return;
+
+    /* Answered from the DNS cache, no need to bother WiFi with it */
+    if ( DNS_OnQueryFromSerial( Packet, Length ) )
+        return;
+
+    /* Terminated locally by the split TCP proxy */
+    if ( SplitTCP_OnPacketFromSerial( Packet, Length ) )
+        return;
+
+    /* WiFi is down or still replaying older packets, keep ordering and hold this one */
+    if ( Link_CanForward( ) == 0 ) {
+        Link_HoldPacket( Packet, Length );
+        return;
+    }
+
+    TCP_EtherEncapsulate( Packet, Length );
+}
+
+/*
+ * If Packet is a compressed frame from the host it is expanded into ExpandBuffer.
+ * Returns the packet to use and updates Length, or NULL if it was corrupt.
+ */
+static const uint8_t* SLIP_Expand( const uint8_t* Packet, int* Length ) {
+#if defined ( SLIP_COMPRESSION_ENABLED )
+    int ExpandedLength = 0;
+
+    if ( *Length < 1 || Packet[ 0 ] != SLIPCompressedMarker )
+        return Packet;
+
+    if ( ( ExpandedLength = LZSS_Decompress( LZSSDict_FromHost, LZSSDict_FromHostLen, &Packet[ 1 ], *Length - 1, ExpandBuffer, sizeof( ExpandBuffer ) ) ) <= 0 ) {
+        ExpandErrors++;
+        return NULL;
+    }
+
+    CompressedRX++;
+    RXBytesOnWire+= *Length;
+    RXBytesExpanded+= ExpandedLength;
+
+    *Length = ExpandedLength;
+    return ExpandBuffer;
+#else
+    return Packet;
+#endif
+}
+
+/*
+ * Compresses a packet going to the host if it has asked for that and it actually gets smaller.
+ * Returns the packet to send and updates Length.
+ */
+static const uint8_t* SLIP_Compress( const uint8_t* Packet, int* Length ) {
+#if defined ( SLIP_COMPRESSION_ENABLED )
+    int CompressedLength = 0;
+
+    if ( HostCompresses == 0 )
+        return Packet;
+
+    TXBytesUncompressed+= *Length;
+    CompressedLength = LZSS_Compress( &CompressContext, Packet, *Length, &CompressBuffer[ 1 ], sizeof( CompressBuffer ) - 1 );
+
+    /* No gain once the marker byte is counted, send it as is */
+    if ( CompressedLength <= 0 || ( CompressedLength + 1 ) >= *Length ) {
+        TXBytesOnWire+= *Length;
+        return Packet;
+    }
+
+    CompressBuffer[ 0 ] = SLIPCompressedMarker;
+    CompressedTX++;
+
+    *Length = CompressedLength + 1;
+    TXBytesOnWire+= *Length;
+
+    return CompressBuffer;
+#else
+    return Packet;
+#endif
+}
+
+/*
+ * Turns compression of what we send on or off and queues the ack telling the host.
+ * Without compression built in the ack says it's off.
+ */
+static void SLIP_SetCompression( int On ) {
+#if defined ( SLIP_COMPRESSION_ENABLED )
+    if ( On != HostCompresses ) {
+        DebugPrintf( "%s: Compression %s.\n", __FUNCTION__, On ? "on" : "off" );
+
+        if ( On )
+            LZSS_Init( &CompressContext, LZSSDict_ToHost, LZSSDict_ToHostLen );
+
+        HostCompresses = On;
+    }
+#endif
+
+    CompressionAckPending = 1;
+}
+
+/*
+ * The link has been resynced (framing switch, ARQ on, off or resynced), the host
+ * may have restarted and lost track, so stop compressing until it asks again.
+ */
+static void SLIP_ResetCompression( void ) {
+#if defined ( SLIP_COMPRESSION_ENABLED )
+    if ( HostCompresses ) {
+        CompressionResets++;
+        SLIP_SetCompression( 0 );
+    }
+#endif
+}
+
+/*
+ * A packet as the host sent it, still compressed if it was.
+ */
+static void SLIP_OnPayload( const uint8_t* Packet, int Length ) {
+    if ( ( Packet = SLIP_Expand( Packet, &Length ) ) != NULL && Length > 0 )
+        SLIP_PacketComplete( Packet, Length );
+}
+
+#if defined ( SLIP_ARQ_ENABLED )
+static void SLIP_OnARQPayload( void* User, const uint8_t* Payload, int Length ) {
+    SLIP_OnPayload( Payload, Length );
+}
+#endif
+
+/*
+ * Host asked for a framing switch, the ack goes out in the old framing.
+ */
+static void SLIP_SetFraming( int Requested ) {
+    int Framing = SLIPFraming_SLIP;
+
+    /* Without COBS built in the ack tells the host we're staying on SLIP */
+#if defined ( SLIP_COBS_ENABLED )
+    if ( Requested == SLIPFraming_COBS )
+        Framing = SLIPFraming_COBS;
+#endif
+
+    if ( Framing != RXFraming ) {
+        DebugPrintf( "%s: Host asked for %s framing.\n", __FUNCTION__, Framing == SLIPFraming_COBS ? "COBS" : "SLIP" );
+
+        /* Whatever is left of this read is in the old framing, skip to the first delimiter */
+        SLIPDecoder_Init( &Decoder, PacketBuffer, sizeof( PacketBuffer ) );
+#if defined ( SLIP_COBS_ENABLED )
+        COBSDecoder_Init( &COBSFrameDecoder, PacketBuffer, sizeof( PacketBuffer ) );
+#endif
+
+        RXFraming = Framing;
+        FramingSwitches++;
+
+        SLIP_ResetCompression( );
+    }
+
+    FramingAckPending = 1;
+}
+
+/*
+ * The host has stopped using ARQ, everything from here on goes out unwrapped.
+ */
+static void SLIP_StopARQ( void ) {
+#if defined ( SLIP_ARQ_ENABLED )
+    if ( HostUsesARQ ) {
+        DebugPrintf( "%s: Host has dropped ARQ, ARQ off.\n", __FUNCTION__ );
+
+        HostUsesARQ = 0;
+        ARQFallbacks++;
+
+        SLIP_ResetCompression( );
+    }
+#endif
+}
+
+/*
+ * A management frame from the host.
+ */
+static void SLIP_OnManagement( const uint8_t* Frame, int Length ) {
+    if ( Length < 3 )
+        return;
+
+    switch ( Frame[ 1 ] ) {
+        case SLIPMgmt_SetFraming: SLIP_SetFraming( Frame[ 2 ] ); break;
+        case SLIPMgmt_SetCompression: SLIP_SetCompression( Frame[ 2 ] ? 1 : 0 ); break;
+        case SLIPMgmt_SetARQ: {
+            /* ARQ only starts with an ARQ frame, this can just turn it off */
+            if ( Frame[ 2 ] == 0 )
+                SLIP_StopARQ( );
+
+            ARQAckPending = 1;
+            break;
+        }
+        default: break;
+    };
+}
+
+/*
+ * A complete frame off the wire, unwrapped by the ARQ layer if the host uses it.
+ */
+static void SLIP_OnFrame( const uint8_t* Frame, int Length ) {
+#if defined ( SLIP_ARQ_ENABLED )
+    int Reason = 0;
+#endif
+
+    /* Management frames are never wrapped, and don't mean the host has given up on ARQ */
+    if ( Frame[ 0 ] == SLIPManagementMarker ) {
+        SLIP_OnManagement( Frame, Length );
+        return;
+    }
+
+#if defined ( SLIP_ARQ_ENABLED )
+    uint32_t Resyncs = ARQ.Resyncs;
+
+    if ( ARQ_IsFrame( Frame, Length ) ) {
+        if ( ARQReady == 0 ) {
+            ARQ_Init( &ARQ, SLIPBaudRate );
+            ARQReady = 1;
+            Resyncs = 0;
+        }
+
+        if ( ARQ_Receive( &ARQ, Frame, Length, SLIP_OnARQPayload, NULL ) < 0 )
+            return;
+
+        /* The host speaks ARQ, start wrapping what we send */
+        if ( HostUsesARQ == 0 ) {
+            DebugPrintf( "%s: Host sent an ARQ frame, using ARQ from now on.\n", __FUNCTION__ );
+
+            HostUsesARQ = 1;
+            SLIP_ResetCompression( );
+        } else if ( ARQ.Resyncs != Resyncs ) {
+            SLIP_ResetCompression( );
+        }
+
+        return;
+    }
+
+    if ( HostUsesARQ ) {
+        /* Only plain IPv4 means the host has dropped ARQ, anything else is most likely an ARQ frame with a damaged marker */
+        if ( IPv4IngressValidation::Check( Frame, Length, &Reason ) == 0 ) {
+            ARQ.CRCErrors++;
+            return;
+        }
+
+        SLIP_StopARQ( );
+    }
+#endif
+
+    SLIP_OnPayload( Frame, Length );
 }
 
 #if 0
@@ -61,234 +391,252 @@ int CopyByteToPacketBuffer( uint8_t Data ) {
 }
 #endif
 
-int UnSLIP( const uint8_t* Src, uint8_t* Dest, int Size ) {
-    int OutSize = 0;
-    uint8_t T1 = 0;
-    uint8_t T2 = 0;    
-    int i = 0;
+/*
+ * Runs Data through the decoder for the framing in use, see SLIPDecoder_Feed.
+ */
+static int FASTPATH SLIP_Decode( const uint8_t* Data, int Length, int* FrameLength ) {
+#if defined ( SLIP_COBS_ENABLED )
+    if ( RXFraming == SLIPFraming_COBS )
+        return COBSDecoder_Feed( &COBSFrameDecoder, Data, Length, FrameLength );
+#endif
 
-    for ( i = 0; i < Size; ) {
-        T1 = Src[ i ];
-        T2 = Src[ i + 1 ];
+    return SLIPDecoder_Feed( &Decoder, Data, Length, FrameLength );
+}
 
-        if ( T1 == 219 && T2 == 220 ) {
-            Dest[ OutSize++ ] = 192;
-            i+= 2;
-        } else {
-            Dest[ OutSize++ ] = T1;
-            i++;
-        }
-    }
+/*
+ * Encodes a frame for the wire in the framing in use, returns the encoded length.
+ */
+static int FASTPATH SLIP_Encode( const uint8_t* Packet, int Length, uint8_t* Dest, int MaxDestLen ) {
+#if defined ( SLIP_COBS_ENABLED )
+    if ( TXFraming == SLIPFraming_COBS )
+        return COBS_Encode( Packet, Length, Dest, MaxDestLen );
+#endif
 
-    return OutSize;
+    return SLIP( Packet, Length, Dest, MaxDestLen );
 }
 
-static uint8_t LeftoverBuffer[ 512 ];
-static int LeftoverBytes = 0;
+/*
+ * Runs the bytes waiting in the transport through the frame decoder, stopping
+ * as soon as a frame is complete. Never waits for more bytes to arrive.
+ * Returns the decoded length of a complete frame, 0 otherwise.
+ */
+static int FASTPATH SLIP_ReadFrame( void ) {
+    int Length = 0;
+    int Used = 0;
+
+    while ( 1 ) {
+        if ( RXChunkOffset >= RXChunkLength ) {
+            if ( ( RXChunkLength = SLIPLink->Read( RXChunk, sizeof( RXChunk ) ) ) <= 0 )
+                return 0;
 
-int AvailableWrapper( void ) { 
-    return LeftoverBytes ? LeftoverBytes : Serial.available( );
-}
+            RXChunkOffset = 0;
+            SLIPBytesReceived+= RXChunkLength;
 
-int ReadBytesWrapper( uint8_t* Buffer, int Length ) {
-    int BytesRead = 0;
-    int Count = 0;    
+            if ( Decoder.Length == 0 )
+                PacketStartTime = millis( );
+        }
 
-    if ( LeftoverBytes > 0 ) {
-        /*
-         * If there are even more bytes left over after this move 
-         * them to the front of the Leftover buffer and adjust
-         * the remaining byte count accordingly. 
-         */
-        if ( LeftoverBytes > Length ) {
-            Count = LeftoverBytes - Length;
+        Used = SLIP_Decode( &RXChunk[ RXChunkOffset ], RXChunkLength - RXChunkOffset, &Length );
+        RXChunkOffset+= Used;
 
-            memcpy( Buffer, LeftoverBuffer, Length );
-            memmove( LeftoverBuffer, &LeftoverBuffer[ Length ], Count );
+        if ( Length > 0 ) {
+            PacketEndTime = millis( );
+            DebugPrintf( "SLIP: %s Read %d bytes in %dms.\n", SLIPLink->Name, Length, ( int ) ( PacketEndTime - PacketStartTime ) );
 
-            LeftoverBytes-= Count;
-            BytesRead = Length;
-        } else {
-            /* 
-             * There are less than or equal to the number of bytes requested in 
-             * the Leftover buffer, copy in what we have. 
-             */
-             memcpy( Buffer, LeftoverBuffer, LeftoverBytes );
-             
-             BytesRead = LeftoverBytes;
-             LeftoverBytes = 0;
+            return Length;
         }
-    } else {
-        BytesRead = Serial.readBytes( Buffer, Length );
     }
-
-    return BytesRead;
 }
 
-int SLIP_ReadUntilEND( uint8_t* Buffer, int BufferMaxLen ) {
-    uint8_t RXBuffer[ 256 ];
-    uint8_t Data = 0;
-    int IsInSLIPStream = 0;
-    int BytesAvailable = 0;
-    int SLIPLength = 0;
-    int BytesRead = 0;
-    int i = 0;
-
-    IsInSLIPStream = 1;
-
-    while ( IsInSLIPStream == 1 ) {
-        BytesRead = Serial.readBytes( &Data, 1 );
-
-        if ( BytesRead == 1 ) {
-            if ( Data == SLIP_END ) {
-                PacketEndTime = millis( );
-                IsInSLIPStream = 0;
-
-                if ( SLIPLength > 0 )
-                    DebugPrintf( "SLIP: UART Read %d bytes in %dms.\n", SLIPLength, ( int ) ( PacketEndTime - PacketStartTime ) );
-            } else {
-                Buffer[ SLIPLength++ ] = Data;
-            }
-        }
+/*
+ * Called every "frame" or run through the main loop. 
+ */
+void SLIP_Tick( void ) {
+    int PacketLength = 0;
+
+    SLIP_DrainTXQueue( );
+
+    /* Leave bytes in the transport until there is somewhere to put the packet */
+    if ( Link_IsHoldQueueFull( ) || EtherTX_IsBackedUp( ) ) {
+        SLIPLink->SetReady( 0 );
+        return;
     }
 
+    SLIPLink->SetReady( 1 );
+
+    if ( ( PacketLength = SLIP_ReadFrame( ) ) > 0 )
+        SLIP_OnFrame( PacketBuffer, PacketLength );
+}
+
 /*
-    while ( IsInSLIPStream ) {
-        BytesAvailable = AvailableWrapper( );
+ * Builds the next answer to a management frame in ManagementReply, the framing ack always goes first.
+ * Returns its length, 0 if nothing is waiting.
+ */
+static int SLIP_NextManagementReply( void ) {
+    ManagementReply[ 0 ] = SLIPManagementMarker;
 
-        if ( BytesAvailable > 0 ) {
-            BytesRead = ReadBytesWrapper( RXBuffer, BytesAvailable > sizeof( RXBuffer ) ? sizeof( RXBuffer ) : BytesAvailable );
+    if ( FramingAckPending ) {
+        ManagementReply[ 1 ] = SLIPMgmt_FramingAck;
+        ManagementReply[ 2 ] = RXFraming;
+        FramingAckPending = 0;
 
-            for ( i = 0; i < BytesRead; i++ ) {
-                if ( RXBuffer[ i ] == SLIP_END ) {
-                    PacketEndTime = millis( );
-                    IsInSLIPStream = 0;
+        return sizeof( ManagementReply );
+    }
 
-                    DebugPrintf( "SLIP: UART Read %d bytes in %dms.\n", SLIPLength, ( int ) ( PacketEndTime - PacketStartTime ) );
-                    break;
-                }
+    if ( CompressionAckPending ) {
+        ManagementReply[ 1 ] = SLIPMgmt_CompressionAck;
+#if defined ( SLIP_COMPRESSION_ENABLED )
+        ManagementReply[ 2 ] = HostCompresses;
+#else
+        ManagementReply[ 2 ] = 0;
+#endif
+        CompressionAckPending = 0;
 
-                if ( ( SLIPLength + 1 ) < BufferMaxLen )
-                    Buffer[ SLIPLength++ ] = RXBuffer[ i ];
-            }
+        return sizeof( ManagementReply );
+    }
 
-            if ( i < BytesRead ) {
-                memcpy( LeftoverBuffer, &RXBuffer[ i ], ( BytesRead - i ) );
-                LeftoverBytes = ( BytesRead - i );
-            }
-        }
+    if ( ARQAckPending ) {
+        ManagementReply[ 1 ] = SLIPMgmt_ARQAck;
+#if defined ( SLIP_ARQ_ENABLED )
+        ManagementReply[ 2 ] = HostUsesARQ;
+#else
+        ManagementReply[ 2 ] = 0;
+#endif
+        ARQAckPending = 0;
+
+        return sizeof( ManagementReply );
     }
-*/
 
-    return SLIPLength;
+    return 0;
 }
 
 /*
- * Called every "frame" or run through the main loop. 
+ * Picks what goes out next: a management reply, an ARQ retransmit, then queued traffic, then a bare ARQ ack.
+ * Returns the length of the frame at *Frame, 0 if there's nothing to send.
  */
-void SLIP_Tick( void ) {
-    int SLIPLength = 0;
-    int PacketLength = 0;
-    uint8_t Data = 0;
+static int SLIP_NextFrame( const uint8_t** Frame ) {
+    struct TXQueueEntry* Entry = NULL;
+    int Length = 0;
+
+#if defined ( SLIP_ARQ_ENABLED )
+    uint32_t Now = millis( );
+#endif
 
-    if ( Serial.readBytes( &Data, 1 ) == 1 && Data == SLIP_END ) {
-        PacketStartTime = millis( );
-        SLIPLength = SLIP_ReadUntilEND( SLIPBuffer, sizeof( SLIPBuffer ) );
+    if ( ( Length = SLIP_NextManagementReply( ) ) > 0 ) {
+        *Frame = ManagementReply;
+        return Length;
+    }
 
-        if ( SLIPLength > 0 ) {
-            PacketLength = UnSLIP( SLIPBuffer, PacketBuffer, SLIPLength );
+#if defined ( SLIP_ARQ_ENABLED )
+    if ( HostUsesARQ ) {
+        *Frame = ARQFrameBuffer;
 
-            if ( PacketLength > 0 )
-                SLIP_PacketComplete( PacketBuffer, SLIPLength );
+        if ( ( Length = ARQ_Retransmit( &ARQ, Now, ARQFrameBuffer, sizeof( ARQFrameBuffer ) ) ) > 0 )
+            return Length;
 
-            SLIPLength = 0;
-        }
+        /* Window is full, leave the traffic in the queue where CoDel can see it */
+        if ( ARQ_CanSend( &ARQ ) == 0 )
+            return ARQ_Ack( &ARQ, ARQFrameBuffer, sizeof( ARQFrameBuffer ) );
     }
+#endif
 
-/*
-    if ( IsTXPacketQueued ) {
-        SLIP_WritePacket( ( const uint8_t* ) TXPacketBuffer, TXPacketLength );
+    if ( ( Entry = TXQueue_Dequeue( ) ) != NULL ) {
+        Length = Entry->Length;
+        *Frame = SLIP_Compress( Entry->Buffer, &Length );
+
+#if defined ( SLIP_ARQ_ENABLED )
+        if ( HostUsesARQ ) {
+            Length = ARQ_Send( &ARQ, Now, *Frame, Length, ARQFrameBuffer, sizeof( ARQFrameBuffer ) );
+            *Frame = ARQFrameBuffer;
+        }
+#endif
+
+        return Length;
+    }
 
-        TXPacketLength = 0;
-        IsTXPacketQueued = 0;
+#if defined ( SLIP_ARQ_ENABLED )
+    if ( HostUsesARQ ) {
+        *Frame = ARQFrameBuffer;
+        return ARQ_Ack( &ARQ, ARQFrameBuffer, sizeof( ARQFrameBuffer ) );
     }
-*/
+#endif
+
+    return 0;
 }
 
-int SLIP_QueuePacketForWrite( const uint8_t* Buffer, int Length ) {
-    const uint8_t* Ptr = Buffer;
-    int Len = Length;
+/*
+ * Writes as much of the queued traffic as the transport will take right now.
+ */
+void FASTPATH SLIP_DrainTXQueue( void ) {
+    const uint8_t* Packet = NULL;
+    int Length = 0;
+    int Written = 0;
 
-    if ( IsTXPacketQueued ) {
-        DebugPrintf( "%s: TX Buffer busy, dropping packet.\n", __FUNCTION__ );
-        TXBytesDropped+= Len;
+    if ( SLIPLink->IsPeerReady( ) == 0 )
+        return;
 
-        return 0;
-    }
+    if ( TXFrameOffset >= TXFrameLength ) {
+        if ( ( Length = SLIP_NextFrame( &Packet ) ) <= 0 )
+            return;
 
-    //DebugPrintf( "%s: %d bytes queued for write.\n", __FUNCTION__, Length );
-    memcpy( TXPacketBuffer, Ptr, Len );
-    
-    TXPacketLength = Len;
-    IsTXPacketQueued = 1;
+        TXFrameLength = SLIP_Encode( Packet, Length, TXFrameBuffer, sizeof( TXFrameBuffer ) );
+        TXFrameOffset = 0;
 
-    return 1;
+        /* A framing ack has just been encoded in the old framing, everything after it uses the new one */
+        TXFraming = RXFraming;
+    }
+
+    if ( ( Written = SLIPLink->Write( &TXFrameBuffer[ TXFrameOffset ], TXFrameLength - TXFrameOffset ) ) > 0 ) {
+        TXFrameOffset+= Written;
+        TXBytesSent+= Written;
+    }
 }
 
-int SLIP( const uint8_t* Src, int SrcLen, uint8_t* Dest, int MaxDestLen ) {
-    int OutLength = 0;
-    int i = 0;
+/*
+ * Writes the SLIP link counters to the debug console.
+ */
+void SLIP_DumpStats( void ) {
+    DebugPrintf( "%s: %s / Frames %u / Overruns %u / Framing errors %u\n", __FUNCTION__, SLIPLink->Name, Decoder.FramesReceived, Decoder.FrameOverruns, Decoder.FramingErrors );
+    SLIPLink->DumpStats( );
+
+#if defined ( SLIP_COBS_ENABLED )
+    DebugPrintf( "%s: Framing RX/TX [%s,%s] / Switches %u / COBS frames %u / Overruns %u / Framing errors %u\n", __FUNCTION__,
+        RXFraming == SLIPFraming_COBS ? "COBS" : "SLIP", TXFraming == SLIPFraming_COBS ? "COBS" : "SLIP", FramingSwitches,
+        COBSFrameDecoder.FramesReceived, COBSFrameDecoder.FrameOverruns, COBSFrameDecoder.FramingErrors );
+#endif
 
-    Dest[ OutLength++ ] = SLIP_END;
+#if defined ( SLIP_COMPRESSION_ENABLED )
+    DebugPrintf( "%s: Compression %s / RX frames %u, %u -> %u bytes / TX frames %u, %u -> %u bytes / Expand errors %u / Resets %u\n", __FUNCTION__, HostCompresses ? "on" : "waiting for host",
+        CompressedRX, RXBytesOnWire, RXBytesExpanded, CompressedTX, TXBytesUncompressed, TXBytesOnWire, ExpandErrors, CompressionResets );
+#endif
 
-    for ( i = 0; i < SrcLen && i < MaxDestLen; i++ ) {
-        if ( Src[ i ] == SLIP_END ) {
-            Dest[ OutLength++ ] = 219;
-            Dest[ OutLength++ ] = 220;
-        } else {
-            Dest[ OutLength++ ] = Src[ i ];
-        }
-    }
+#if defined ( SLIP_ARQ_ENABLED )
+    DebugPrintf( "%s: ARQ %s / TX frames %u, retransmits %u (fast %u), given up %u / RX delivered %u, CRC errors %u, out of order %u, duplicates %u, skipped %u / Resyncs %u / Fallbacks %u\n", __FUNCTION__,
+        HostUsesARQ ? "on" : "waiting for host", ARQ.FramesSent, ARQ.Retransmits, ARQ.FastRetransmits, ARQ.GiveUps,
+        ARQ.FramesDelivered, ARQ.CRCErrors, ARQ.OutOfOrder, ARQ.Duplicates, ARQ.Skipped, ARQ.Resyncs, ARQFallbacks );
+#endif
+}
 
-    Dest[ OutLength++ ] = SLIP_END;
-    return OutLength;
+int SLIP_QueuePacketForWrite( const uint8_t* Buffer, int Length ) {
+    return TXQueue_Enqueue( Buffer, Length );
 }
 
+/*
+ * Queues the packet and pushes it out right away instead of waiting for the next SLIP_Tick.
+ * It goes through the same path as queued traffic, so it never cuts into a frame that is
+ * part written and gets the same framing, compression and ARQ. Whatever the transport
+ * won't take now stays queued. Returns 0 if the queue had no room for it.
+ */
 int SLIP_WritePacket( const uint8_t* Buffer, int Length ) {
-    static uint8_t OutBuffer[ 2048 ];
-    uint8_t* BufPtr = OutBuffer;
-    int BytesSLIPPED = 0;
-    int BytesWritten = 0;
-    int Temp = 0;
-    uint32_t Start = 0;
-    uint32_t End = 0;
-
-    Start = millis( );
-
-    //Serial.flush( );
-
-    if ( ( BytesSLIPPED = SLIP( Buffer, Length, OutBuffer, sizeof( OutBuffer ) ) ) > 0 ) {
-        while ( BytesSLIPPED > 0 ) {
-            /*
-            Temp = Serial.write( BufPtr, BytesSLIPPED >= 64 ? 64 : BytesSLIPPED );
-
-            BytesWritten+= Temp;
-            BytesSLIPPED-= Temp;
-            BufPtr+= Temp;
-            */
-            Serial.write( *BufPtr++ );
-            
-            BytesSLIPPED--;
-            BytesWritten++;
-        }
-    }
+    int Sent = 0;
 
-    //Serial.flush( );
+    if ( TXQueue_Enqueue( Buffer, Length ) == 0 )
+        return 0;
 
-    End = millis( );
-    //DebugPrintf( "%s: Wrote %d bytes in %dms\n", __FUNCTION__, BytesWritten, ( int ) ( End - Start ) );
+    do {
+        Sent = TXBytesSent;
+        SLIP_DrainTXQueue( );
+    } while ( TXBytesSent != Sent );
 
-    TXBytesSent+= BytesWritten;
-    return BytesWritten;
+    return 1;
 }
-
@@ -1,12 +1,75 @@
 #ifndef _SLIP_H_
 #define _SLIP_H_
 
+#include "slipcodec.h"
+#include "cobs.h"
+
 // From RFC 1055
 #define SLIPMaxPacketLen 1006
 
-#define SLIP_END 0xC0
-#define SLIP_ESC 0xDB
-#define SLIP_REPLACE 0xDC
+#define SLIPBaudRate 115200
+
+/*
+ * Per packet LZSS compression of the serial link (see lzss.h).
+ * Compressed frames from the host are always expanded, but we only compress
+ * what we send once the host has asked for it with a management frame
+ * (tools/slipz does), so a host without it keeps working as before.
+ * It goes back off when the framing switches or ARQ starts, stops or
+ * resyncs, and the host has to ask again.
+ */
+// #define SLIP_COMPRESSION_ENABLED
+
+/*
+ * First byte of a compressed frame. IPv4 packets always start with 0x4X
+ * so there's no confusing the two.
+ */
+#define SLIPCompressedMarker 0x50
+
+/*
+ * Selective repeat ARQ on the serial link (see arq.h), for long or noisy
+ * runs where a damaged frame would otherwise cost an end to end TCP
+ * retransmission. It only starts once the host has sent us a good ARQ
+ * frame (tools/slipz -a). It is turned off again by a management frame
+ * or a plain frame that is valid IPv4, anything else (an ARQ frame with
+ * a damaged marker) only counts as a CRC error.
+ * Costs about 12KB of RAM for the two windows.
+ */
+// #define SLIP_ARQ_ENABLED
+
+/*
+ * COBS framing (see cobs.h) as an alternative to SLIP escaping, so binary
+ * traffic full of 0xC0/0xDB bytes costs the same wire time as text.
+ * SLIPDefaultFraming is what we boot with, the host can switch us over
+ * with a management frame (tools/slipz -c) and the switch is acked in
+ * the old framing before anything goes out in the new one.
+ */
+// #define SLIP_COBS_ENABLED
+
+#define SLIPFraming_SLIP 0
+#define SLIPFraming_COBS 1
+
+#define SLIPDefaultFraming SLIPFraming_SLIP
+
+/*
+ * First byte of a management frame from or to the host, never compressed
+ * or wrapped by ARQ: Marker | Command | Value.
+ */
+#define SLIPManagementMarker 0x52
+
+/* Host asks for framing (Value), we answer with the framing now in use */
+#define SLIPMgmt_SetFraming 0x01
+#define SLIPMgmt_FramingAck 0x81
+
+/*
+ * Host asks us to compress (Value 1) or not, we answer with whether we do.
+ * We also send an unasked ack with Value 0 when compression is reset.
+ */
+#define SLIPMgmt_SetCompression 0x02
+#define SLIPMgmt_CompressionAck 0x82
+
+/* Host tells us it isn't using ARQ (Value 0), we answer with whether we still are */
+#define SLIPMgmt_SetARQ 0x03
+#define SLIPMgmt_ARQAck 0x83
 
 typedef void ( SLIPCompleteCB ) ( uint8_t* Packet, int Length );
 typedef void ( WriteByteFn ) ( uint8_t Data );
@@ -20,7 +83,23 @@ void SLIP_WritePacket_Blocking( WriteByteFn WriteByte, uint8_t* Packet, int Leng
  */
 void SLIP_Tick( void );
 
+/*
+ * Queues the packet and pushes it out right away instead of waiting for the next SLIP_Tick.
+ * It goes through the same path as queued traffic, so it never cuts into a frame that is
+ * part written and gets the same framing, compression and ARQ. Whatever the transport
+ * won't take now stays queued. Returns 0 if the queue had no room for it.
+ */
 int SLIP_WritePacket( const uint8_t* Buffer, int Length );
 int SLIP_QueuePacketForWrite( const uint8_t* Buffer, int Length );
 
+/*
+ * Writes the SLIP link counters to the debug console.
+ */
+void SLIP_DumpStats( void );
+
+/*
+ * Writes as much of the queued traffic as the transport will take right now.
+ */
+void SLIP_DrainTXQueue( void );
+
 #endif
@@ -0,0 +1,135 @@
+#include <string.h>
+#include "slipcodec.h"
+#include "hotpath.h"
+
+/*
+ * Sets up a decoder writing frames of up to MaxLength bytes into Buffer.
+ */
+void SLIPDecoder_Init( struct SLIPDecoder* Decoder, uint8_t* Buffer, int MaxLength ) {
+    memset( Decoder, 0, sizeof( struct SLIPDecoder ) );
+
+    Decoder->Buffer = Buffer;
+    Decoder->MaxLength = MaxLength;
+    Decoder->IsDiscarding = 1;
+}
+
+/*
+ * Decodes Data, stopping as soon as a frame is complete.
+ * Returns how many bytes were used, *FrameLength is set to the length of
+ * the frame in Buffer if one completed, 0 otherwise. The frame stays in
+ * Buffer until the next call.
+ */
+int FASTPATH SLIPDecoder_Feed( struct SLIPDecoder* Decoder, const uint8_t* Data, int Length, int* FrameLength ) {
+    uint8_t Byte = 0;
+    int Complete = 0;
+    int i = 0;
+
+    *FrameLength = 0;
+
+    for ( i = 0; i < Length; i++ ) {
+        Byte = Data[ i ];
+
+        if ( Byte == SLIP_END ) {
+            Complete = Decoder->IsDiscarding ? 0 : Decoder->Length;
+
+            Decoder->Length = 0;
+            Decoder->IsInESC = 0;
+            Decoder->IsDiscarding = 0;
+
+            /* Back to back ENDs are just the start of the next frame */
+            if ( Complete > 0 ) {
+                Decoder->FramesReceived++;
+
+                *FrameLength = Complete;
+                return i + 1;
+            }
+
+            continue;
+        }
+
+        if ( Decoder->IsDiscarding )
+            continue;
+
+        if ( Decoder->IsInESC ) {
+            Decoder->IsInESC = 0;
+
+            if ( Byte == SLIP_REPLACE ) {
+                Byte = SLIP_END;
+            } else if ( Byte == SLIP_ESC_REPLACE ) {
+                Byte = SLIP_ESC;
+            } else {
+                Decoder->FramingErrors++;
+                Decoder->IsDiscarding = 1;
+                continue;
+            }
+        } else if ( Byte == SLIP_ESC ) {
+            Decoder->IsInESC = 1;
+            continue;
+        }
+
+        if ( Decoder->Length >= Decoder->MaxLength ) {
+            Decoder->FrameOverruns++;
+            Decoder->IsDiscarding = 1;
+            continue;
+        }
+
+        Decoder->Buffer[ Decoder->Length++ ] = Byte;
+    }
+
+    return Length;
+}
+
+/*
+ * SLIP encodes Src into Dest, including the leading and trailing END bytes.
+ * Returns the encoded length.
+ */
+int FASTPATH SLIP( const uint8_t* Src, int SrcLen, uint8_t* Dest, int MaxDestLen ) {
+    int OutLength = 0;
+    int i = 0;
+
+    Dest[ OutLength++ ] = SLIP_END;
+
+    /* Leave room for an escape pair and the closing END */
+    for ( i = 0; i < SrcLen && ( OutLength + 3 ) <= MaxDestLen; i++ ) {
+        if ( Src[ i ] == SLIP_END ) {
+            Dest[ OutLength++ ] = SLIP_ESC;
+            Dest[ OutLength++ ] = SLIP_REPLACE;
+        } else if ( Src[ i ] == SLIP_ESC ) {
+            Dest[ OutLength++ ] = SLIP_ESC;
+            Dest[ OutLength++ ] = SLIP_ESC_REPLACE;
+        } else {
+            Dest[ OutLength++ ] = Src[ i ];
+        }
+    }
+
+    Dest[ OutLength++ ] = SLIP_END;
+    return OutLength;
+}
+
+/*
+ * Decodes SLIP escapes in Src into Dest, returns the decoded length.
+ */
+int FASTPATH UnSLIP( const uint8_t* Src, uint8_t* Dest, int Size ) {
+    int OutSize = 0;
+    uint8_t T1 = 0;
+    uint8_t T2 = 0;
+    int i = 0;
+
+    for ( i = 0; i < Size; ) {
+        T1 = Src[ i ];
+        T2 = ( i + 1 ) < Size ? Src[ i + 1 ] : 0;
+
+        if ( T1 == SLIP_ESC && T2 == SLIP_REPLACE ) {
+            Dest[ OutSize++ ] = SLIP_END;
+            i+= 2;
+        } else if ( T1 == SLIP_ESC && T2 == SLIP_ESC_REPLACE ) {
+            Dest[ OutSize++ ] = SLIP_ESC;
+            i+= 2;
+        } else {
+            Dest[ OutSize++ ] = T1;
+            i++;
+        }
+    }
+
+    return OutSize;
+}
@@ -0,0 +1,67 @@
+#ifndef _SLIPCODEC_H_
+#define _SLIPCODEC_H_
+
+/*
+ * SLIP encoder and incremental decoder (RFC 1055).
+ * Plain C with no Arduino dependencies so the host side tools build the
+ * exact same file and the framing can be tested off the ESP.
+ */
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SLIP_END 0xC0
+#define SLIP_ESC 0xDB
+#define SLIP_REPLACE 0xDC
+#define SLIP_ESC_REPLACE 0xDD
+
+/*
+ * Frames are decoded straight into Buffer as bytes are fed in.
+ * Anything that would run past the end of it is thrown away up to the next
+ * END, and so is everything before the first END after SLIPDecoder_Init.
+ */
+struct SLIPDecoder {
+    uint8_t* Buffer;
+    int MaxLength;
+
+    int Length;
+    int IsInESC;
+    int IsDiscarding;
+
+    uint32_t FramesReceived;
+    uint32_t FrameOverruns;
+    uint32_t FramingErrors;
+};
+
+/*
+ * Sets up a decoder writing frames of up to MaxLength bytes into Buffer.
+ */
+void SLIPDecoder_Init( struct SLIPDecoder* Decoder, uint8_t* Buffer, int MaxLength );
+
+/*
+ * Decodes Data, stopping as soon as a frame is complete.
+ * Returns how many bytes were used, *FrameLength is set to the length of
+ * the frame in Buffer if one completed, 0 otherwise. The frame stays in
+ * Buffer until the next call.
+ */
+int SLIPDecoder_Feed( struct SLIPDecoder* Decoder, const uint8_t* Data, int Length, int* FrameLength );
+
+/*
+ * SLIP encodes Src into Dest, including the leading and trailing END bytes.
+ * Returns the encoded length.
+ */
+int SLIP( const uint8_t* Src, int SrcLen, uint8_t* Dest, int MaxDestLen );
+
+/*
+ * Decodes SLIP escapes in Src into Dest, returns the decoded length.
+ */
+int UnSLIP( const uint8_t* Src, uint8_t* Dest, int Size );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
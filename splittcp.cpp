@@ -0,0 +1,621 @@
+#include <ESP8266WiFi.h>
+#include <lwip/netif.h>
+#include <lwip/err.h>
+#include <lwip/tcp.h>
+#include "ether.h"
+#include "ipv4.h"
+#include "util.h"
+#include "slip.h"
+#include "mydebug.h"
+#include "hdrview.h"
+#include "bridge.h"
+#include "splittcp.h"
+
+#if defined ( SPLIT_TCP_ENABLED )
+
+extern "C" {
+#include <lwip/ip.h>
+}
+
+#define IP_PROTO_TCP 0x06
+
+#define TCPOffset_Checksum 16
+#define TCPOffset_Flags 13
+#define TCPFlag_SYN 0x02
+#define TCPFlag_ACK 0x10
+
+struct SplitNATEntry {
+    uint32_t HostIP;
+    uint32_t DestIP;
+    uint16_t HostPort;
+    uint16_t DestPort;
+    uint32_t LastUsed;
+    int Set;
+};
+
+struct SplitConnection {
+    struct tcp_pcb* Down;
+    struct tcp_pcb* Up;
+
+    /* Data received on one side that the other side couldn't take yet */
+    struct pbuf* PendingUp;
+    struct pbuf* PendingDown;
+
+    uint16_t HostPort;
+    int UpConnected;
+
+    /* A side has sent its FIN, and whether it has been passed on to the other side yet */
+    int DownClosed;
+    int UpClosed;
+    int DownFINRelayed;
+    int UpFINRelayed;
+    int Set;
+};
+
+extern netif_linkoutput_fn OriginalLinkoutputFn;
+extern netif_output_fn OriginalOutputFn;
+extern netif_input_fn OriginalInputFn;
+extern struct netif* ESPif;
+
+static const uint16_t ProxiedPorts[ ] = SplitTCPPorts;
+
+static struct netif SLIPif;
+static struct SplitNATEntry NATTable[ SplitTCPMaxConnections * 2 ];
+static struct SplitConnection Connections[ SplitTCPMaxConnections ];
+static uint8_t SplitOutBuffer[ SLIPMaxPacketLen ] __attribute__( ( aligned( 4 ) ) );
+static int IsLinkOutputAllowed = 0;
+
+static uint32_t Accepted = 0;
+static uint32_t Refused = 0;
+static uint32_t UpstreamFailures = 0;
+static uint32_t BytesUp = 0;
+static uint32_t BytesDown = 0;
+
+static err_t SplitTCP_OnDownRecv( void* Arg, struct tcp_pcb* pcb, struct pbuf* p, err_t err );
+static err_t SplitTCP_OnUpRecv( void* Arg, struct tcp_pcb* pcb, struct pbuf* p, err_t err );
+
+static int SplitTCP_IsProxiedPort( uint16_t Port ) {
+    int i = 0;
+
+    for ( i = 0; i < ( int ) ( sizeof( ProxiedPorts ) / sizeof( ProxiedPorts[ 0 ] ) ); i++ ) {
+        if ( ProxiedPorts[ i ] == Port )
+            return 1;
+    }
+
+    return 0;
+}
+
+static struct SplitNATEntry* SplitTCP_FindNAT( uint16_t HostPort ) {
+    int i = 0;
+
+    for ( i = 0; i < ( int ) ( sizeof( NATTable ) / sizeof( NATTable[ 0 ] ) ); i++ ) {
+        if ( NATTable[ i ].Set && NATTable[ i ].HostPort == HostPort )
+            return &NATTable[ i ];
+    }
+
+    return NULL;
+}
+
+static struct SplitNATEntry* SplitTCP_AllocNAT( void ) {
+    struct SplitNATEntry* Oldest = &NATTable[ 0 ];
+    int i = 0;
+
+    for ( i = 0; i < ( int ) ( sizeof( NATTable ) / sizeof( NATTable[ 0 ] ) ); i++ ) {
+        if ( NATTable[ i ].Set == 0 )
+            return &NATTable[ i ];
+
+        if ( ( int32_t ) ( NATTable[ i ].LastUsed - Oldest->LastUsed ) < 0 )
+            Oldest = &NATTable[ i ];
+    }
+
+    return Oldest;
+}
+
+/*
+ * Rewrites the source and destination address of a TCP/IPv4 packet and fixes both checksums.
+ */
+static void SplitTCP_Rewrite( uint8_t* Packet, int HeaderLength, uint32_t NewSource, uint32_t NewDest ) {
+    uint8_t* TCP = &Packet[ HeaderLength ];
+    uint32_t OldSource = UnalignedIPv4View::SourceIP( Packet );
+    uint32_t OldDest = UnalignedIPv4View::DestIP( Packet );
+
+    memcpy( &Packet[ IPv4Offset_SourceIP ], &NewSource, 4 );
+    memcpy( &Packet[ IPv4Offset_DestIP ], &NewDest, 4 );
+
+    /* The TCP checksum covers the addresses through the pseudo header */
+    Checksum_Replace32( &Packet[ IPv4Offset_HeaderChecksum ], OldSource, NewSource );
+    Checksum_Replace32( &Packet[ IPv4Offset_HeaderChecksum ], OldDest, NewDest );
+    Checksum_Replace32( &TCP[ TCPOffset_Checksum ], OldSource, NewSource );
+    Checksum_Replace32( &TCP[ TCPOffset_Checksum ], OldDest, NewDest );
+}
+
+/*
+ * lwIP output for the serial side interface, NATs the reply back so it looks
+ * like it came from the real destination and queues it for the serial host.
+ */
+static err_t SplitTCP_NetifOutput( struct netif* inp, struct pbuf* p, ip_addr_t* ipaddr ) {
+    struct SplitNATEntry* NAT = NULL;
+    int HeaderLength = 0;
+    int Length = p->tot_len;
+
+    if ( Length > ( int ) sizeof( SplitOutBuffer ) || Length < ( int ) sizeof( struct ip_packet ) )
+        return ERR_BUF;
+
+    pbuf_copy_partial( p, SplitOutBuffer, Length, 0 );
+    HeaderLength = SLIPIPv4View::HeaderLength( SplitOutBuffer );
+
+    if ( SLIPIPv4View::Protocol( SplitOutBuffer ) != IP_PROTO_TCP || ( HeaderLength + 20 ) > Length )
+        return ERR_OK;
+
+    if ( ( NAT = SplitTCP_FindNAT( SLIPIPv4View::View::LoadBE16<2>( &SplitOutBuffer[ HeaderLength ] ) ) ) == NULL )
+        return ERR_OK;
+
+    NAT->LastUsed = millis( );
+    SplitTCP_Rewrite( SplitOutBuffer, HeaderLength, NAT->DestIP, NAT->HostIP );
+
+    BridgeQueueing::ToSerial( SplitOutBuffer, Length );
+    return ERR_OK;
+}
+
+static err_t SplitTCP_NetifInit( struct netif* netif ) {
+    netif->name[ 0 ] = 's';
+    netif->name[ 1 ] = 'l';
+    netif->output = SplitTCP_NetifOutput;
+    netif->linkoutput = NULL;
+    netif->mtu = SLIPMaxPacketLen;
+    netif->flags = NETIF_FLAG_LINK_UP;
+
+    return ERR_OK;
+}
+
+static void SplitTCP_FreePending( struct pbuf** Pending ) {
+    if ( *Pending ) {
+        pbuf_free( *Pending );
+        *Pending = NULL;
+    }
+}
+
+/*
+ * Returns 1 if the pcb had to be aborted, it's gone then.
+ */
+static int SplitTCP_ClosePCB( struct tcp_pcb* pcb ) {
+    tcp_arg( pcb, NULL );
+    tcp_recv( pcb, NULL );
+    tcp_sent( pcb, NULL );
+    tcp_err( pcb, NULL );
+
+    if ( tcp_close( pcb ) == ERR_OK )
+        return 0;
+
+    tcp_abort( pcb );
+    return 1;
+}
+
+/*
+ * Tears down both halves of a proxied connection.
+ * Current is the pcb whose callback we're in (or NULL), returns ERR_ABRT if it was aborted
+ * and the callback has to return that so lwIP stops using it.
+ */
+static err_t SplitTCP_Close( struct SplitConnection* Conn, struct tcp_pcb* Current ) {
+    struct SplitNATEntry* NAT = SplitTCP_FindNAT( Conn->HostPort );
+    err_t Result = ERR_OK;
+
+    if ( Conn->Down && SplitTCP_ClosePCB( Conn->Down ) && Conn->Down == Current )
+        Result = ERR_ABRT;
+
+    if ( Conn->Up && SplitTCP_ClosePCB( Conn->Up ) && Conn->Up == Current )
+        Result = ERR_ABRT;
+
+    SplitTCP_FreePending( &Conn->PendingUp );
+    SplitTCP_FreePending( &Conn->PendingDown );
+
+    if ( NAT )
+        NAT->Set = 0;
+
+    memset( Conn, 0, sizeof( struct SplitConnection ) );
+    return Result;
+}
+
+/*
+ * Writes as many whole pbufs from Pending to To as its send buffer has room for,
+ * then opens From's receive window by the same amount. That's what bounds how
+ * much either side can have in flight through us.
+ */
+static int SplitTCP_Relay( struct tcp_pcb* To, struct pbuf** Pending, struct tcp_pcb* From ) {
+    struct pbuf* q = NULL;
+    struct pbuf* Next = NULL;
+    int Written = 0;
+
+    while ( ( q = *Pending ) != NULL && tcp_sndbuf( To ) >= q->len ) {
+        if ( tcp_write( To, q->payload, q->len, TCP_WRITE_FLAG_COPY ) != ERR_OK )
+            break;
+
+        Written+= q->len;
+
+        /* Take the first pbuf off the chain and free it */
+        if ( ( Next = q->next ) != NULL ) {
+            pbuf_ref( Next );
+            pbuf_dechain( q );
+        }
+
+        pbuf_free( q );
+        *Pending = Next;
+    }
+
+    if ( Written ) {
+        tcp_output( To );
+
+        if ( From )
+            tcp_recved( From, Written );
+    }
+
+    return Written;
+}
+
+/*
+ * Moves whatever can be moved in both directions. A FIN is passed on as a half
+ * close once everything sent before it has been, so the other side can still
+ * reply, and the connection is only freed once both sides have closed.
+ * Returns what the callback for Current should return, see SplitTCP_Close.
+ */
+static err_t SplitTCP_Flush( struct SplitConnection* Conn, struct tcp_pcb* Current ) {
+    if ( Conn->UpConnected && Conn->Up && Conn->PendingUp )
+        BytesUp+= SplitTCP_Relay( Conn->Up, &Conn->PendingUp, Conn->Down );
+
+    if ( Conn->Down && Conn->PendingDown )
+        BytesDown+= SplitTCP_Relay( Conn->Down, &Conn->PendingDown, Conn->Up );
+
+    /* If there's no room for the FIN yet it goes on the next flush */
+    if ( Conn->DownClosed && Conn->DownFINRelayed == 0 && Conn->PendingUp == NULL && Conn->UpConnected && Conn->Up ) {
+        if ( tcp_shutdown( Conn->Up, 0, 1 ) == ERR_OK )
+            Conn->DownFINRelayed = 1;
+    }
+
+    if ( Conn->UpClosed && Conn->UpFINRelayed == 0 && Conn->PendingDown == NULL && Conn->Down ) {
+        if ( tcp_shutdown( Conn->Down, 0, 1 ) == ERR_OK )
+            Conn->UpFINRelayed = 1;
+    }
+
+    /* A side that has finished closing is gone and has nothing left to pass on */
+    if ( ( Conn->DownFINRelayed || Conn->Up == NULL ) && ( Conn->UpFINRelayed || Conn->Down == NULL ) && Conn->DownClosed && Conn->UpClosed )
+        return SplitTCP_Close( Conn, Current );
+
+    return ERR_OK;
+}
+
+static void SplitTCP_Append( struct pbuf** Pending, struct pbuf* p ) {
+    if ( *Pending )
+        pbuf_cat( *Pending, p );
+    else
+        *Pending = p;
+}
+
+static err_t SplitTCP_OnDownRecv( void* Arg, struct tcp_pcb* pcb, struct pbuf* p, err_t err ) {
+    struct SplitConnection* Conn = ( struct SplitConnection* ) Arg;
+
+    if ( p == NULL )
+        Conn->DownClosed = 1;
+    else
+        SplitTCP_Append( &Conn->PendingUp, p );
+
+    return SplitTCP_Flush( Conn, pcb );
+}
+
+static err_t SplitTCP_OnUpRecv( void* Arg, struct tcp_pcb* pcb, struct pbuf* p, err_t err ) {
+    struct SplitConnection* Conn = ( struct SplitConnection* ) Arg;
+
+    if ( p == NULL )
+        Conn->UpClosed = 1;
+    else
+        SplitTCP_Append( &Conn->PendingDown, p );
+
+    return SplitTCP_Flush( Conn, pcb );
+}
+
+static err_t SplitTCP_OnSent( void* Arg, struct tcp_pcb* pcb, uint16_t Length ) {
+    return SplitTCP_Flush( ( struct SplitConnection* ) Arg, pcb );
+}
+
+static void SplitTCP_OnDownError( void* Arg, err_t err ) {
+    struct SplitConnection* Conn = ( struct SplitConnection* ) Arg;
+
+    /* lwIP frees the pcb after this */
+    Conn->Down = NULL;
+
+    /* ERR_CLSD is our FIN being acked after the host's, the upstream side may still have data to pass on */
+    if ( err == ERR_CLSD && Conn->DownClosed && Conn->UpFINRelayed )
+        SplitTCP_Flush( Conn, NULL );
+    else
+        SplitTCP_Close( Conn, NULL );
+}
+
+static void SplitTCP_OnUpError( void* Arg, err_t err ) {
+    struct SplitConnection* Conn = ( struct SplitConnection* ) Arg;
+
+    if ( Conn->UpConnected == 0 )
+        UpstreamFailures++;
+
+    Conn->Up = NULL;
+
+    if ( err == ERR_CLSD && Conn->UpClosed && Conn->DownFINRelayed )
+        SplitTCP_Flush( Conn, NULL );
+    else
+        SplitTCP_Close( Conn, NULL );
+}
+
+static err_t SplitTCP_OnUpConnected( void* Arg, struct tcp_pcb* pcb, err_t err ) {
+    struct SplitConnection* Conn = ( struct SplitConnection* ) Arg;
+
+    Conn->UpConnected = 1;
+
+    return SplitTCP_Flush( Conn, pcb );
+}
+
+/*
+ * The serial host connected to us, open the real connection over WiFi.
+ */
+static err_t SplitTCP_OnAccept( void* Arg, struct tcp_pcb* pcb, err_t err ) {
+    struct SplitConnection* Conn = NULL;
+    struct SplitNATEntry* NAT = NULL;
+    ip_addr_t LocalAddr;
+    ip_addr_t DestAddr;
+    int i = 0;
+
+    tcp_accepted( ( struct tcp_pcb* ) Arg );
+
+    for ( i = 0; i < SplitTCPMaxConnections && Conn == NULL; i++ ) {
+        if ( Connections[ i ].Set == 0 )
+            Conn = &Connections[ i ];
+    }
+
+    if ( Conn == NULL || ( NAT = SplitTCP_FindNAT( pcb->remote_port ) ) == NULL || ( Conn->Up = tcp_new( ) ) == NULL ) {
+        Refused++;
+        tcp_abort( pcb );
+
+        return ERR_ABRT;
+    }
+
+    Conn->Set = 1;
+    Conn->Down = pcb;
+    Conn->HostPort = pcb->remote_port;
+
+    tcp_arg( Conn->Down, Conn );
+    tcp_recv( Conn->Down, SplitTCP_OnDownRecv );
+    tcp_sent( Conn->Down, SplitTCP_OnSent );
+    tcp_err( Conn->Down, SplitTCP_OnDownError );
+
+    LocalAddr.addr = OurIPAddress;
+    DestAddr.addr = NAT->DestIP;
+
+    tcp_arg( Conn->Up, Conn );
+    tcp_recv( Conn->Up, SplitTCP_OnUpRecv );
+    tcp_sent( Conn->Up, SplitTCP_OnSent );
+    tcp_err( Conn->Up, SplitTCP_OnUpError );
+
+    tcp_nagle_disable( Conn->Down );
+    tcp_nagle_disable( Conn->Up );
+
+    tcp_bind( Conn->Up, &LocalAddr, 0 );
+    tcp_connect( Conn->Up, &DestAddr, NAT->DestPort, SplitTCP_OnUpConnected );
+
+    Accepted++;
+    return ERR_OK;
+}
+
+/*
+ * Creates the serial side lwIP interface and starts listening on the proxied ports.
+ */
+void SplitTCP_Init( void ) {
+    struct tcp_pcb* Listener = NULL;
+    ip_addr_t Address;
+    ip_addr_t Netmask;
+    ip_addr_t Gateway;
+    int i = 0;
+
+    Address.addr = SplitTCPLocalIP;
+    Netmask.addr = IPAddress( 255, 255, 255, 252 );
+    Gateway.addr = 0;
+
+    netif_add( &SLIPif, &Address, &Netmask, &Gateway, NULL, SplitTCP_NetifInit, ip_input );
+    netif_set_up( &SLIPif );
+
+    for ( i = 0; i < ( int ) ( sizeof( ProxiedPorts ) / sizeof( ProxiedPorts[ 0 ] ) ); i++ ) {
+        if ( ( Listener = tcp_new( ) ) == NULL )
+            break;
+
+        tcp_bind( Listener, &Address, ProxiedPorts[ i ] );
+
+        if ( ( Listener = tcp_listen( Listener ) ) == NULL )
+            break;
+
+        tcp_arg( Listener, Listener );
+        tcp_accept( Listener, SplitTCP_OnAccept );
+    }
+}
+
+/*
+ * Looks at a packet from the serial host, if it belongs to a proxied
+ * connection it is handed to lwIP. Returns 1 if it was consumed.
+ */
+int SplitTCP_OnPacketFromSerial( const uint8_t* Packet, int Length ) {
+    struct SplitNATEntry* NAT = NULL;
+    struct pbuf* p = NULL;
+    const uint8_t* TCP = NULL;
+    uint32_t DestIP = 0;
+    uint16_t HostPort = 0;
+    uint16_t DestPort = 0;
+    uint8_t Flags = 0;
+    int HeaderLength = 0;
+
+    if ( Length < ( int ) sizeof( struct ip_packet ) || SLIPIPv4View::Protocol( Packet ) != IP_PROTO_TCP )
+        return 0;
+
+    HeaderLength = SLIPIPv4View::HeaderLength( Packet );
+
+    if ( ( HeaderLength + 20 ) > Length )
+        return 0;
+
+    TCP = &Packet[ HeaderLength ];
+    HostPort = SLIPIPv4View::View::LoadBE16<0>( TCP );
+    DestPort = SLIPIPv4View::View::LoadBE16<2>( TCP );
+    Flags = TCP[ TCPOffset_Flags ];
+    DestIP = SLIPIPv4View::DestIP( Packet );
+
+    NAT = SplitTCP_FindNAT( HostPort );
+
+    /* A new connection starts with a bare SYN, anything else we don't know about isn't ours */
+    if ( NAT == NULL || NAT->DestIP != DestIP || NAT->DestPort != DestPort ) {
+        if ( ( Flags & ( TCPFlag_SYN | TCPFlag_ACK ) ) != TCPFlag_SYN || SplitTCP_IsProxiedPort( DestPort ) == 0 )
+            return 0;
+
+        NAT = SplitTCP_AllocNAT( );
+
+        NAT->HostIP = SLIPIPv4View::SourceIP( Packet );
+        NAT->DestIP = DestIP;
+        NAT->HostPort = HostPort;
+        NAT->DestPort = DestPort;
+        NAT->Set = 1;
+    }
+
+    NAT->LastUsed = millis( );
+
+    if ( ( p = pbuf_alloc( PBUF_RAW, Length, PBUF_RAM ) ) == NULL )
+        return 1;
+
+    memcpy( p->payload, Packet, Length );
+    SplitTCP_Rewrite( ( uint8_t* ) p->payload, HeaderLength, SplitTCPHostAlias, SplitTCPLocalIP );
+
+    SLIPif.input( p, &SLIPif );
+    return 1;
+}
+
+/*
+ * Returns 1 if the addresses and ports match one of our upstream connections.
+ * The upstream pcbs share OurIPAddress and its port space with the serial host,
+ * so the local port alone could pick up the host's own traffic.
+ */
+static int SplitTCP_IsUpstream( uint32_t RemoteIP, uint16_t RemotePort, uint16_t LocalPort ) {
+    struct tcp_pcb* Up = NULL;
+    int i = 0;
+
+    for ( i = 0; i < SplitTCPMaxConnections; i++ ) {
+        if ( Connections[ i ].Set == 0 || ( Up = Connections[ i ].Up ) == NULL )
+            continue;
+
+        if ( Up->local_port == LocalPort && Up->remote_port == RemotePort && Up->remote_ip.addr == RemoteIP )
+            return 1;
+    }
+
+    return 0;
+}
+
+/*
+ * Hands a copy of an ethernet frame to lwIP's own input function.
+ */
+static void SplitTCP_InputToLWIP( const uint8_t* Frame, int Length ) {
+    struct pbuf* p = NULL;
+
+    if ( ( p = pbuf_alloc( PBUF_RAW, Length, PBUF_RAM ) ) == NULL )
+        return;
+
+    memcpy( p->payload, Frame, Length );
+
+    /* Input can flush packets that were waiting on ARP, let them out */
+    IsLinkOutputAllowed = 1;
+    OriginalInputFn( p, ESPif );
+    IsLinkOutputAllowed = 0;
+}
+
+/*
+ * Looks at a frame from WiFi, if it is for one of our upstream connections
+ * (or an ARP reply lwIP needs) it is handed to lwIP. Returns 1 if it
+ * should not also be forwarded to the serial host.
+ */
+int SplitTCP_OnFrameFromWiFi( const uint8_t* Frame, int Length ) {
+    const uint8_t* IP = &Frame[ sizeof( struct EtherFrame ) ];
+    int HeaderLength = 0;
+
+    switch ( RXEtherView::Type( Frame ) ) {
+        case EtherType_ARP: {
+            /* lwIP never sees ARP otherwise, and our upstream connections need it */
+            if ( Length >= ( int ) ( sizeof( struct EtherFrame ) + sizeof( struct ARPHeader ) ) && ( ( const struct ARPHeader* ) IP )->Operation == htons( 2 ) )
+                SplitTCP_InputToLWIP( Frame, Length );
+
+            return 0;
+        }
+        case EtherType_IPv4: {
+            if ( Length < ( int ) ( sizeof( struct EtherFrame ) + sizeof( struct ip_packet ) ) || RXIPv4View::Protocol( IP ) != IP_PROTO_TCP )
+                return 0;
+
+            HeaderLength = RXIPv4View::HeaderLength( IP );
+
+            if ( ( int ) ( sizeof( struct EtherFrame ) + HeaderLength + 4 ) > Length )
+                return 0;
+
+            if ( RXIPv4View::DestIP( IP ) != ( uint32_t ) OurIPAddress )
+                return 0;
+
+            if ( SplitTCP_IsUpstream( RXIPv4View::SourceIP( IP ), RXIPv4View::View::LoadBE16<0>( &IP[ HeaderLength ] ), RXIPv4View::View::LoadBE16<2>( &IP[ HeaderLength ] ) ) == 0 )
+                return 0;
+
+            SplitTCP_InputToLWIP( Frame, Length );
+            return 1;
+        }
+        default: break;
+    };
+
+    return 0;
+}
+
+/*
+ * Returns 1 if an IP packet lwIP is sending out over WiFi belongs to one of our upstream connections.
+ */
+int SplitTCP_IsProxyOutput( struct pbuf* p ) {
+    const uint8_t* IP = ( const uint8_t* ) p->payload;
+    int HeaderLength = 0;
+
+    if ( p->len < sizeof( struct ip_packet ) || UnalignedIPv4View::Protocol( IP ) != IP_PROTO_TCP )
+        return 0;
+
+    HeaderLength = UnalignedIPv4View::HeaderLength( IP );
+
+    if ( ( HeaderLength + 4 ) > p->len )
+        return 0;
+
+    return SplitTCP_IsUpstream( UnalignedIPv4View::DestIP( IP ), UnalignedIPv4View::View::LoadBE16<2>( &IP[ HeaderLength ] ), UnalignedIPv4View::View::LoadBE16<0>( &IP[ HeaderLength ] ) );
+}
+
+/*
+ * Returns 1 while lwIP is sending on our behalf and link level output should go through.
+ */
+int SplitTCP_IsLinkOutputAllowed( void ) {
+    return IsLinkOutputAllowed;
+}
+
+/*
+ * Calls the original WiFi netif output with link level output let through.
+ */
+err_t SplitTCP_Output( struct netif* inp, struct pbuf* p, ip_addr_t* ipaddr ) {
+    err_t Result = ERR_OK;
+
+    IsLinkOutputAllowed = 1;
+    Result = OriginalOutputFn( inp, p, ipaddr );
+    IsLinkOutputAllowed = 0;
+
+    return Result;
+}
+
+/*
+ * Writes the proxy counters to the debug console.
+ */
+void SplitTCP_DumpStats( void ) {
+    int Active = 0;
+    int i = 0;
+
+    for ( i = 0; i < SplitTCPMaxConnections; i++ )
+        Active+= Connections[ i ].Set;
+
+    DebugPrintf( "%s: Active %d / Accepted/Refused [%u,%u] / Upstream failures %u / Bytes up/down [%u,%u]\n", __FUNCTION__, Active, Accepted, Refused, UpstreamFailures, BytesUp, BytesDown );
+}
+
+#endif
@@ -0,0 +1,81 @@
+#ifndef _SPLITTCP_H_
+#define _SPLITTCP_H_
+
+/*
+ * Split TCP proxy.
+ * TCP connections the serial host opens to one of the SplitTCPPorts are
+ * terminated on the ESP by lwIP, and we open the matching connection to
+ * the real destination over WiFi ourselves. Data is relayed between the two
+ * with bounded buffers, so each side gets its own window and RTT and losses
+ * on WiFi are retransmitted without crossing the UART.
+ *
+ * The host doesn't know any of this is happening. Its packets are NATed onto
+ * a private point to point link (SplitTCPHostAlias -> SplitTCPLocalIP) that
+ * lwIP sees as a second interface, and the replies are NATed back to look
+ * like they came from the original destination.
+ */
+
+// #define SPLIT_TCP_ENABLED
+
+/* Private link addresses lwIP uses on the serial side, never seen outside the ESP */
+#define SplitTCPLocalIP IPAddress( 10, 254, 0, 1 )
+#define SplitTCPHostAlias IPAddress( 10, 254, 0, 2 )
+
+#define SplitTCPMaxConnections 4
+
+/* Destination ports to proxy, everything else is bridged as usual */
+#define SplitTCPPorts { 80, 6667, 21, 23 }
+
+#if defined ( SPLIT_TCP_ENABLED )
+
+/*
+ * Creates the serial side lwIP interface and starts listening on the proxied ports.
+ */
+void SplitTCP_Init( void );
+
+/*
+ * Looks at a packet from the serial host, if it belongs to a proxied
+ * connection it is handed to lwIP. Returns 1 if it was consumed.
+ */
+int SplitTCP_OnPacketFromSerial( const uint8_t* Packet, int Length );
+
+/*
+ * Looks at a frame from WiFi, if it is for one of our upstream connections
+ * (or an ARP reply lwIP needs) it is handed to lwIP. Returns 1 if it
+ * should not also be forwarded to the serial host.
+ */
+int SplitTCP_OnFrameFromWiFi( const uint8_t* Frame, int Length );
+
+/*
+ * Returns 1 if an IP packet lwIP is sending out over WiFi belongs to one of our upstream connections.
+ */
+int SplitTCP_IsProxyOutput( struct pbuf* p );
+
+/*
+ * Returns 1 while lwIP is sending on our behalf and link level output should go through.
+ */
+int SplitTCP_IsLinkOutputAllowed( void );
+
+/*
+ * Calls the original WiFi netif output with link level output let through.
+ */
+err_t SplitTCP_Output( struct netif* inp, struct pbuf* p, ip_addr_t* ipaddr );
+
+/*
+ * Writes the proxy counters to the debug console.
+ */
+void SplitTCP_DumpStats( void );
+
+#else
+
+#define SplitTCP_Init( )
+#define SplitTCP_OnPacketFromSerial( a, b ) 0
+#define SplitTCP_OnFrameFromWiFi( a, b ) 0
+#define SplitTCP_IsProxyOutput( a ) 0
+#define SplitTCP_IsLinkOutputAllowed( ) 0
+#define SplitTCP_Output( a, b, c ) ERR_OK
+#define SplitTCP_DumpStats( )
+
+#endif
+
+#endif
@@ -0,0 +1,136 @@
+#!/usr/bin/env python3
+#
+# Reports how much of the ESP8266's IRAM a SLIP8266 build uses (see hotpath.h).
+#
+# Sums the sections the linker put in the IRAM window, lists the biggest
+# symbols there, and checks every function marked FASTPATH in the sources
+# against the ELF: in IRAM as intended, still in flash (the profile isn't
+# on), or gone because it was inlined into its callers.
+#
+#   ./irammap.py -e SLIP8266.ino.elf
+#   ./irammap.py -e SLIP8266.ino.elf --iram-size 49152 --top 40
+#
+# The IRAM size depends on the core's MMU option, 32KB unless the cache
+# has been cut down to 16KB.
+#
+
+import argparse
+import glob
+import os
+import re
+import subprocess
+import sys
+
+NM = "xtensa-lx106-elf-nm"
+SIZE = "xtensa-lx106-elf-size"
+
+IRAM_START = 0x40100000
+
+FASTPATH_RE = re.compile(r"\bFASTPATH\b[\w\s\*]*?\b(\w+)\s*\(")
+
+
+def in_iram(address, iram_size):
+    return IRAM_START <= address < IRAM_START + iram_size
+
+
+def iram_sections(elf, size_tool, iram_size):
+    """Returns [ (section, size) ] for every section inside the IRAM window."""
+    proc = subprocess.run([size_tool, "-A", "-x", elf], capture_output=True, text=True, check=True)
+    sections = []
+
+    for line in proc.stdout.splitlines():
+        fields = line.split()
+
+        if len(fields) != 3 or not fields[1].startswith("0x"):
+            continue
+
+        size, address = int(fields[1], 16), int(fields[2], 16)
+
+        if size and in_iram(address, iram_size):
+            sections.append((fields[0], size))
+
+    return sections
+
+
+def symbols(elf, nm_tool):
+    """Returns [ (address, size, name) ] for every sized, defined symbol."""
+    proc = subprocess.run([nm_tool, "-S", "-C", "--defined-only", elf], capture_output=True, text=True, check=True)
+    result = []
+
+    for line in proc.stdout.splitlines():
+        fields = line.split(None, 3)
+
+        if len(fields) == 4:
+            result.append((int(fields[0], 16), int(fields[1], 16), fields[3]))
+
+    return result
+
+
+def fastpath_functions(source_dir):
+    """Returns { function: file } for everything marked FASTPATH."""
+    result = {}
+
+    for path in sorted(glob.glob(os.path.join(source_dir, "*.c*")) + glob.glob(os.path.join(source_dir, "*.ino"))):
+        with open(path, errors="replace") as f:
+            for match in FASTPATH_RE.finditer(f.read()):
+                result[match.group(1)] = os.path.basename(path)
+
+    return result
+
+
+def main():
+    parser = argparse.ArgumentParser(description="SLIP8266 IRAM budget report")
+    parser.add_argument("-e", "--elf", required=True, help="firmware ELF from the Arduino build directory")
+    parser.add_argument("--nm", default=NM)
+    parser.add_argument("--size", default=SIZE)
+    parser.add_argument("--iram-size", type=int, default=32768)
+    parser.add_argument("--source", default=os.path.join(os.path.dirname(os.path.abspath(__file__)), ".."), help="sketch directory to look for FASTPATH in")
+    parser.add_argument("--top", type=int, default=25)
+    args = parser.parse_args()
+
+    sections = iram_sections(args.elf, args.size, args.iram_size)
+    used = sum(size for _, size in sections)
+
+    print("IRAM used %d of %d bytes (%.1f%%), %d free" % (used, args.iram_size, 100.0 * used / args.iram_size, args.iram_size - used))
+
+    for name, size in sections:
+        print("  %-24s %6d" % (name, size))
+
+    syms = symbols(args.elf, args.nm)
+    iram_syms = sorted((s for s in syms if in_iram(s[0], args.iram_size)), key=lambda s: -s[1])
+
+    print("\nLargest IRAM symbols:")
+
+    for address, size, name in iram_syms[:args.top]:
+        print("  %08x %6d  %s" % (address, size, name))
+
+    # C++ names come out of nm -C with their argument lists
+    by_name = {}
+
+    for address, size, name in syms:
+        by_name.setdefault(name.split("(")[0], (address, size))
+
+    fastpath = fastpath_functions(args.source)
+    fastpath_bytes = 0
+
+    print("\nFASTPATH functions:")
+
+    for function, path in sorted(fastpath.items(), key=lambda f: (f[1], f[0])):
+        if function not in by_name:
+            where = "inlined"
+            size = 0
+        else:
+            address, size = by_name[function]
+            where = "IRAM" if in_iram(address, args.iram_size) else "flash"
+
+            if where == "IRAM":
+                fastpath_bytes += size
+
+        print("  %-14s %-30s %-8s %6d" % (path, function, where, size))
+
+    print("\n%d bytes of IRAM in FASTPATH functions" % fastpath_bytes)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
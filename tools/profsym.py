@@ -0,0 +1,154 @@
+#!/usr/bin/env python3
+#
+# Symbolizes SLIP8266 profiler samples (see profiler.h) against the firmware ELF.
+#
+# Reads a debug console log (or stdin) and picks out the "PROF" lines, or
+# listens for them on UDP with --udp. Prints a flat profile by function and
+# optionally writes folded stacks for flamegraph.pl. Only the sampled PC is
+# recorded, so a "stack" is the chain of functions inlined at that PC,
+# outermost first, which is still where most of the hot code ends up.
+#
+#   ./profsym.py -e SLIP8266.ino.elf console.log
+#   ./profsym.py -e SLIP8266.ino.elf --udp 7812 --seconds 30 --folded out.folded
+#   flamegraph.pl out.folded > profile.svg
+#
+
+import argparse
+import collections
+import socket
+import subprocess
+import sys
+import time
+
+ADDR2LINE = "xtensa-lx106-elf-addr2line"
+
+
+def parse_line(line, samples, info):
+    fields = line.split()
+
+    if len(fields) < 3 or fields[0] != "PROF":
+        return
+
+    info["hz"] = int(fields[1])
+    info["dropped"] += int(fields[2])
+
+    for pc in fields[3:]:
+        samples[int(pc, 16)] += 1
+
+
+def read_log(paths, samples, info):
+    files = [open(p, errors="replace") for p in paths] if paths else [sys.stdin]
+
+    for f in files:
+        for line in f:
+            # The profiler shares the console with everything else
+            start = line.find("PROF ")
+
+            if start >= 0:
+                parse_line(line[start:], samples, info)
+
+
+def read_udp(port, seconds, samples, info):
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    sock.bind(("", port))
+    sock.settimeout(1.0)
+
+    end = time.time() + seconds
+
+    while time.time() < end:
+        try:
+            data, _ = sock.recvfrom(2048)
+        except socket.timeout:
+            continue
+
+        for line in data.decode("ascii", errors="replace").splitlines():
+            parse_line(line, samples, info)
+
+
+def symbolize(elf, addresses, addr2line):
+    """Returns { pc: [ function, ... ] }, innermost inlined function first."""
+    result = {}
+
+    if not addresses:
+        return result
+
+    proc = subprocess.run([addr2line, "-f", "-i", "-C", "-a", "-e", elf],
+                          input="\n".join("0x%08x" % a for a in addresses) + "\n",
+                          capture_output=True, text=True, check=True)
+
+    current = None
+
+    # -a prints the address first, then (function, file:line) pairs for each inline level
+    lines = proc.stdout.splitlines()
+    i = 0
+
+    while i < len(lines):
+        line = lines[i].strip()
+
+        if line.startswith("0x"):
+            current = int(line, 16)
+            result[current] = []
+            i += 1
+            continue
+
+        if current is not None and line:
+            result[current].append(line if line != "??" else "0x%08x" % current)
+
+        # Skip the file:line that follows every function name
+        i += 2
+
+    return result
+
+
+def main():
+    parser = argparse.ArgumentParser(description="SLIP8266 profile symbolizer")
+    parser.add_argument("-e", "--elf", required=True, help="firmware ELF from the Arduino build directory")
+    parser.add_argument("--addr2line", default=ADDR2LINE)
+    parser.add_argument("--udp", type=int, metavar="PORT", help="collect from UDP instead of a log")
+    parser.add_argument("--seconds", type=int, default=30, help="how long to collect over UDP")
+    parser.add_argument("--folded", metavar="FILE", help="write folded stacks for flamegraph.pl")
+    parser.add_argument("--top", type=int, default=30)
+    parser.add_argument("logs", nargs="*")
+    args = parser.parse_args()
+
+    samples = collections.Counter()
+    info = {"hz": 0, "dropped": 0}
+
+    if args.udp:
+        read_udp(args.udp, args.seconds, samples, info)
+    else:
+        read_log(args.logs, samples, info)
+
+    total = sum(samples.values())
+
+    if total == 0:
+        print("No PROF samples found.")
+        return 1
+
+    symbols = symbolize(args.elf, sorted(samples), args.addr2line)
+    flat = collections.Counter()
+    folded = collections.Counter()
+
+    for pc, count in samples.items():
+        chain = symbols.get(pc) or ["0x%08x" % pc]
+
+        flat[chain[0]] += count
+        folded[";".join(reversed(chain))] += count
+
+    print("%d samples at %dHz (%.1fs), %d dropped" % (total, info["hz"], total / max(info["hz"], 1), info["dropped"]))
+    print("%8s %7s  %s" % ("samples", "%", "function"))
+
+    for name, count in flat.most_common(args.top):
+        print("%8d %6.2f%%  %s" % (count, 100.0 * count / total, name))
+
+    if args.folded:
+        with open(args.folded, "w") as f:
+            for stack, count in sorted(folded.items()):
+                f.write("%s %d\n" % (stack, count))
+
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
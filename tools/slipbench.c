@@ -0,0 +1,258 @@
+/*
+ * slipbench: host side of the SLIP8266 codec benchmarks.
+ *
+ * Times the plain C kernels shared with the firmware (slipcodec.c, cobs.c,
+ * lzss.c, arq.c) over the same packet sizes, escape densities and text
+ * payloads as Bench_Run (see bench.h) does on target. Handy for checking a
+ * change to one of them without flashing anything, the on target figures
+ * are still the ones that count.
+ *
+ * Build: cc -O2 -I.. -o slipbench slipbench.c ../slipcodec.c ../cobs.c ../lzss.c ../arq.c
+ * Use:   ./slipbench [-i iterations]
+ */
+
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include "slipcodec.h"
+#include "cobs.h"
+#include "lzss.h"
+#include "arq.h"
+
+/* Same as SLIPMaxPacketLen and TXQueueMaxPacketLen, those headers need the Arduino core */
+#define MaxPacketLen 1006
+#define MaxBufferLen 1500
+
+#define DefaultIterations 20000
+
+#define ArrayCount( x ) ( int ) ( sizeof( x ) / sizeof( x[ 0 ] ) )
+
+/* Packet sizes: minimum TCP ACK, default IPv4 MSS, full SLIP MTU */
+static const int BenchPacketSizes[ ] = { 40, 576, MaxPacketLen };
+
+/* Percentage of bytes that are SLIP_END/SLIP_ESC and have to be escaped */
+static const int BenchEscapeDensities[ ] = { 0, 1, 10, 50 };
+
+/* Typical payloads for the compression benchmark, the last one is the worst case */
+static const char* const BenchTextPayloads[ ] = {
+    "HTTP/1.1 200 OK\r\nDate: Mon, 19 Oct 2026 10:00:00 GMT\r\nServer: nginx\r\nContent-Type: text/html; charset=UTF-8\r\n"
+    "Content-Length: 1432\r\nConnection: close\r\n\r\n<!DOCTYPE html><html><head><title>Index</title></head><body>",
+    ":nick!~user@host.example.net PRIVMSG #retro :anyone got a spare 3c509 lying around?\r\n"
+    ":other!~them@dialup.example.org PRIVMSG #retro :check the parts bin at the swap meet\r\n",
+    NULL
+};
+
+static uint8_t BenchPacket[ MaxBufferLen ];
+static uint8_t BenchEncoded[ MaxBufferLen * 2 + 2 ];
+static uint8_t BenchDecoded[ MaxBufferLen * 2 ];
+static uint32_t BenchSeed = 1;
+static volatile uint32_t BenchSink = 0;
+
+static struct SLIPDecoder BenchDecoder;
+static struct COBSDecoder BenchCOBSDecoder;
+static struct LZSSContext BenchLZSS;
+
+static int Iterations = DefaultIterations;
+
+static double NowSeconds( void ) {
+    struct timespec Now;
+
+    clock_gettime( CLOCK_MONOTONIC, &Now );
+    return Now.tv_sec + Now.tv_nsec / 1e9;
+}
+
+static uint32_t Bench_Random( void ) {
+    BenchSeed = BenchSeed * 1103515245 + 12345;
+    return BenchSeed >> 8;
+}
+
+/*
+ * Fills the packet buffer with random bytes, EscapePercent of them being
+ * bytes that the SLIP encoder has to escape. Same generator as bench.cpp.
+ */
+static void Bench_FillPacket( int Length, int EscapePercent ) {
+    uint8_t Data = 0;
+    int i = 0;
+
+    for ( i = 0; i < Length; i++ ) {
+        if ( ( int ) ( Bench_Random( ) % 100 ) < EscapePercent ) {
+            Data = ( Bench_Random( ) & 1 ) ? SLIP_END : SLIP_ESC;
+        } else {
+            do {
+                Data = Bench_Random( ) & 0xFF;
+            } while ( Data == SLIP_END || Data == SLIP_ESC );
+        }
+
+        BenchPacket[ i ] = Data;
+    }
+}
+
+/*
+ * Prints nanoseconds per byte and throughput.
+ */
+static void Bench_ReportBytes( const char* Name, int Size, int Escapes, double Seconds ) {
+    double NSPerByte = ( Seconds * 1e9 ) / ( ( double ) Iterations * Size );
+
+    printf( "BENCH: %-10s %4d bytes %2d%% esc %7.3f ns/byte %8.1f MB/s\n", Name, Size, Escapes, NSPerByte, 1000.0 / NSPerByte );
+}
+
+/*
+ * SLIP( ) and UnSLIP( ), the SLIP stream decoder, then COBS, over every size and escape density.
+ */
+static void Bench_SLIPCodec( void ) {
+    double Start = 0;
+    int EncodedLength = 0;
+    int FrameLength = 0;
+    int Size = 0;
+    int Escapes = 0;
+    int s = 0;
+    int e = 0;
+    int i = 0;
+
+    SLIPDecoder_Init( &BenchDecoder, BenchDecoded, sizeof( BenchDecoded ) );
+    COBSDecoder_Init( &BenchCOBSDecoder, BenchDecoded, sizeof( BenchDecoded ) );
+
+    for ( s = 0; s < ArrayCount( BenchPacketSizes ); s++ ) {
+        for ( e = 0; e < ArrayCount( BenchEscapeDensities ); e++ ) {
+            Size = BenchPacketSizes[ s ];
+            Escapes = BenchEscapeDensities[ e ];
+
+            Bench_FillPacket( Size, Escapes );
+
+            Start = NowSeconds( );
+
+            for ( i = 0; i < Iterations; i++ )
+                EncodedLength = SLIP( BenchPacket, Size, BenchEncoded, sizeof( BenchEncoded ) );
+
+            Bench_ReportBytes( "SLIP", Size, Escapes, NowSeconds( ) - Start );
+
+            /* UnSLIP( ) takes the frame without the END bytes */
+            Start = NowSeconds( );
+
+            for ( i = 0; i < Iterations; i++ )
+                BenchSink+= UnSLIP( &BenchEncoded[ 1 ], BenchDecoded, EncodedLength - 2 );
+
+            Bench_ReportBytes( "UnSLIP", Size, Escapes, NowSeconds( ) - Start );
+            Start = NowSeconds( );
+
+            for ( i = 0; i < Iterations; i++ ) {
+                SLIPDecoder_Feed( &BenchDecoder, BenchEncoded, EncodedLength, &FrameLength );
+                BenchSink+= FrameLength;
+            }
+
+            Bench_ReportBytes( "SLIPFeed", Size, Escapes, NowSeconds( ) - Start );
+
+            /* Same data through COBS, its cost doesn't depend on how much SLIP would escape */
+            Start = NowSeconds( );
+
+            for ( i = 0; i < Iterations; i++ )
+                EncodedLength = COBS_Encode( BenchPacket, Size, BenchEncoded, sizeof( BenchEncoded ) );
+
+            Bench_ReportBytes( "COBS", Size, Escapes, NowSeconds( ) - Start );
+            Start = NowSeconds( );
+
+            for ( i = 0; i < Iterations; i++ ) {
+                COBSDecoder_Feed( &BenchCOBSDecoder, BenchEncoded, EncodedLength, &FrameLength );
+                BenchSink+= FrameLength;
+            }
+
+            Bench_ReportBytes( "UnCOBS", Size, Escapes, NowSeconds( ) - Start );
+        }
+    }
+}
+
+/*
+ * The ARQ layer's CRC-16 over whole packets.
+ */
+static void Bench_CRC16( void ) {
+    double Start = 0;
+    int s = 0;
+    int i = 0;
+
+    Bench_FillPacket( MaxBufferLen, 0 );
+
+    for ( s = 0; s < ArrayCount( BenchPacketSizes ); s++ ) {
+        Start = NowSeconds( );
+
+        for ( i = 0; i < Iterations; i++ )
+            BenchSink+= ARQ_CRC16( BenchPacket, BenchPacketSizes[ s ] );
+
+        Bench_ReportBytes( "ARQ_CRC16", BenchPacketSizes[ s ], 0, NowSeconds( ) - Start );
+    }
+}
+
+/*
+ * LZSS compress and expand with the ToHost dictionary, same payloads as on target.
+ */
+static void Bench_Compression( void ) {
+    double Start = 0;
+    double CompressNS = 0;
+    double ExpandNS = 0;
+    int CompressedLength = 0;
+    int Length = 0;
+    int p = 0;
+    int i = 0;
+
+    LZSS_Init( &BenchLZSS, LZSSDict_ToHost, LZSSDict_ToHostLen );
+
+    for ( p = 0; p < ArrayCount( BenchTextPayloads ); p++ ) {
+        /* A 40 byte TCP/IP header in front, that part barely compresses */
+        Bench_FillPacket( 40, 0 );
+
+        if ( BenchTextPayloads[ p ] ) {
+            Length = 40 + strlen( BenchTextPayloads[ p ] );
+            memcpy( &BenchPacket[ 40 ], BenchTextPayloads[ p ], Length - 40 );
+        } else {
+            Length = 576;
+            Bench_FillPacket( Length, 0 );
+        }
+
+        Start = NowSeconds( );
+
+        for ( i = 0; i < Iterations; i++ )
+            CompressedLength = LZSS_Compress( &BenchLZSS, BenchPacket, Length, BenchEncoded, sizeof( BenchEncoded ) );
+
+        CompressNS = ( ( NowSeconds( ) - Start ) * 1e9 ) / Iterations;
+        ExpandNS = 0;
+
+        if ( CompressedLength > 0 ) {
+            Start = NowSeconds( );
+
+            for ( i = 0; i < Iterations; i++ )
+                BenchSink+= LZSS_Decompress( LZSSDict_ToHost, LZSSDict_ToHostLen, BenchEncoded, CompressedLength, BenchDecoded, sizeof( BenchDecoded ) );
+
+            ExpandNS = ( ( NowSeconds( ) - Start ) * 1e9 ) / Iterations;
+        }
+
+        printf( "BENCH: LZSS %4d -> %4d bytes, compress/expand %9.1f/%9.1f ns/packet\n", Length, CompressedLength ? CompressedLength + 1 : Length, CompressNS, ExpandNS );
+    }
+}
+
+int main( int Argc, char** Argv ) {
+    int Option = 0;
+
+    while ( ( Option = getopt( Argc, Argv, "i:" ) ) != -1 ) {
+        switch ( Option ) {
+            case 'i': Iterations = atoi( optarg ); break;
+            default: {
+                fprintf( stderr, "Usage: %s [-i iterations]\n", Argv[ 0 ] );
+                return 1;
+            }
+        };
+    }
+
+    if ( Iterations <= 0 )
+        Iterations = DefaultIterations;
+
+    printf( "BENCH: %d iterations per kernel\n", Iterations );
+
+    Bench_SLIPCodec( );
+    Bench_CRC16( );
+    Bench_Compression( );
+
+    return 0;
+}
@@ -0,0 +1,279 @@
+/*
+ * sliploop: runs the SLIP8266 framing code over a host transport.
+ *
+ * Forks into two ends joined by a socketpair, each using FDTransport
+ * (see transport_fd.h) the same way slip.cpp uses SLIPLink: partial
+ * non-blocking writes of SLIP() encoded frames, and reads fed through
+ * SLIPDecoder_Feed. One end sends numbered frames of random length, the
+ * other echoes them back and the first checks what returns.
+ *
+ * -e N flips a bit in roughly one of every N bytes on the way out, to
+ * see the decoder drop damaged frames and pick up at the next END.
+ * -r stops the echo end reading now and then, to exercise SetReady.
+ * -c uses COBS framing (see cobs.h) instead of SLIP.
+ *
+ * Only the plain C parts (slipcodec.c, cobs.c, the transport interface)
+ * run here. The engine in slip.cpp (SLIP_Tick, SLIP_DrainTXQueue and
+ * SLIP_NextFrame, the TX queue, ARQ and compression) needs the Arduino
+ * core and lwIP and is not built on the host, so this measures the codecs
+ * over the stand-in transport, not the firmware's own queueing.
+ *
+ * Build: cc -O2 -I.. -I. -o sliploop sliploop.c transport_fd.c ../slipcodec.c ../cobs.c
+ * Use:   ./sliploop [-n frames] [-s max size] [-e error interval] [-r] [-c]
+ */
+
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include "slipcodec.h"
+#include "cobs.h"
+#include "transport_fd.h"
+
+#define MaxFrameLen 1006
+
+/* Frames start with a 4 byte sequence number, the rest is derived from it */
+#define FrameHeaderLen 4
+
+#define MaxInFlight 2
+
+static int ErrorInterval = 0;
+static int UseHoldOff = 0;
+static int UseCOBS = 0;
+
+static unsigned long BitsFlipped = 0;
+
+static uint8_t RXBuffer[ MaxFrameLen ];
+static struct SLIPDecoder Decoder;
+static struct COBSDecoder FrameDecoderCOBS;
+
+static uint8_t RXChunk[ 64 ];
+static int RXChunkLength = 0;
+static int RXChunkOffset = 0;
+
+static double NowSeconds( void ) {
+    struct timespec Now;
+
+    clock_gettime( CLOCK_MONOTONIC, &Now );
+    return Now.tv_sec + Now.tv_nsec / 1e9;
+}
+
+static int FrameLength( uint32_t Seq, int MaxSize ) {
+    return FrameHeaderLen + ( int ) ( ( Seq * 2654435761u ) % ( uint32_t ) ( MaxSize - FrameHeaderLen + 1 ) );
+}
+
+/*
+ * Fills Frame for Seq, every byte value shows up so there's plenty to escape.
+ */
+static int BuildFrame( uint32_t Seq, int MaxSize, uint8_t* Frame ) {
+    int Length = FrameLength( Seq, MaxSize );
+    int i = 0;
+
+    memcpy( Frame, &Seq, FrameHeaderLen );
+
+    for ( i = FrameHeaderLen; i < Length; i++ )
+        Frame[ i ] = ( uint8_t ) ( ( Seq * 31 ) + ( i * 7 ) );
+
+    return Length;
+}
+
+/*
+ * Encodes Frame and writes it through SLIPLink, waiting for room as needed.
+ */
+static void SendFrame( const uint8_t* Frame, int Length ) {
+    static uint8_t Encoded[ MaxFrameLen * 2 + 2 ];
+    int EncodedLength = UseCOBS ? COBS_Encode( Frame, Length, Encoded, sizeof( Encoded ) ) : SLIP( Frame, Length, Encoded, sizeof( Encoded ) );
+    int Offset = 0;
+    int Written = 0;
+    int i = 0;
+
+    if ( ErrorInterval > 0 ) {
+        for ( i = 0; i < EncodedLength; i++ ) {
+            if ( ( rand( ) % ErrorInterval ) == 0 ) {
+                Encoded[ i ]^= 1 << ( rand( ) & 7 );
+                BitsFlipped++;
+            }
+        }
+    }
+
+    while ( Offset < EncodedLength ) {
+        if ( SLIPLink->IsPeerReady( ) == 0 || ( Written = SLIPLink->Write( &Encoded[ Offset ], EncodedLength - Offset ) ) <= 0 ) {
+            usleep( 100 );
+            continue;
+        }
+
+        Offset+= Written;
+    }
+}
+
+/*
+ * Same shape as SLIP_ReadFrame in slip.cpp.
+ * Returns the length of a complete frame in RXBuffer, 0 otherwise.
+ */
+static int ReadFrame( void ) {
+    int Length = 0;
+
+    while ( 1 ) {
+        if ( RXChunkOffset >= RXChunkLength ) {
+            if ( ( RXChunkLength = SLIPLink->Read( RXChunk, sizeof( RXChunk ) ) ) <= 0 )
+                return 0;
+
+            RXChunkOffset = 0;
+        }
+
+        if ( UseCOBS )
+            RXChunkOffset+= COBSDecoder_Feed( &FrameDecoderCOBS, &RXChunk[ RXChunkOffset ], RXChunkLength - RXChunkOffset, &Length );
+        else
+            RXChunkOffset+= SLIPDecoder_Feed( &Decoder, &RXChunk[ RXChunkOffset ], RXChunkLength - RXChunkOffset, &Length );
+
+        if ( Length > 0 )
+            return Length;
+    }
+}
+
+static void RunEcho( void ) {
+    int Length = 0;
+
+    while ( 1 ) {
+        if ( UseHoldOff )
+            SLIPLink->SetReady( ( rand( ) % 8 ) != 0 );
+
+        if ( ( Length = ReadFrame( ) ) > 0 ) {
+            SendFrame( RXBuffer, Length );
+        } else {
+            usleep( 50 );
+        }
+    }
+}
+
+static int RunSender( int Frames, int MaxSize ) {
+    static uint8_t Frame[ MaxFrameLen ];
+    uint32_t NextToSend = 0;
+    uint32_t Seq = 0;
+    unsigned long Good = 0;
+    unsigned long Bad = 0;
+    unsigned long Bytes = 0;
+    double Start = NowSeconds( );
+    double LastHeard = Start;
+    int InFlight = 0;
+    int Length = 0;
+
+    while ( ( int ) NextToSend < Frames || InFlight > 0 ) {
+        /*
+         * Keep both directions busy, but never with more than the two ends can
+         * buffer between them or each would wait for the other to read.
+         */
+        if ( ( int ) NextToSend < Frames && InFlight < MaxInFlight ) {
+            Length = BuildFrame( NextToSend++, MaxSize, Frame );
+            SendFrame( Frame, Length );
+
+            InFlight++;
+            continue;
+        }
+
+        if ( ( Length = ReadFrame( ) ) == 0 ) {
+            /* Anything lost to -e is never coming back */
+            if ( ( NowSeconds( ) - LastHeard ) > 0.5 ) {
+                Bad+= InFlight;
+                InFlight = 0;
+            }
+
+            usleep( 50 );
+            continue;
+        }
+
+        LastHeard = NowSeconds( );
+        InFlight--;
+
+        memcpy( &Seq, RXBuffer, FrameHeaderLen );
+
+        if ( Length < FrameHeaderLen || Length != FrameLength( Seq, MaxSize ) ) {
+            Bad++;
+            continue;
+        }
+
+        BuildFrame( Seq, MaxSize, Frame );
+
+        if ( memcmp( RXBuffer, Frame, Length ) != 0 ) {
+            Bad++;
+            continue;
+        }
+
+        Bytes+= Length;
+        Good++;
+    }
+
+    printf( "sliploop: %d frames, %lu good, %lu bad or lost, %.1fKB/s echoed, %lu bits flipped\n", Frames, Good, Bad, ( Bytes / 1024.0 ) / ( NowSeconds( ) - Start ), BitsFlipped );
+    if ( UseCOBS )
+        printf( "sliploop: COBS decoder frames %u, overruns %u, framing errors %u\n", FrameDecoderCOBS.FramesReceived, FrameDecoderCOBS.FrameOverruns, FrameDecoderCOBS.FramingErrors );
+    else
+        printf( "sliploop: SLIP decoder frames %u, overruns %u, framing errors %u\n", Decoder.FramesReceived, Decoder.FrameOverruns, Decoder.FramingErrors );
+
+    return ErrorInterval == 0 && Good != ( unsigned long ) Frames;
+}
+
+int main( int Argc, char** Argv ) {
+    int Frames = 10000;
+    int MaxSize = MaxFrameLen;
+    int Pair[ 2 ];
+    int Option = 0;
+    int Result = 0;
+    pid_t Child = 0;
+
+    while ( ( Option = getopt( Argc, Argv, "n:s:e:rc" ) ) != -1 ) {
+        switch ( Option ) {
+            case 'n': Frames = atoi( optarg ); break;
+            case 's': MaxSize = atoi( optarg ); break;
+            case 'e': ErrorInterval = atoi( optarg ); break;
+            case 'r': UseHoldOff = 1; break;
+            case 'c': UseCOBS = 1; break;
+            default:
+                fprintf( stderr, "Usage: %s [-n frames] [-s max size] [-e error interval] [-r] [-c]\n", Argv[ 0 ] );
+                return 1;
+        };
+    }
+
+    if ( MaxSize < FrameHeaderLen || MaxSize > MaxFrameLen ) {
+        fprintf( stderr, "Frame size must be %d to %d\n", FrameHeaderLen, MaxFrameLen );
+        return 1;
+    }
+
+    if ( socketpair( AF_UNIX, SOCK_STREAM, 0, Pair ) < 0 ) {
+        perror( "socketpair" );
+        return 1;
+    }
+
+    SLIPDecoder_Init( &Decoder, RXBuffer, sizeof( RXBuffer ) );
+    COBSDecoder_Init( &FrameDecoderCOBS, RXBuffer, sizeof( RXBuffer ) );
+
+    if ( ( Child = fork( ) ) == 0 ) {
+        close( Pair[ 0 ] );
+        srand( 2 );
+
+        FDTransport_Use( Pair[ 1 ] );
+        SLIPLink->Begin( 0 );
+
+        RunEcho( );
+        return 0;
+    }
+
+    close( Pair[ 1 ] );
+    srand( 1 );
+
+    FDTransport_Use( Pair[ 0 ] );
+    SLIPLink->Begin( 0 );
+
+    Result = RunSender( Frames, MaxSize );
+    SLIPLink->DumpStats( );
+
+    kill( Child, SIGTERM );
+    waitpid( Child, NULL, 0 );
+
+    return Result;
+}
@@ -0,0 +1,570 @@
+/*
+ * slipz: host side of the SLIP8266 serial link compression.
+ *
+ * Sits between the serial port the ESP is on and a pseudo terminal that the
+ * host's SLIP driver is attached to. Frames going to the ESP are compressed
+ * with the FromHost dictionary when that makes them smaller, compressed
+ * frames coming back are expanded before the host sees them.
+ *
+ * Compression is asked for with a management frame every second until the
+ * ESP acks it, and only then do we compress anything (and only what
+ * shrinks). The ESP turns it back off and tells us whenever the link
+ * resyncs, we just ask again. With -n we ask it to stop instead.
+ *
+ * With -a frames in both directions also go through the ARQ layer
+ * (see arq.h), so damaged ones are repeated over the serial link instead of
+ * end to end. The ESP starts using it once it has seen an ARQ frame from
+ * us, we send it an empty one every second until it answers. Without -a we
+ * tell it every second that we don't use ARQ until it acks, in case it is
+ * still using it from before we were restarted.
+ *
+ * -c asks the ESP to switch the serial link to COBS framing (see cobs.h),
+ * -C is for an ESP built to boot in COBS. The host's side of the pty is
+ * always SLIP.
+ *
+ * Build: cc -O2 -I.. -o slipz slipz.c ../lzss.c ../arq.c ../slipcodec.c ../cobs.c
+ * Use:   ./slipz [-a] [-n] [-c|-C] /dev/ttyUSB0 115200
+ *        slattach -p slip -s 115200 <pty printed by slipz>
+ */
+
+#define _DEFAULT_SOURCE
+#define _XOPEN_SOURCE 600
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <sys/select.h>
+#include "lzss.h"
+#include "arq.h"
+#include "slipcodec.h"
+#include "cobs.h"
+
+#define SLIPCompressedMarker 0x50
+
+/* Management frames, see slip.h */
+#define SLIPManagementMarker 0x52
+#define SLIPMgmt_SetFraming 0x01
+#define SLIPMgmt_FramingAck 0x81
+#define SLIPMgmt_SetCompression 0x02
+#define SLIPMgmt_CompressionAck 0x82
+#define SLIPMgmt_SetARQ 0x03
+#define SLIPMgmt_ARQAck 0x83
+
+#define FramingSLIP 0
+#define FramingCOBS 1
+
+#define MaxFrameLen 2048
+
+/* What the ESP can take in one frame (SLIPMaxPacketLen) */
+#define MaxPayloadToESP 1006
+
+/* Frames from the host waiting for room in the ARQ window */
+#define HostQueueLen 32
+
+/* Only hand the serial port another ARQ frame once it has (nearly) sent the last one */
+#define MaxSerialBacklog 64
+
+#define ARQHelloMS 1000
+#define FramingHelloMS 1000
+#define CompressionHelloMS 1000
+#define ARQReportMS 30000
+
+struct FrameReader {
+    uint8_t Buffer[ MaxFrameLen ];
+    int Length;
+    int IsInESC;
+    int Overrun;
+};
+
+struct QueuedFrame {
+    uint8_t Data[ MaxPayloadToESP ];
+    int Length;
+};
+
+static struct LZSSContext CompressContext;
+static int UseCompression = 1;
+static int ESPCompresses = -1;
+
+static struct ARQContext ARQ;
+static int UseARQ = 0;
+static int HeardARQ = 0;
+static int ESPUsesARQ = -1;
+
+/* Framing on the serial port, the pty is always SLIP */
+static int ESPFraming = FramingSLIP;
+static int WantCOBS = 0;
+
+static uint8_t FromESPBuffer[ MaxFrameLen ];
+static struct SLIPDecoder SLIPFromESP;
+static struct COBSDecoder COBSFromESP;
+
+static struct QueuedFrame HostQueue[ HostQueueLen ];
+static int HostQueueHead = 0;
+static int HostQueueCount = 0;
+static unsigned long HostQueueDrops = 0;
+
+static unsigned long FramesCompressed = 0;
+static unsigned long FramesExpanded = 0;
+static unsigned long BytesIn = 0;
+static unsigned long BytesOut = 0;
+static unsigned long LastReported = 0;
+
+static speed_t BaudToSpeed( int Baud ) {
+    switch ( Baud ) {
+        case 9600: return B9600;
+        case 19200: return B19200;
+        case 38400: return B38400;
+        case 57600: return B57600;
+        case 115200: return B115200;
+        case 230400: return B230400;
+        default: break;
+    };
+
+    fprintf( stderr, "Unsupported baud rate %d\n", Baud );
+    exit( 1 );
+}
+
+static uint32_t NowMS( void ) {
+    struct timespec Now;
+
+    clock_gettime( CLOCK_MONOTONIC, &Now );
+    return ( uint32_t ) ( Now.tv_sec * 1000 + Now.tv_nsec / 1000000 );
+}
+
+static void MakeRaw( int fd, int Baud ) {
+    struct termios Attr;
+
+    if ( tcgetattr( fd, &Attr ) < 0 ) {
+        perror( "tcgetattr" );
+        exit( 1 );
+    }
+
+    cfmakeraw( &Attr );
+
+    if ( Baud ) {
+        cfsetispeed( &Attr, BaudToSpeed( Baud ) );
+        cfsetospeed( &Attr, BaudToSpeed( Baud ) );
+    }
+
+    tcsetattr( fd, TCSANOW, &Attr );
+}
+
+static void WriteAll( int fd, const uint8_t* Data, int Length ) {
+    ssize_t Written = 0;
+
+    while ( Length > 0 ) {
+        if ( ( Written = write( fd, Data, Length ) ) < 0 ) {
+            if ( errno == EINTR || errno == EAGAIN )
+                continue;
+
+            perror( "write" );
+            exit( 1 );
+        }
+
+        Data+= Written;
+        Length-= Written;
+    }
+}
+
+static void WriteFrame( int fd, const uint8_t* Data, int Length ) {
+    uint8_t Out[ MaxFrameLen * 2 + 2 ];
+    int OutLength = 0;
+    int i = 0;
+
+    Out[ OutLength++ ] = SLIP_END;
+
+    for ( i = 0; i < Length; i++ ) {
+        if ( Data[ i ] == SLIP_END ) {
+            Out[ OutLength++ ] = SLIP_ESC;
+            Out[ OutLength++ ] = SLIP_REPLACE;
+        } else if ( Data[ i ] == SLIP_ESC ) {
+            Out[ OutLength++ ] = SLIP_ESC;
+            Out[ OutLength++ ] = SLIP_ESC_REPLACE;
+        } else {
+            Out[ OutLength++ ] = Data[ i ];
+        }
+    }
+
+    Out[ OutLength++ ] = SLIP_END;
+    WriteAll( fd, Out, OutLength );
+}
+
+/*
+ * Writes a frame to the ESP in whichever framing the link is using.
+ */
+static void WriteESPFrame( int fd, const uint8_t* Data, int Length ) {
+    uint8_t Out[ COBSMaxEncodedLen( MaxFrameLen ) ];
+
+    if ( ESPFraming == FramingSLIP ) {
+        WriteFrame( fd, Data, Length );
+        return;
+    }
+
+    WriteAll( fd, Out, COBS_Encode( Data, Length, Out, sizeof( Out ) ) );
+}
+
+/*
+ * Until the ESP acks, asks it every second to switch to COBS framing.
+ */
+static void PumpFraming( int SerialFD ) {
+    static uint32_t LastHello = 0;
+    uint8_t Request[ 3 ] = { SLIPManagementMarker, SLIPMgmt_SetFraming, FramingCOBS };
+    uint32_t Now = NowMS( );
+
+    if ( WantCOBS == 0 || ESPFraming == FramingCOBS || ( Now - LastHello ) < FramingHelloMS )
+        return;
+
+    LastHello = Now;
+    WriteESPFrame( SerialFD, Request, sizeof( Request ) );
+}
+
+/*
+ * Until the ESP acks what we want, asks it every second to compress or not.
+ */
+static void PumpCompression( int SerialFD ) {
+    static uint32_t LastHello = 0;
+    uint8_t Request[ 3 ] = { SLIPManagementMarker, SLIPMgmt_SetCompression, ( uint8_t ) UseCompression };
+    uint32_t Now = NowMS( );
+
+    if ( ESPCompresses == UseCompression || ( Now - LastHello ) < CompressionHelloMS )
+        return;
+
+    LastHello = Now;
+    WriteESPFrame( SerialFD, Request, sizeof( Request ) );
+}
+
+/*
+ * Without -a, tells the ESP every second that we don't use ARQ until it acks.
+ */
+static void PumpARQOff( int SerialFD ) {
+    static uint32_t LastHello = 0;
+    uint8_t Request[ 3 ] = { SLIPManagementMarker, SLIPMgmt_SetARQ, 0 };
+    uint32_t Now = NowMS( );
+
+    if ( UseARQ || ESPUsesARQ == 0 || ( Now - LastHello ) < ARQHelloMS )
+        return;
+
+    LastHello = Now;
+    WriteESPFrame( SerialFD, Request, sizeof( Request ) );
+}
+
+/*
+ * Sends queued frames as the ARQ window and the serial port allow,
+ * along with any retransmits and acks that are due.
+ */
+static void PumpARQ( int SerialFD ) {
+    static uint32_t LastHello = 0;
+    uint8_t Frame[ ARQMaxPayload + ARQOverhead ];
+    struct QueuedFrame* Queued = NULL;
+    uint32_t Now = NowMS( );
+    int Backlog = 0;
+    int Length = 0;
+
+    /* Anything already sitting in the tty buffer would count against the retransmit timer */
+    while ( ioctl( SerialFD, TIOCOUTQ, &Backlog ) < 0 || Backlog <= MaxSerialBacklog ) {
+        if ( ( Length = ARQ_Retransmit( &ARQ, Now, Frame, sizeof( Frame ) ) ) == 0 ) {
+            if ( HostQueueCount == 0 || ARQ_CanSend( &ARQ ) == 0 )
+                break;
+
+            Queued = &HostQueue[ HostQueueHead ];
+            Length = ARQ_Send( &ARQ, Now, Queued->Data, Queued->Length, Frame, sizeof( Frame ) );
+
+            HostQueueHead = ( HostQueueHead + 1 ) % HostQueueLen;
+            HostQueueCount--;
+        }
+
+        WriteESPFrame( SerialFD, Frame, Length );
+    }
+
+    /* Until the ESP answers in kind it doesn't know we speak ARQ */
+    if ( HeardARQ == 0 && ( Now - LastHello ) >= ARQHelloMS ) {
+        LastHello = Now;
+        ARQ.AckPending = 1;
+    }
+
+    if ( ( Length = ARQ_Ack( &ARQ, Frame, sizeof( Frame ) ) ) > 0 )
+        WriteESPFrame( SerialFD, Frame, Length );
+}
+
+/*
+ * A frame (compressed or not) ready to go to the ESP.
+ */
+static void SendToESP( int SerialFD, const uint8_t* Frame, int Length ) {
+    struct QueuedFrame* Queued = NULL;
+
+    if ( UseARQ == 0 ) {
+        WriteESPFrame( SerialFD, Frame, Length );
+        return;
+    }
+
+    if ( HostQueueCount >= HostQueueLen || Length > MaxPayloadToESP ) {
+        HostQueueDrops++;
+        return;
+    }
+
+    Queued = &HostQueue[ ( HostQueueHead + HostQueueCount ) % HostQueueLen ];
+    memcpy( Queued->Data, Frame, Length );
+    Queued->Length = Length;
+    HostQueueCount++;
+
+    PumpARQ( SerialFD );
+}
+
+/*
+ * Frame from the host's SLIP driver, on its way to the ESP.
+ */
+static void OnFrameFromHost( int SerialFD, const uint8_t* Frame, int Length ) {
+    uint8_t Compressed[ MaxFrameLen ];
+    int CompressedLength = 0;
+
+    BytesIn+= Length;
+
+    /* Not before the ESP has acked, one built without compression would drop the frame */
+    if ( UseCompression && ESPCompresses == 1 )
+        CompressedLength = LZSS_Compress( &CompressContext, Frame, Length, &Compressed[ 1 ], sizeof( Compressed ) - 1 );
+
+    if ( CompressedLength > 0 && ( CompressedLength + 1 ) < Length ) {
+        Compressed[ 0 ] = SLIPCompressedMarker;
+        SendToESP( SerialFD, Compressed, CompressedLength + 1 );
+
+        BytesOut+= CompressedLength + 1;
+        FramesCompressed++;
+    } else {
+        SendToESP( SerialFD, Frame, Length );
+        BytesOut+= Length;
+    }
+}
+
+/*
+ * Payload from the ESP, on its way to the host's SLIP driver.
+ */
+static void ExpandToHost( int PtyFD, const uint8_t* Frame, int Length ) {
+    uint8_t Expanded[ MaxFrameLen ];
+    int ExpandedLength = 0;
+
+    if ( Length < 1 )
+        return;
+
+    if ( Frame[ 0 ] != SLIPCompressedMarker ) {
+        WriteFrame( PtyFD, Frame, Length );
+        return;
+    }
+
+    if ( ( ExpandedLength = LZSS_Decompress( LZSSDict_ToHost, LZSSDict_ToHostLen, &Frame[ 1 ], Length - 1, Expanded, sizeof( Expanded ) ) ) <= 0 ) {
+        fprintf( stderr, "Dropping corrupt compressed frame (%d bytes)\n", Length );
+        return;
+    }
+
+    WriteFrame( PtyFD, Expanded, ExpandedLength );
+    FramesExpanded++;
+}
+
+static void OnARQPayload( void* User, const uint8_t* Payload, int Length ) {
+    ExpandToHost( *( int* ) User, Payload, Length );
+}
+
+/*
+ * Frame from the ESP, on its way to the host's SLIP driver.
+ */
+static void OnFrameFromESP( int PtyFD, const uint8_t* Frame, int Length ) {
+    if ( Length >= 3 && Frame[ 0 ] == SLIPManagementMarker ) {
+        if ( Frame[ 1 ] == SLIPMgmt_FramingAck && Frame[ 2 ] != ESPFraming ) {
+            fprintf( stderr, "slipz: ESP switched to %s framing\n", Frame[ 2 ] == FramingCOBS ? "COBS" : "SLIP" );
+
+            SLIPDecoder_Init( &SLIPFromESP, FromESPBuffer, sizeof( FromESPBuffer ) );
+            COBSDecoder_Init( &COBSFromESP, FromESPBuffer, sizeof( FromESPBuffer ) );
+            ESPFraming = Frame[ 2 ];
+        } else if ( Frame[ 1 ] == SLIPMgmt_FramingAck && Frame[ 2 ] == FramingSLIP && WantCOBS ) {
+            fprintf( stderr, "slipz: ESP doesn't support COBS framing, staying on SLIP\n" );
+            WantCOBS = 0;
+        } else if ( Frame[ 1 ] == SLIPMgmt_CompressionAck && Frame[ 2 ] != ESPCompresses ) {
+            /* Off after on means the link resynced, we ask again. Off from the start may mean it isn't built in */
+            fprintf( stderr, "slipz: ESP compression %s\n", Frame[ 2 ] ? "on" : "off" );
+
+            ESPCompresses = Frame[ 2 ];
+        } else if ( Frame[ 1 ] == SLIPMgmt_ARQAck ) {
+            ESPUsesARQ = Frame[ 2 ];
+        }
+
+        return;
+    }
+
+    if ( UseARQ && ARQ_IsFrame( Frame, Length ) ) {
+        if ( ARQ_Receive( &ARQ, Frame, Length, OnARQPayload, &PtyFD ) >= 0 )
+            HeardARQ = 1;
+
+        return;
+    }
+
+    ExpandToHost( PtyFD, Frame, Length );
+}
+
+/*
+ * Feeds bytes from the ESP through the decoder for the framing in use,
+ * one frame at a time since an ack can switch framing part way through.
+ */
+static void ReadFromESP( int PtyFD, const uint8_t* Data, int Length ) {
+    int FrameLength = 0;
+    int Used = 0;
+
+    while ( Length > 0 ) {
+        if ( ESPFraming == FramingCOBS )
+            Used = COBSDecoder_Feed( &COBSFromESP, Data, Length, &FrameLength );
+        else
+            Used = SLIPDecoder_Feed( &SLIPFromESP, Data, Length, &FrameLength );
+
+        Data+= Used;
+        Length-= Used;
+
+        if ( FrameLength > 0 )
+            OnFrameFromESP( PtyFD, FromESPBuffer, FrameLength );
+    }
+}
+
+/*
+ * Feeds received bytes through the SLIP decoder, calling OnFrame for every complete frame.
+ */
+static void ReadFrames( struct FrameReader* Reader, const uint8_t* Data, int Length, int OutFD, void ( *OnFrame ) ( int, const uint8_t*, int ) ) {
+    uint8_t Byte = 0;
+    int i = 0;
+
+    for ( i = 0; i < Length; i++ ) {
+        Byte = Data[ i ];
+
+        if ( Byte == SLIP_END ) {
+            if ( Reader->Length > 0 && Reader->Overrun == 0 )
+                OnFrame( OutFD, Reader->Buffer, Reader->Length );
+
+            Reader->Length = 0;
+            Reader->IsInESC = 0;
+            Reader->Overrun = 0;
+            continue;
+        }
+
+        if ( Reader->IsInESC ) {
+            Reader->IsInESC = 0;
+
+            if ( Byte == SLIP_REPLACE )
+                Byte = SLIP_END;
+            else if ( Byte == SLIP_ESC_REPLACE )
+                Byte = SLIP_ESC;
+        } else if ( Byte == SLIP_ESC ) {
+            Reader->IsInESC = 1;
+            continue;
+        }
+
+        if ( Reader->Length < MaxFrameLen )
+            Reader->Buffer[ Reader->Length++ ] = Byte;
+        else
+            Reader->Overrun = 1;
+    }
+}
+
+int main( int Argc, char** Argv ) {
+    static struct FrameReader FromHost;
+    uint8_t Buffer[ 4096 ];
+    struct timeval Timeout;
+    fd_set ReadSet;
+    ssize_t Count = 0;
+    uint32_t LastARQReport = 0;
+    int SerialFD = -1;
+    int PtyFD = -1;
+    int MaxFD = 0;
+    int Option = 0;
+
+    while ( ( Option = getopt( Argc, Argv, "ancC" ) ) != -1 ) {
+        switch ( Option ) {
+            case 'a': UseARQ = 1; break;
+            case 'n': UseCompression = 0; break;
+            case 'c': WantCOBS = 1; break;
+            case 'C': ESPFraming = FramingCOBS; break;
+            default: Argc = 0; break;
+        };
+    }
+
+    if ( ( Argc - optind ) < 2 ) {
+        fprintf( stderr, "Usage: %s [-a] [-n] [-c|-C] <serial device> <baud>\n", Argv[ 0 ] );
+        return 1;
+    }
+
+    if ( ( SerialFD = open( Argv[ optind ], O_RDWR | O_NOCTTY ) ) < 0 ) {
+        perror( Argv[ optind ] );
+        return 1;
+    }
+
+    MakeRaw( SerialFD, atoi( Argv[ optind + 1 ] ) );
+    ARQ_Init( &ARQ, atoi( Argv[ optind + 1 ] ) );
+
+    if ( ( PtyFD = posix_openpt( O_RDWR | O_NOCTTY ) ) < 0 || grantpt( PtyFD ) < 0 || unlockpt( PtyFD ) < 0 ) {
+        perror( "posix_openpt" );
+        return 1;
+    }
+
+    MakeRaw( PtyFD, 0 );
+    printf( "%s\n", ptsname( PtyFD ) );
+    fflush( stdout );
+
+    LZSS_Init( &CompressContext, LZSSDict_FromHost, LZSSDict_FromHostLen );
+    SLIPDecoder_Init( &SLIPFromESP, FromESPBuffer, sizeof( FromESPBuffer ) );
+    COBSDecoder_Init( &COBSFromESP, FromESPBuffer, sizeof( FromESPBuffer ) );
+    MaxFD = ( SerialFD > PtyFD ? SerialFD : PtyFD ) + 1;
+
+    while ( 1 ) {
+        FD_ZERO( &ReadSet );
+        FD_SET( SerialFD, &ReadSet );
+        FD_SET( PtyFD, &ReadSet );
+
+        /* ARQ and the framing and compression requests have timers to run even when nothing is coming in */
+        Timeout.tv_sec = 0;
+        Timeout.tv_usec = 5000;
+
+        if ( select( MaxFD, &ReadSet, NULL, NULL, ( UseARQ || WantCOBS || ESPCompresses != UseCompression || ESPUsesARQ != 0 ) ? &Timeout : NULL ) < 0 ) {
+            if ( errno == EINTR )
+                continue;
+
+            perror( "select" );
+            return 1;
+        }
+
+        if ( FD_ISSET( PtyFD, &ReadSet ) ) {
+            /* EIO just means nothing has the other end open yet */
+            if ( ( Count = read( PtyFD, Buffer, sizeof( Buffer ) ) ) > 0 )
+                ReadFrames( &FromHost, Buffer, Count, SerialFD, OnFrameFromHost );
+            else if ( Count < 0 && errno == EIO )
+                usleep( 100000 );
+        }
+
+        if ( FD_ISSET( SerialFD, &ReadSet ) ) {
+            if ( ( Count = read( SerialFD, Buffer, sizeof( Buffer ) ) ) > 0 )
+                ReadFromESP( PtyFD, Buffer, Count );
+        }
+
+        PumpFraming( SerialFD );
+        PumpCompression( SerialFD );
+        PumpARQOff( SerialFD );
+
+        if ( UseARQ ) {
+            PumpARQ( SerialFD );
+
+            if ( ( NowMS( ) - LastARQReport ) >= ARQReportMS ) {
+                LastARQReport = NowMS( );
+                fprintf( stderr, "slipz: ARQ %s, sent %u, retransmits %u (fast %u), given up %u, delivered %u, CRC errors %u, out of order %u, queue drops %lu\n",
+                    HeardARQ ? "on" : "waiting for ESP", ARQ.FramesSent, ARQ.Retransmits, ARQ.FastRetransmits, ARQ.GiveUps,
+                    ARQ.FramesDelivered, ARQ.CRCErrors, ARQ.OutOfOrder, HostQueueDrops );
+            }
+        }
+
+        if ( ( FramesCompressed - LastReported ) >= 100 ) {
+            LastReported = FramesCompressed;
+            fprintf( stderr, "slipz: %lu frames compressed (%lu -> %lu bytes), %lu expanded\n", FramesCompressed, BytesIn, BytesOut, FramesExpanded );
+        }
+    }
+
+    return 0;
+}
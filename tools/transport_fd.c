@@ -0,0 +1,87 @@
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include "transport_fd.h"
+
+static int LinkFD = -1;
+static int IsReady = 1;
+
+static unsigned long BytesRead = 0;
+static unsigned long BytesWritten = 0;
+
+const struct SLIPTransport* SLIPLink = &FDTransport;
+
+static void FD_Begin( uint32_t Speed ) {
+    ( void ) Speed;
+
+    fcntl( LinkFD, F_SETFL, fcntl( LinkFD, F_GETFL ) | O_NONBLOCK );
+}
+
+/*
+ * While we're not ready the bytes stay in the kernel, which pushes
+ * back on the writer the same way a full UART FIFO does.
+ */
+static int FD_Read( uint8_t* Buffer, int Length ) {
+    ssize_t Count = 0;
+
+    if ( IsReady == 0 || ( Count = read( LinkFD, Buffer, Length ) ) <= 0 )
+        return 0;
+
+    BytesRead+= Count;
+    return ( int ) Count;
+}
+
+/*
+ * TIOCOUTQ works for ttys and sockets alike.
+ */
+static int FD_WriteSpace( void ) {
+    int Backlog = 0;
+
+    if ( ioctl( LinkFD, TIOCOUTQ, &Backlog ) < 0 )
+        return FDTransportMaxBacklog;
+
+    return Backlog < FDTransportMaxBacklog ? FDTransportMaxBacklog - Backlog : 0;
+}
+
+static int FD_Write( const uint8_t* Data, int Length ) {
+    ssize_t Count = 0;
+    int Space = FD_WriteSpace( );
+
+    if ( Length > Space )
+        Length = Space;
+
+    if ( Length <= 0 || ( Count = write( LinkFD, Data, Length ) ) <= 0 )
+        return 0;
+
+    BytesWritten+= Count;
+    return ( int ) Count;
+}
+
+static int FD_IsPeerReady( void ) {
+    return FD_WriteSpace( ) > 0;
+}
+
+static void FD_SetReady( int Ready ) {
+    IsReady = Ready;
+}
+
+static void FD_DumpStats( void ) {
+    fprintf( stderr, "FDTransport: fd %d / read %lu / written %lu / %s\n", LinkFD, BytesRead, BytesWritten, IsReady ? "ready" : "holding off" );
+}
+
+const struct SLIPTransport FDTransport = {
+    "FD", FD_Begin, FD_Read, FD_Write, FD_WriteSpace, FD_IsPeerReady, FD_SetReady, FD_DumpStats
+};
+
+/*
+ * Points FDTransport (and SLIPLink) at fd.
+ */
+void FDTransport_Use( int fd ) {
+    LinkFD = fd;
+    IsReady = 1;
+    SLIPLink = &FDTransport;
+}
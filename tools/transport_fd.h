@@ -0,0 +1,22 @@
+#ifndef _TRANSPORT_FD_H_
+#define _TRANSPORT_FD_H_
+
+/*
+ * Host stand-in for the SLIP8266 transport (see ../transport.h) over any
+ * file descriptor: a pty, a serial port or one end of a socketpair.
+ * The descriptor is switched to non-blocking.
+ */
+
+#include "transport.h"
+
+/* How much may sit unsent in the kernel before WriteSpace reports 0 */
+#define FDTransportMaxBacklog 16384
+
+extern const struct SLIPTransport FDTransport;
+
+/*
+ * Points FDTransport (and SLIPLink) at fd.
+ */
+void FDTransport_Use( int fd );
+
+#endif
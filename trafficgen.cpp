@@ -0,0 +1,391 @@
+#include <ESP8266WiFi.h>
+#include <lwip/netif.h>
+#include <lwip/err.h>
+#include "ether.h"
+#include "ipv4.h"
+#include "util.h"
+#include "slip.h"
+#include "mydebug.h"
+#include "hdrview.h"
+#include "bridge.h"
+#include "txqueue.h"
+#include "trafficgen.h"
+
+#if defined ( TRAFFICGEN_ENABLED )
+
+extern "C" {
+#include <lwip/inet_chksum.h>
+}
+
+#define IPerfFlag_Version1 0x80000000
+
+/* IP and UDP headers in front of the payload for the serial side */
+#define TrafficGenHeadroom ( sizeof( struct ip_packet ) + sizeof( struct udp_packet ) )
+
+#define TrafficGenMaxSize ( TXQueueMaxPacketLen - TrafficGenHeadroom )
+
+/*
+ * iperf2's UDP datagram header, all fields in network byte order.
+ * A negative ID marks the closing datagram of a run.
+ */
+struct IPerfDatagram {
+    int32_t ID;
+    uint32_t Seconds;
+    uint32_t Microseconds;
+} __attribute__( ( packed ) );
+
+/*
+ * Follows the datagram header in the server's answer to the closing datagram.
+ */
+struct IPerfServerReport {
+    int32_t Flags;
+    int32_t TotalLengthHigh;
+    int32_t TotalLengthLow;
+    int32_t StopSeconds;
+    int32_t StopMicroseconds;
+    int32_t Errors;
+    int32_t OutOfOrder;
+    int32_t Datagrams;
+    int32_t JitterSeconds;
+    int32_t JitterMicroseconds;
+} __attribute__( ( packed ) );
+
+/*
+ * One iperf client run into the sink. Jitter is kept times 16 as in RFC 1889.
+ */
+struct TrafficGenSink {
+    uint32_t ClientIP;
+    uint16_t ClientPort;
+    int IsActive;
+
+    int32_t NextID;
+    uint32_t Datagrams;
+    int32_t Errors;
+    uint32_t OutOfOrder;
+    uint64_t Bytes;
+    uint64_t StartUS;
+    uint64_t LastUS;
+
+    int64_t LastTransitUS;
+    uint32_t Jitter16;
+
+    /* Answer to the closing datagram, sent again if the client repeats it */
+    struct IPerfServerReport Report;
+    int HaveReport;
+
+    uint32_t Runs;
+};
+
+static const char* const SideNames[ ] = { "Serial", "WiFi" };
+
+static uint8_t Packet[ TrafficGenHeadroom + TrafficGenMaxSize ] __attribute__( ( aligned( 4 ) ) );
+
+static struct TrafficGenSink Sinks[ 2 ];
+
+static int IsRunning = 0;
+static int IsFinishing = 0;
+static int GenSide = 0;
+static int GenSize = 0;
+static uint32_t GenRate = 0;
+static uint32_t GenDurationMS = 0;
+static uint64_t GenStartUS = 0;
+static uint32_t GenDestIP = 0;
+static int32_t GenNextID = 0;
+static int GenFinsSent = 0;
+static uint32_t GenNextFin = 0;
+
+static uint32_t GenSent = 0;
+static uint32_t GenSendFailures = 0;
+static uint32_t GenRuns = 0;
+static uint32_t GenReports = 0;
+
+static uint32_t TrafficGen_LoadBE32( const uint8_t* Data ) {
+    return ( ( uint32_t ) Data[ 0 ] << 24 ) | ( ( uint32_t ) Data[ 1 ] << 16 ) | ( ( uint32_t ) Data[ 2 ] << 8 ) | Data[ 3 ];
+}
+
+static uint16_t TrafficGen_LoadBE16( const uint8_t* Data ) {
+    return ( ( uint16_t ) Data[ 0 ] << 8 ) | Data[ 1 ];
+}
+
+/*
+ * Sends the Length bytes at &Packet[ TrafficGenHeadroom ] as a UDP datagram from us on Side.
+ * Returns 0 if it couldn't go out.
+ */
+static int TrafficGen_Send( int Side, uint32_t DestIP, uint16_t SourcePort, uint16_t DestPort, int Length ) {
+    struct ip_packet* IPHeader = ( struct ip_packet* ) Packet;
+    struct udp_packet* UDPHeader = ( struct udp_packet* ) &Packet[ sizeof( struct ip_packet ) ];
+
+    if ( Side == TrafficGenSide_WiFi )
+        return UDP_SendDatagram( OurIPAddress, SourcePort, DestIP, DestPort, &Packet[ TrafficGenHeadroom ], Length ) == ERR_OK;
+
+    /* From the gateway address so the host routes answers back over the serial link, like the link probe */
+    PrepareTCPHeader( IPHeader, OurGateway, DestIP, Length, 0, IP_PROTO_UDP );
+    PrepareUDPHeader( UDPHeader, DestPort, Length );
+    UDPHeader->SourcePort = htons( SourcePort );
+
+    BridgeQueueing::ToSerial( Packet, TrafficGenHeadroom + Length );
+    return 1;
+}
+
+/*
+ * Stamps the iperf datagram header at the front of the payload.
+ */
+static void TrafficGen_Stamp( int32_t ID ) {
+    struct IPerfDatagram* Datagram = ( struct IPerfDatagram* ) &Packet[ TrafficGenHeadroom ];
+    uint64_t Now = micros64( );
+
+    Datagram->ID = htonl( ID );
+    Datagram->Seconds = htonl( ( uint32_t ) ( Now / 1000000 ) );
+    Datagram->Microseconds = htonl( ( uint32_t ) ( Now % 1000000 ) );
+}
+
+/*
+ * Prints a server report, ours or one from an iperf server.
+ */
+static void TrafficGen_PrintReport( const char* What, int Side, const struct IPerfServerReport* Report ) {
+    uint64_t Bytes = ( ( uint64_t ) ( uint32_t ) ntohl( Report->TotalLengthHigh ) << 32 ) | ( uint32_t ) ntohl( Report->TotalLengthLow );
+    uint64_t DurationUS = ( uint64_t ) ntohl( Report->StopSeconds ) * 1000000 + ntohl( Report->StopMicroseconds );
+    uint32_t JitterUS = ntohl( Report->JitterSeconds ) * 1000000 + ntohl( Report->JitterMicroseconds );
+    uint32_t Datagrams = ntohl( Report->Datagrams );
+    int32_t Errors = ntohl( Report->Errors );
+    uint32_t Kbps = DurationUS ? ( uint32_t ) ( ( Bytes * 8000 ) / DurationUS ) : 0;
+    uint32_t Loss10 = Datagrams ? ( uint32_t ) ( ( ( uint64_t ) ( Errors > 0 ? Errors : 0 ) * 1000 ) / Datagrams ) : 0;
+
+    DebugPrintf( "%s: %s %s: %u bytes in %ums, %ukbit/s / Lost %d of %u (%u.%u%%) / Out of order %d / Jitter %u.%03ums\n", __FUNCTION__, SideNames[ Side ], What,
+        ( uint32_t ) Bytes, ( uint32_t ) ( DurationUS / 1000 ), Kbps, Errors, Datagrams, Loss10 / 10, Loss10 % 10, ntohl( Report->OutOfOrder ), JitterUS / 1000, JitterUS % 1000 );
+}
+
+/*
+ * Starts sending Size byte datagrams at RateBPS for DurationMS to the
+ * iperf server on Side. Anything already running is stopped.
+ */
+void TrafficGen_Start( int Side, int Size, uint32_t RateBPS, uint32_t DurationMS ) {
+    if ( Size < ( int ) sizeof( struct IPerfDatagram ) )
+        Size = sizeof( struct IPerfDatagram );
+
+    if ( Size > ( int ) TrafficGenMaxSize )
+        Size = TrafficGenMaxSize;
+
+    /* Only the header is ever written, the rest of the payload stays zero */
+    memset( Packet, 0, sizeof( Packet ) );
+
+    GenSide = Side;
+    GenSize = Size;
+    GenRate = RateBPS;
+    GenDurationMS = DurationMS;
+    GenDestIP = ( Side == TrafficGenSide_WiFi ) ? ( uint32_t ) TrafficGenWiFiServer : BridgeAddressing::SerialHostIP( );
+    GenNextID = 0;
+    GenSent = 0;
+    GenSendFailures = 0;
+    GenStartUS = micros64( );
+
+    IsFinishing = 0;
+    IsRunning = 1;
+    GenRuns++;
+
+    DebugPrintf( "%s: %s run, %d byte datagrams at %ubit/s for %ums\n", __FUNCTION__, SideNames[ Side ], Size, RateBPS, DurationMS );
+}
+
+/*
+ * Called every "frame" or run through the main loop, paces the generator.
+ */
+void TrafficGen_Tick( void ) {
+    uint64_t Elapsed = 0;
+    uint64_t Due = 0;
+    uint32_t Now = millis( );
+    int Burst = 0;
+
+    if ( IsRunning ) {
+        Elapsed = micros64( ) - GenStartUS;
+
+        if ( Elapsed >= ( uint64_t ) GenDurationMS * 1000 ) {
+            DebugPrintf( "%s: %s run done, sent %u datagrams (%u failed), waiting for the server report\n", __FUNCTION__, SideNames[ GenSide ], GenSent, GenSendFailures );
+
+            IsRunning = 0;
+            IsFinishing = 1;
+            GenFinsSent = 0;
+            GenNextFin = Now;
+        } else {
+            /* Datagrams that should have gone by now, counting the one at time zero */
+            Due = ( ( Elapsed * GenRate ) / ( ( uint64_t ) GenSize * 8 * 1000000 ) ) + 1;
+
+            for ( Burst = 0; Burst < TrafficGenMaxBurst && ( uint64_t ) GenNextID < Due; Burst++ ) {
+                TrafficGen_Stamp( GenNextID++ );
+
+                if ( TrafficGen_Send( GenSide, GenDestIP, TrafficGenClientPort, TrafficGenPort, GenSize ) )
+                    GenSent++;
+                else
+                    GenSendFailures++;
+            }
+        }
+    }
+
+    if ( IsFinishing && ( int32_t ) ( Now - GenNextFin ) >= 0 ) {
+        if ( GenFinsSent >= TrafficGenMaxFins ) {
+            DebugPrintf( "%s: %s run, no report from the server\n", __FUNCTION__, SideNames[ GenSide ] );
+
+            IsFinishing = 0;
+            return;
+        }
+
+        TrafficGen_Stamp( -GenNextID );
+        TrafficGen_Send( GenSide, GenDestIP, TrafficGenClientPort, TrafficGenPort, GenSize );
+
+        GenFinsSent++;
+        GenNextFin = Now + TrafficGenFinIntervalMS;
+    }
+}
+
+/*
+ * An iperf datagram from a client into the sink on Side.
+ */
+static void TrafficGen_OnClientDatagram( int Side, uint32_t SourceIP, uint16_t SourcePort, const uint8_t* Payload, int Length ) {
+    struct TrafficGenSink* Sink = &Sinks[ Side ];
+    struct IPerfServerReport* Report = &Sink->Report;
+    int32_t ID = ( int32_t ) TrafficGen_LoadBE32( Payload );
+    uint64_t Now = micros64( );
+    uint64_t SentUS = ( uint64_t ) TrafficGen_LoadBE32( &Payload[ 4 ] ) * 1000000 + TrafficGen_LoadBE32( &Payload[ 8 ] );
+    int64_t Transit = ( int64_t ) ( Now - SentUS );
+    int64_t Delta = 0;
+    uint32_t Runs = Sink->Runs;
+    int IsSameClient = Sink->ClientIP == SourceIP && Sink->ClientPort == SourcePort;
+
+    if ( ID >= 0 ) {
+        if ( Sink->IsActive == 0 || IsSameClient == 0 ) {
+            memset( Sink, 0, sizeof( struct TrafficGenSink ) );
+
+            Sink->Runs = Runs;
+            Sink->ClientIP = SourceIP;
+            Sink->ClientPort = SourcePort;
+            Sink->StartUS = Now;
+            Sink->LastTransitUS = Transit;
+            Sink->IsActive = 1;
+        }
+
+        /* Same bookkeeping as iperf's server: gaps are losses until the missing ones turn up */
+        if ( ID >= Sink->NextID ) {
+            Sink->Errors+= ID - Sink->NextID;
+            Sink->NextID = ID + 1;
+        } else {
+            Sink->OutOfOrder++;
+            Sink->Errors--;
+        }
+
+        Delta = Transit - Sink->LastTransitUS;
+        Sink->LastTransitUS = Transit;
+        Sink->Jitter16+= ( uint32_t ) ( Delta < 0 ? -Delta : Delta ) - ( ( Sink->Jitter16 + 8 ) >> 4 );
+
+        Sink->Datagrams++;
+        Sink->Bytes+= Length;
+        Sink->LastUS = Now;
+        return;
+    }
+
+    if ( IsSameClient == 0 )
+        return;
+
+    if ( Sink->IsActive ) {
+        Report->Flags = htonl( IPerfFlag_Version1 );
+        Report->TotalLengthHigh = htonl( ( uint32_t ) ( Sink->Bytes >> 32 ) );
+        Report->TotalLengthLow = htonl( ( uint32_t ) Sink->Bytes );
+        Report->StopSeconds = htonl( ( uint32_t ) ( ( Sink->LastUS - Sink->StartUS ) / 1000000 ) );
+        Report->StopMicroseconds = htonl( ( uint32_t ) ( ( Sink->LastUS - Sink->StartUS ) % 1000000 ) );
+        Report->Errors = htonl( Sink->Errors );
+        Report->OutOfOrder = htonl( Sink->OutOfOrder );
+        Report->Datagrams = htonl( -ID );
+        Report->JitterSeconds = htonl( ( Sink->Jitter16 >> 4 ) / 1000000 );
+        Report->JitterMicroseconds = htonl( ( Sink->Jitter16 >> 4 ) % 1000000 );
+
+        Sink->IsActive = 0;
+        Sink->HaveReport = 1;
+        Sink->Runs++;
+
+        TrafficGen_PrintReport( "sink", Side, Report );
+    }
+
+    if ( Sink->HaveReport == 0 )
+        return;
+
+    /* Echo the closing header back with the report after it, as iperf does */
+    memcpy( &Packet[ TrafficGenHeadroom ], Payload, sizeof( struct IPerfDatagram ) );
+    memcpy( &Packet[ TrafficGenHeadroom + sizeof( struct IPerfDatagram ) ], Report, sizeof( struct IPerfServerReport ) );
+
+    TrafficGen_Send( Side, SourceIP, TrafficGenPort, SourcePort, sizeof( struct IPerfDatagram ) + sizeof( struct IPerfServerReport ) );
+}
+
+/*
+ * Looks at an IP packet on Side addressed to LocalIP, returns 1 if it was iperf traffic for us.
+ */
+static int TrafficGen_OnPacket( int Side, uint32_t LocalIP, const uint8_t* IP, int Length ) {
+    struct IPerfServerReport Report;
+    const uint8_t* UDP = NULL;
+    int HeaderLength = 0;
+    int UDPLength = 0;
+    uint16_t DestPort = 0;
+
+    if ( Length < ( int ) TrafficGenHeadroom || UnalignedIPv4View::Protocol( IP ) != IP_PROTO_UDP || UnalignedIPv4View::DestIP( IP ) != LocalIP )
+        return 0;
+
+    HeaderLength = UnalignedIPv4View::HeaderLength( IP );
+    UDP = &IP[ HeaderLength ];
+
+    if ( ( HeaderLength + ( int ) sizeof( struct udp_packet ) ) > Length )
+        return 0;
+
+    DestPort = TrafficGen_LoadBE16( &UDP[ 2 ] );
+    UDPLength = TrafficGen_LoadBE16( &UDP[ 4 ] ) - sizeof( struct udp_packet );
+
+    if ( DestPort != TrafficGenPort && DestPort != TrafficGenClientPort )
+        return 0;
+
+    if ( UDPLength < ( int ) sizeof( struct IPerfDatagram ) || ( HeaderLength + ( int ) sizeof( struct udp_packet ) + UDPLength ) > Length )
+        return 1;
+
+    if ( DestPort == TrafficGenPort ) {
+        TrafficGen_OnClientDatagram( Side, UnalignedIPv4View::SourceIP( IP ), TrafficGen_LoadBE16( &UDP[ 0 ] ), &UDP[ sizeof( struct udp_packet ) ], UDPLength );
+        return 1;
+    }
+
+    /* The server's answer to our closing datagram */
+    if ( IsFinishing && Side == GenSide && UDPLength >= ( int ) ( sizeof( struct IPerfDatagram ) + sizeof( struct IPerfServerReport ) ) ) {
+        memcpy( &Report, &UDP[ sizeof( struct udp_packet ) + sizeof( struct IPerfDatagram ) ], sizeof( Report ) );
+
+        IsFinishing = 0;
+        GenReports++;
+
+        TrafficGen_PrintReport( "server", Side, &Report );
+    }
+
+    return 1;
+}
+
+/*
+ * Looks at a packet from the serial host, returns 1 if it was iperf traffic for us.
+ */
+int TrafficGen_OnPacketFromSerial( const uint8_t* Packet, int Length ) {
+    return TrafficGen_OnPacket( TrafficGenSide_Serial, OurGateway, Packet, Length );
+}
+
+/*
+ * Looks at an IP packet from WiFi, returns 1 if it was iperf traffic for us.
+ */
+int TrafficGen_OnPacketFromWiFi( const uint8_t* Packet, int Length ) {
+    return TrafficGen_OnPacket( TrafficGenSide_WiFi, OurIPAddress, Packet, Length );
+}
+
+/*
+ * Writes the generator and sink counters to the debug console.
+ */
+void TrafficGen_DumpStats( void ) {
+    int i = 0;
+
+    DebugPrintf( "%s: Generator %s / Runs %u / Reports %u / Last run sent %u, failed %u\n", __FUNCTION__,
+        IsRunning ? SideNames[ GenSide ] : ( IsFinishing ? "finishing" : "idle" ), GenRuns, GenReports, GenSent, GenSendFailures );
+
+    for ( i = 0; i < 2; i++ ) {
+        DebugPrintf( "%s: %s sink %s / Runs %u / Datagrams %u / Lost %d / Out of order %u\n", __FUNCTION__, SideNames[ i ],
+            Sinks[ i ].IsActive ? "receiving" : "idle", Sinks[ i ].Runs, Sinks[ i ].Datagrams, Sinks[ i ].Errors, Sinks[ i ].OutOfOrder );
+    }
+}
+
+#endif
@@ -0,0 +1,90 @@
+#ifndef _TRAFFICGEN_H_
+#define _TRAFFICGEN_H_
+
+/*
+ * Built in traffic generator and sink for sizing the bridge.
+ * Datagrams use iperf2's UDP format so a stock iperf does the other end:
+ *
+ *   Serial side: "iperf -s -u" on the serial host. We send from the
+ *   gateway address through the SLIP transmit queue like forwarded
+ *   traffic, so the results include queueing and CoDel drops.
+ *   WiFi side: "iperf -s -u" on TrafficGenWiFiServer.
+ *
+ * When a run is over we send iperf's closing datagram and the server
+ * answers with its report (bytes, lost, out of order, jitter), which is
+ * printed next to what we sent.
+ *
+ * The sink answers "iperf -c <gateway> -u" from the serial host and
+ * "iperf -c <our IP> -u" from WiFi on TrafficGenPort, working out loss,
+ * reordering and jitter (RFC 1889) the way iperf does and replying to
+ * the closing datagram with the same report.
+ *
+ * TCP isn't covered, the bridge has no TCP stack of its own outside the
+ * split TCP proxy. Run iperf -c across the bridge for that.
+ */
+
+// #define TRAFFICGEN_ENABLED
+
+#define TrafficGenSide_Serial 0
+#define TrafficGenSide_WiFi 1
+
+/* Sink port, and where the generator sends to */
+#define TrafficGenPort 5001
+
+/* Generator source port, server reports come back here */
+#define TrafficGenClientPort 5002
+
+#define TrafficGenWiFiServer IPAddress( 192, 168, 2, 2 )
+
+/* Run started from setup( ), rate is UDP payload bits per second */
+#define TrafficGenDefaultSide TrafficGenSide_Serial
+#define TrafficGenDefaultSize 512
+#define TrafficGenDefaultRate ( ( SLIPBaudRate / 10 ) * 8 * 8 / 10 )
+#define TrafficGenDefaultDurationMS 10000
+
+/* Caps how many datagrams one TrafficGen_Tick sends to catch up */
+#define TrafficGenMaxBurst 8
+
+/* Closing datagrams are repeated until the server reports, like iperf */
+#define TrafficGenFinIntervalMS 250
+#define TrafficGenMaxFins 10
+
+#if defined ( TRAFFICGEN_ENABLED )
+
+/*
+ * Starts sending Size byte datagrams at RateBPS for DurationMS to the
+ * iperf server on Side. Anything already running is stopped.
+ */
+void TrafficGen_Start( int Side, int Size, uint32_t RateBPS, uint32_t DurationMS );
+
+/*
+ * Called every "frame" or run through the main loop, paces the generator.
+ */
+void TrafficGen_Tick( void );
+
+/*
+ * Looks at a packet from the serial host, returns 1 if it was iperf traffic for us.
+ */
+int TrafficGen_OnPacketFromSerial( const uint8_t* Packet, int Length );
+
+/*
+ * Looks at an IP packet from WiFi, returns 1 if it was iperf traffic for us.
+ */
+int TrafficGen_OnPacketFromWiFi( const uint8_t* Packet, int Length );
+
+/*
+ * Writes the generator and sink counters to the debug console.
+ */
+void TrafficGen_DumpStats( void );
+
+#else
+
+#define TrafficGen_Start( a, b, c, d )
+#define TrafficGen_Tick( )
+#define TrafficGen_OnPacketFromSerial( a, b ) 0
+#define TrafficGen_OnPacketFromWiFi( a, b ) 0
+#define TrafficGen_DumpStats( )
+
+#endif
+
+#endif
@@ -0,0 +1,252 @@
+#include <ESP8266WiFi.h>
+#include <lwip/netif.h>
+#include <lwip/err.h>
+#include "ether.h"
+#include "ipv4.h"
+#include "util.h"
+#include "slip.h"
+#include "mydebug.h"
+#include "transport.h"
+
+#if defined ( SLIP_TRANSPORT_HSPI )
+#include <SPISlave.h>
+#endif
+
+/*
+ * UART0, the original transport. There are no RTS/CTS lines on the
+ * module so both ends are always ready, flow control is the SLIP frame
+ * being left in the UART FIFO until there is somewhere to put it.
+ */
+static uint32_t UARTOverruns = 0;
+
+static void UART_Begin( uint32_t Speed ) {
+    Serial.begin( Speed );
+
+    while ( ! Serial )
+        yield( );
+
+    Serial.setTimeout( 0 );
+}
+
+static int UART_Read( uint8_t* Buffer, int Length ) {
+    int Count = 0;
+    int Data = 0;
+
+    while ( Count < Length && ( Data = Serial.read( ) ) >= 0 )
+        Buffer[ Count++ ] = Data;
+
+    return Count;
+}
+
+static int UART_WriteSpace( void ) {
+    return Serial.availableForWrite( );
+}
+
+static int UART_Write( const uint8_t* Data, int Length ) {
+    int Space = Serial.availableForWrite( );
+
+    if ( Length > Space )
+        Length = Space;
+
+    return Length > 0 ? Serial.write( Data, Length ) : 0;
+}
+
+static int UART_IsPeerReady( void ) {
+    return 1;
+}
+
+static void UART_SetReady( int IsReady ) {
+}
+
+static void UART_DumpStats( void ) {
+    if ( Serial.hasOverrun( ) )
+        UARTOverruns++;
+
+    DebugPrintf( "%s: UART @ %u baud / RX overruns seen %u\n", __FUNCTION__, SLIPBaudRate, UARTOverruns );
+}
+
+const struct SLIPTransport UARTTransport = {
+    "UART", UART_Begin, UART_Read, UART_Write, UART_WriteSpace, UART_IsPeerReady, UART_SetReady, UART_DumpStats
+};
+
+#if defined ( SLIP_TRANSPORT_HSPI )
+
+/*
+ * HSPI slave. The master drives 32 byte transactions, byte 0 of each is
+ * how many of the following 31 carry SLIP data, so any mix of partial
+ * chunks works and idle reads cost nothing.
+ *
+ * The status word tells the master what it may do:
+ *   bits 0-15   bytes we can take (0 when we've asked it to hold off)
+ *   bits 16-23  data bytes in the chunk waiting to be read
+ *
+ * The SPI callbacks run from the HSPI interrupt. Each ring has one
+ * producer and one consumer, Head and Tail only ever increase and the
+ * slot is (Index & (Size - 1)).
+ */
+static uint8_t HSPIRXRing[ HSPIRXRingSize ];
+static volatile uint32_t HSPIRXHead = 0;
+static volatile uint32_t HSPIRXTail = 0;
+
+static uint8_t HSPITXRing[ HSPITXRingSize ];
+static volatile uint32_t HSPITXHead = 0;
+static volatile uint32_t HSPITXTail = 0;
+
+static uint8_t HSPITXChunk[ HSPIChunkLen ];
+static volatile int HSPIIsChunkLoaded = 0;
+static volatile int HSPIIsReady = 1;
+
+static volatile uint32_t HSPIChunksIn = 0;
+static volatile uint32_t HSPIChunksOut = 0;
+static volatile uint32_t HSPIRXOverruns = 0;
+
+static void ICACHE_RAM_ATTR HSPI_UpdateStatus( void ) {
+    uint32_t Free = HSPIIsReady ? HSPIRXRingSize - ( HSPIRXHead - HSPIRXTail ) : 0;
+
+    if ( Free > 0xFFFF )
+        Free = 0xFFFF;
+
+    SPISlave.setStatus( Free | ( ( HSPIIsChunkLoaded ? ( uint32_t ) HSPITXChunk[ 0 ] : 0 ) << 16 ) );
+}
+
+/*
+ * Moves up to one chunk from the TX ring to the SPI data registers.
+ * Called from the interrupt, or with interrupts off.
+ */
+static void ICACHE_RAM_ATTR HSPI_LoadChunk( void ) {
+    uint32_t Count = HSPITXHead - HSPITXTail;
+    uint32_t i = 0;
+
+    if ( Count > HSPIChunkDataLen )
+        Count = HSPIChunkDataLen;
+
+    for ( i = 0; i < Count; i++ )
+        HSPITXChunk[ 1 + i ] = HSPITXRing[ ( HSPITXTail + i ) & ( HSPITXRingSize - 1 ) ];
+
+    HSPITXChunk[ 0 ] = Count;
+    HSPITXTail+= Count;
+    HSPIIsChunkLoaded = Count > 0;
+
+    SPISlave.setData( HSPITXChunk, HSPIChunkLen );
+    HSPI_UpdateStatus( );
+}
+
+static void ICACHE_RAM_ATTR HSPI_OnData( uint8_t* Data, size_t Length ) {
+    uint32_t Count = Data[ 0 ];
+    uint32_t i = 0;
+
+    if ( Count == 0 || Count > HSPIChunkDataLen || Length < HSPIChunkLen )
+        return;
+
+    /* The master should have checked the status word first */
+    if ( ( HSPIRXHead - HSPIRXTail ) + Count > HSPIRXRingSize ) {
+        HSPIRXOverruns++;
+        return;
+    }
+
+    for ( i = 0; i < Count; i++ )
+        HSPIRXRing[ ( HSPIRXHead + i ) & ( HSPIRXRingSize - 1 ) ] = Data[ 1 + i ];
+
+    HSPIRXHead+= Count;
+    HSPIChunksIn++;
+
+    HSPI_UpdateStatus( );
+}
+
+static void ICACHE_RAM_ATTR HSPI_OnDataSent( void ) {
+    if ( HSPIIsChunkLoaded )
+        HSPIChunksOut++;
+
+    HSPI_LoadChunk( );
+}
+
+static void HSPI_Begin( uint32_t Speed ) {
+    SPISlave.onData( HSPI_OnData );
+    SPISlave.onDataSent( HSPI_OnDataSent );
+    SPISlave.begin( );
+
+    noInterrupts( );
+    HSPI_LoadChunk( );
+    interrupts( );
+}
+
+static int HSPI_Read( uint8_t* Buffer, int Length ) {
+    uint32_t Count = HSPIRXHead - HSPIRXTail;
+    uint32_t i = 0;
+
+    if ( Count > ( uint32_t ) Length )
+        Count = Length;
+
+    for ( i = 0; i < Count; i++ )
+        Buffer[ i ] = HSPIRXRing[ ( HSPIRXTail + i ) & ( HSPIRXRingSize - 1 ) ];
+
+    if ( Count > 0 ) {
+        noInterrupts( );
+        HSPIRXTail+= Count;
+        HSPI_UpdateStatus( );
+        interrupts( );
+    }
+
+    return Count;
+}
+
+static int HSPI_WriteSpace( void ) {
+    return HSPITXRingSize - ( HSPITXHead - HSPITXTail );
+}
+
+static int HSPI_Write( const uint8_t* Data, int Length ) {
+    uint32_t Space = HSPI_WriteSpace( );
+    uint32_t i = 0;
+
+    if ( ( uint32_t ) Length > Space )
+        Length = Space;
+
+    for ( i = 0; i < ( uint32_t ) Length; i++ )
+        HSPITXRing[ ( HSPITXHead + i ) & ( HSPITXRingSize - 1 ) ] = Data[ i ];
+
+    /* Nothing waiting for the master means nothing will reload the registers for us */
+    noInterrupts( );
+    HSPITXHead+= Length;
+
+    if ( HSPIIsChunkLoaded == 0 )
+        HSPI_LoadChunk( );
+
+    interrupts( );
+
+    return Length;
+}
+
+/*
+ * The master only reads when it has somewhere to put the data,
+ * so anything that fits in the ring can go.
+ */
+static int HSPI_IsPeerReady( void ) {
+    return 1;
+}
+
+static void HSPI_SetReady( int IsReady ) {
+    if ( HSPIIsReady == IsReady )
+        return;
+
+    noInterrupts( );
+    HSPIIsReady = IsReady;
+    HSPI_UpdateStatus( );
+    interrupts( );
+}
+
+static void HSPI_DumpStats( void ) {
+    DebugPrintf( "%s: HSPI chunks in/out [%u,%u] / RX overruns %u / RX,TX waiting [%u,%u] / %s\n", __FUNCTION__,
+        HSPIChunksIn, HSPIChunksOut, HSPIRXOverruns, HSPIRXHead - HSPIRXTail, HSPITXHead - HSPITXTail, HSPIIsReady ? "Ready" : "Holding off" );
+}
+
+const struct SLIPTransport HSPITransport = {
+    "HSPI", HSPI_Begin, HSPI_Read, HSPI_Write, HSPI_WriteSpace, HSPI_IsPeerReady, HSPI_SetReady, HSPI_DumpStats
+};
+
+const struct SLIPTransport* SLIPLink = &HSPITransport;
+
+#else
+
+const struct SLIPTransport* SLIPLink = &UARTTransport;
+
+#endif
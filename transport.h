@@ -0,0 +1,63 @@
+#ifndef _TRANSPORT_H_
+#define _TRANSPORT_H_
+
+/*
+ * What the SLIP framing and queueing code talks to instead of a UART.
+ * Everything is non-blocking: Read and Write move what they can right now
+ * and return how many bytes that was, WriteSpace says how much Write would
+ * take, IsPeerReady is the other end's flow control and SetReady is ours.
+ *
+ * SLIPLink is the one in use. Plain C so the host side tools can provide
+ * their own (see tools/transport_fd.h) and run the same framing code.
+ */
+
+#include <stdint.h>
+
+/*
+ * Carry SLIP over the HSPI slave instead of UART0 (see transport.cpp).
+ * The SPI master clocks everything so the SLIPBaudRate bottleneck goes
+ * away, at the cost of GPIO 12-15 and a master that polls the status word.
+ */
+// #define SLIP_TRANSPORT_HSPI
+
+/* HSPI moves 32 bytes per transaction, the first is how many of the rest are data */
+#define HSPIChunkLen 32
+#define HSPIChunkDataLen ( HSPIChunkLen - 1 )
+
+/* Must be powers of two */
+#define HSPIRXRingSize 4096
+#define HSPITXRingSize 4096
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct SLIPTransport {
+    const char* Name;
+
+    void ( *Begin ) ( uint32_t Speed );
+
+    int ( *Read ) ( uint8_t* Buffer, int Length );
+    int ( *Write ) ( const uint8_t* Data, int Length );
+    int ( *WriteSpace ) ( void );
+
+    /* Flow control, whether the other end can take more and whether we can */
+    int ( *IsPeerReady ) ( void );
+    void ( *SetReady ) ( int IsReady );
+
+    void ( *DumpStats ) ( void );
+};
+
+extern const struct SLIPTransport* SLIPLink;
+
+extern const struct SLIPTransport UARTTransport;
+
+#if defined ( SLIP_TRANSPORT_HSPI )
+extern const struct SLIPTransport HSPITransport;
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
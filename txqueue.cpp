@@ -0,0 +1,252 @@
+#include <ESP8266WiFi.h>
+#include <lwip/netif.h>
+#include <lwip/err.h>
+#include <math.h>
+#include "ether.h"
+#include "ipv4.h"
+#include "util.h"
+#include "slip.h"
+#include "mydebug.h"
+#include "txqueue.h"
+
+#define IP_ECN_Mask 0x03
+#define IP_ECN_CE 0x03
+
+extern volatile int TXBytesDropped;
+
+static struct TXQueueEntry TXQueue[ TXQueueSlots ];
+static int TXQueueHead = 0;
+static int TXQueueLength = 0;
+static int TXQueueBytes = 0;
+
+static uint32_t CoDelTargetMS = TXQueueDefaultTargetMS;
+static uint32_t CoDelIntervalMS = TXQueueDefaultIntervalMS;
+
+/* CoDel state, see RFC 8289 */
+static uint32_t FirstAboveTime = 0;
+static uint32_t DropNext = 0;
+static uint32_t DropCount = 0;
+static uint32_t LastDropCount = 0;
+static int IsDropping = 0;
+
+static uint32_t TailDrops = 0;
+static uint32_t CoDelDrops = 0;
+static uint32_t CoDelMarks = 0;
+static uint32_t MaxSojournMS = 0;
+
+/*
+ * Adds a packet to the tail of the queue.
+ * Returns 0 if the queue is full or the packet is too big and it was dropped.
+ */
+int TXQueue_Enqueue( const uint8_t* Packet, int Length ) {
+    struct TXQueueEntry* Entry = NULL;
+
+    if ( TXQueueLength >= TXQueueSlots || Length > TXQueueMaxPacketLen ) {
+        TXBytesDropped+= Length;
+        TailDrops++;
+
+        return 0;
+    }
+
+    Entry = &TXQueue[ ( TXQueueHead + TXQueueLength ) % TXQueueSlots ];
+
+    memcpy( Entry->Buffer, Packet, Length );
+    Entry->Length = Length;
+    Entry->EnqueueTime = millis( );
+
+    TXQueueLength++;
+    TXQueueBytes+= Length;
+
+    return 1;
+}
+
+static struct TXQueueEntry* TXQueue_Pop( void ) {
+    struct TXQueueEntry* Entry = NULL;
+
+    if ( TXQueueLength > 0 ) {
+        Entry = &TXQueue[ TXQueueHead ];
+
+        TXQueueHead = ( TXQueueHead + 1 ) % TXQueueSlots;
+        TXQueueLength--;
+        TXQueueBytes-= Entry->Length;
+    }
+
+    return Entry;
+}
+
+/*
+ * Pops the head and works out whether the queue has been above target for
+ * a full interval (OkToDrop), this is dodequeue( ) from the RFC.
+ */
+static struct TXQueueEntry* CoDel_DoDequeue( uint32_t Now, int* OkToDrop ) {
+    struct TXQueueEntry* Entry = TXQueue_Pop( );
+    uint32_t Sojourn = 0;
+
+    *OkToDrop = 0;
+
+    if ( Entry == NULL ) {
+        FirstAboveTime = 0;
+        return NULL;
+    }
+
+    Sojourn = Now - Entry->EnqueueTime;
+
+    if ( Sojourn > MaxSojournMS )
+        MaxSojournMS = Sojourn;
+
+    /* Below target, or only about a packet's worth left: that's not a standing queue */
+    if ( Sojourn < CoDelTargetMS || TXQueueBytes <= TXQueueMaxPacketLen ) {
+        FirstAboveTime = 0;
+    } else if ( FirstAboveTime == 0 ) {
+        FirstAboveTime = Now + CoDelIntervalMS;
+    } else if ( ( int32_t ) ( Now - FirstAboveTime ) >= 0 ) {
+        *OkToDrop = 1;
+    }
+
+    return Entry;
+}
+
+static uint32_t CoDel_ControlLaw( uint32_t Time, uint32_t Count ) {
+    return Time + ( uint32_t ) ( CoDelIntervalMS / sqrtf( ( float ) Count ) );
+}
+
+/*
+ * Sets CE on an ECT capable IPv4 packet and fixes up the header checksum (RFC 1624).
+ * Returns 0 if the packet isn't ECN capable and has to be dropped instead.
+ */
+static int CoDel_MarkCE( struct TXQueueEntry* Entry ) {
+    uint8_t* IP = Entry->Buffer;
+    uint16_t OldWord = 0;
+    uint16_t NewWord = 0;
+    uint32_t Sum = 0;
+
+    if ( ! TXQueueUseECN || Entry->Length < ( int ) sizeof( struct ip_packet ) || ( IP[ 0 ] >> 4 ) != 4 )
+        return 0;
+
+    if ( ( IP[ 1 ] & IP_ECN_Mask ) == 0 )
+        return 0;
+
+    OldWord = ( IP[ 0 ] << 8 ) | IP[ 1 ];
+    IP[ 1 ]|= IP_ECN_CE;
+    NewWord = ( IP[ 0 ] << 8 ) | IP[ 1 ];
+
+    Sum = ( uint16_t ) ~( ( IP[ 10 ] << 8 ) | IP[ 11 ] );
+    Sum+= ( uint16_t ) ~OldWord;
+    Sum+= NewWord;
+    Sum = ( Sum & 0xFFFF ) + ( Sum >> 16 );
+    Sum = ( Sum & 0xFFFF ) + ( Sum >> 16 );
+    Sum = ( uint16_t ) ~Sum;
+
+    IP[ 10 ] = Sum >> 8;
+    IP[ 11 ] = Sum & 0xFF;
+
+    CoDelMarks++;
+    return 1;
+}
+
+/*
+ * Drops the packet unless it can be ECN marked, returns 1 if it was marked (and should be sent).
+ */
+static int CoDel_DropOrMark( struct TXQueueEntry* Entry ) {
+    if ( CoDel_MarkCE( Entry ) )
+        return 1;
+
+    TXBytesDropped+= Entry->Length;
+    CoDelDrops++;
+
+    return 0;
+}
+
+/*
+ * Takes the next packet to send off the head of the queue after applying CoDel.
+ * The returned entry is only valid until the next call to TXQueue_Enqueue.
+ * Returns NULL if there is nothing to send.
+ */
+struct TXQueueEntry* TXQueue_Dequeue( void ) {
+    struct TXQueueEntry* Entry = NULL;
+    uint32_t Now = millis( );
+    uint32_t Delta = 0;
+    int OkToDrop = 0;
+
+    Entry = CoDel_DoDequeue( Now, &OkToDrop );
+
+    if ( IsDropping ) {
+        if ( OkToDrop == 0 ) {
+            IsDropping = 0;
+        } else {
+            while ( Entry && IsDropping && ( int32_t ) ( Now - DropNext ) >= 0 ) {
+                DropCount++;
+
+                if ( CoDel_DropOrMark( Entry ) ) {
+                    DropNext = CoDel_ControlLaw( DropNext, DropCount );
+                    return Entry;
+                }
+
+                Entry = CoDel_DoDequeue( Now, &OkToDrop );
+
+                if ( OkToDrop == 0 )
+                    IsDropping = 0;
+                else
+                    DropNext = CoDel_ControlLaw( DropNext, DropCount );
+            }
+        }
+    } else if ( OkToDrop && Entry ) {
+        IsDropping = 1;
+
+        /* If we were dropping not long ago, pick up close to the old drop rate */
+        Delta = DropCount - LastDropCount;
+        DropCount = ( Delta > 1 && ( Now - DropNext ) < 16 * CoDelIntervalMS ) ? Delta : 1;
+        DropNext = CoDel_ControlLaw( Now, DropCount );
+        LastDropCount = DropCount;
+
+        if ( CoDel_DropOrMark( Entry ) == 0 )
+            Entry = CoDel_DoDequeue( Now, &OkToDrop );
+    }
+
+    return Entry;
+}
+
+/*
+ * Returns the number of packets waiting.
+ */
+int TXQueue_Count( void ) {
+    return TXQueueLength;
+}
+
+/*
+ * Empties the queue and resets the CoDel state and counters.
+ */
+void TXQueue_Reset( void ) {
+    TXQueueHead = 0;
+    TXQueueLength = 0;
+    TXQueueBytes = 0;
+
+    FirstAboveTime = 0;
+    DropNext = 0;
+    DropCount = 0;
+    LastDropCount = 0;
+    IsDropping = 0;
+
+    TailDrops = 0;
+    CoDelDrops = 0;
+    CoDelMarks = 0;
+    MaxSojournMS = 0;
+}
+
+/*
+ * Changes the CoDel target sojourn time and interval.
+ */
+void TXQueue_SetCoDelParams( uint32_t TargetMS, uint32_t IntervalMS ) {
+    CoDelTargetMS = TargetMS;
+    CoDelIntervalMS = IntervalMS;
+}
+
+/*
+ * Writes the queue and CoDel counters to the debug console.
+ */
+void TXQueue_DumpStats( void ) {
+    DebugPrintf( "%s: Queued %d/%d (%d bytes) / Tail drops %u / CoDel drops/marks [%u,%u] / Max sojourn %ums\n", __FUNCTION__,
+        TXQueueLength, TXQueueSlots, TXQueueBytes, TailDrops, CoDelDrops, CoDelMarks, MaxSojournMS );
+
+    MaxSojournMS = 0;
+}
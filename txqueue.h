@@ -0,0 +1,65 @@
+#ifndef _TXQUEUE_H_
+#define _TXQUEUE_H_
+
+/*
+ * Serial bound transmit queue with CoDel active queue management.
+ * Packets are timestamped on the way in, and on the way out CoDel looks
+ * at how long they sat in the queue (the sojourn time). If that stays above
+ * the target for a whole interval it starts dropping (or ECN marking
+ * packets that allow it) at an increasing rate until it comes back down,
+ * so TCP senders back off to what the serial line can actually carry.
+ */
+
+#define TXQueueSlots 6
+#define TXQueueMaxPacketLen 1500
+
+/*
+ * Defaults sized for 115200 baud where a full 1500 byte packet alone takes
+ * ~130ms to send, the target has to be at least a packet time or so.
+ */
+#define TXQueueDefaultTargetMS 50
+#define TXQueueDefaultIntervalMS 500
+
+/* Mark ECT capable packets with CE instead of dropping them */
+#define TXQueueUseECN 1
+
+struct TXQueueEntry {
+    uint8_t Buffer[ TXQueueMaxPacketLen ] __attribute__( ( aligned( 4 ) ) );
+    int Length;
+    uint32_t EnqueueTime;
+};
+
+/*
+ * Adds a packet to the tail of the queue.
+ * Returns 0 if the queue is full or the packet is too big and it was dropped.
+ */
+int TXQueue_Enqueue( const uint8_t* Packet, int Length );
+
+/*
+ * Takes the next packet to send off the head of the queue after applying CoDel.
+ * The returned entry is only valid until the next call to TXQueue_Enqueue.
+ * Returns NULL if there is nothing to send.
+ */
+struct TXQueueEntry* TXQueue_Dequeue( void );
+
+/*
+ * Returns the number of packets waiting.
+ */
+int TXQueue_Count( void );
+
+/*
+ * Empties the queue and resets the CoDel state and counters.
+ */
+void TXQueue_Reset( void );
+
+/*
+ * Changes the CoDel target sojourn time and interval.
+ */
+void TXQueue_SetCoDelParams( uint32_t TargetMS, uint32_t IntervalMS );
+
+/*
+ * Writes the queue and CoDel counters to the debug console.
+ */
+void TXQueue_DumpStats( void );
+
+#endif
@@ -48,3 +48,42 @@ int IsMACZero( uint8_t* MAC ) {
     return 1;
 }
 
+/*
+ * Computes the standard (IEEE 802.3) CRC32 of the given buffer.
+ */
+uint32_t CRC32( const uint8_t* Data, int Length ) {
+    uint32_t CRC = 0xFFFFFFFF;
+    int i = 0;
+    int j = 0;
+
+    for ( i = 0; i < Length; i++ ) {
+        CRC^= Data[ i ];
+
+        for ( j = 0; j < 8; j++ )
+            CRC = ( CRC >> 1 ) ^ ( 0xEDB88320 & ( 0 - ( CRC & 1 ) ) );
+    }
+
+    return ~CRC;
+}
+
+/*
+ * Fixes up a 16 bit ones complement checksum (stored in network byte order at Checksum)
+ * after a 32 bit field it covers changed from Old to New (RFC 1624).
+ */
+void Checksum_Replace32( uint8_t* Checksum, uint32_t Old, uint32_t New ) {
+    const uint8_t* o = ( const uint8_t* ) &Old;
+    const uint8_t* n = ( const uint8_t* ) &New;
+    uint32_t Sum = ( uint16_t ) ~( ( Checksum[ 0 ] << 8 ) | Checksum[ 1 ] );
+
+    Sum+= ( uint16_t ) ~( ( o[ 0 ] << 8 ) | o[ 1 ] );
+    Sum+= ( uint16_t ) ~( ( o[ 2 ] << 8 ) | o[ 3 ] );
+    Sum+= ( n[ 0 ] << 8 ) | n[ 1 ];
+    Sum+= ( n[ 2 ] << 8 ) | n[ 3 ];
+
+    Sum = ( Sum & 0xFFFF ) + ( Sum >> 16 );
+    Sum = ( Sum & 0xFFFF ) + ( Sum >> 16 );
+    Sum = ( uint16_t ) ~Sum;
+
+    Checksum[ 0 ] = Sum >> 8;
+    Checksum[ 1 ] = Sum & 0xFF;
+}
@@ -17,5 +17,16 @@ int IsMACBroadcast( uint8_t* MAC );
 /* Returns 1 if the given MAC address is a zero address (00:00:00:00:00:00) */
 int IsMACZero( uint8_t* MAC );
 
+/*
+ * Computes the standard (IEEE 802.3) CRC32 of the given buffer.
+ */
+uint32_t CRC32( const uint8_t* Data, int Length );
+
+/*
+ * Fixes up a 16 bit ones complement checksum (stored in network byte order at Checksum)
+ * after a 32 bit field it covers changed from Old to New (RFC 1624).
+ */
+void Checksum_Replace32( uint8_t* Checksum, uint32_t Old, uint32_t New );
+
 #endif
 
@@ -0,0 +1,116 @@
+#include <ESP8266WiFi.h>
+#include <lwip/netif.h>
+#include <lwip/err.h>
+#include "ether.h"
+#include "ipv4.h"
+#include "util.h"
+#include "slip.h"
+#include "mydebug.h"
+#include "warmstart.h"
+
+#define WarmStartCheckIntervalMS 1000
+
+extern const char* SSID;
+
+static struct WarmStartState CurrentState;
+
+/*
+ * Keyed on the SSID so reflashing with a different network configuration
+ * doesn't try to reuse a BSSID from somewhere else.
+ */
+static uint32_t WarmStart_ConfigKey( void ) {
+    return CRC32( ( const uint8_t* ) SSID, strlen( SSID ) );
+}
+
+static uint32_t WarmStart_CRC( const struct WarmStartState* State ) {
+    return CRC32( ( ( const uint8_t* ) State ) + sizeof( State->CRC ), sizeof( struct WarmStartState ) - sizeof( State->CRC ) );
+}
+
+static void WarmStart_Write( struct WarmStartState* State ) {
+    State->Magic = WarmStartMagic;
+    State->ConfigKey = WarmStart_ConfigKey( );
+    State->CRC = WarmStart_CRC( State );
+
+    ESP.rtcUserMemoryWrite( WarmStartRTCOffset, ( uint32_t* ) State, sizeof( struct WarmStartState ) );
+}
+
+/*
+ * Reads the warm start state from RTC memory.
+ * Returns 1 if it is valid for the current SSID, otherwise 0.
+ */
+int WarmStart_Load( struct WarmStartState* State ) {
+    if ( ESP.rtcUserMemoryRead( WarmStartRTCOffset, ( uint32_t* ) State, sizeof( struct WarmStartState ) ) == false )
+        return 0;
+
+    if ( State->Magic != WarmStartMagic || State->ConfigKey != WarmStart_ConfigKey( ) || State->CRC != WarmStart_CRC( State ) )
+        return 0;
+
+    if ( State->Channel == 0 || State->IPAddress == 0 )
+        return 0;
+
+    memcpy( &CurrentState, State, sizeof( CurrentState ) );
+    return 1;
+}
+
+/*
+ * Records the current BSSID, channel and IP configuration in RTC memory.
+ */
+void WarmStart_Save( void ) {
+    uint8_t* BSSID = WiFi.BSSID( );
+
+    if ( BSSID )
+        memcpy( CurrentState.BSSID, BSSID, MACAddressLen );
+
+    /* A different gateway means the MAC we have is for someone else */
+    if ( CurrentState.Gateway != ( uint32_t ) OurGateway )
+        CurrentState.HaveGatewayMAC = 0;
+
+    CurrentState.Channel = WiFi.channel( );
+    CurrentState.IPAddress = OurIPAddress;
+    CurrentState.Netmask = OurNetmask;
+    CurrentState.Gateway = OurGateway;
+
+    WarmStart_Write( &CurrentState );
+}
+
+/*
+ * Throws away the cached state, used when connecting with it fails.
+ */
+void WarmStart_Invalidate( void ) {
+    memset( &CurrentState, 0, sizeof( CurrentState ) );
+    ESP.rtcUserMemoryWrite( WarmStartRTCOffset, ( uint32_t* ) &CurrentState, sizeof( CurrentState ) );
+}
+
+/*
+ * Adds the cached gateway MAC to the ARP table so the first packets
+ * after a reboot don't have to wait on an ARP request.
+ */
+void WarmStart_SeedNeighbors( const struct WarmStartState* State ) {
+    if ( State->HaveGatewayMAC && State->Gateway == ( uint32_t ) OurGateway ) {
+        ARP_AddToTable( State->GatewayMAC, State->Gateway );
+        DebugPrintf( "%s: Seeded gateway MAC from RTC memory.\n", __FUNCTION__ );
+    }
+}
+
+/*
+ * Called every "frame" or run through the main loop.
+ * Saves the gateway MAC once it shows up in (or changes in) the ARP table.
+ */
+void WarmStart_Tick( void ) {
+    static uint32_t NextCheck = 0;
+    struct ARPEntry* Entry = NULL;
+    uint32_t Now = millis( );
+
+    if ( Now >= NextCheck ) {
+        NextCheck = Now + WarmStartCheckIntervalMS;
+
+        if ( ( Entry = ARP_FindEntryByIP( OurGateway ) ) != NULL ) {
+            if ( CurrentState.HaveGatewayMAC == 0 || memcmp( CurrentState.GatewayMAC, Entry->MACAddress, MACAddressLen ) != 0 ) {
+                memcpy( CurrentState.GatewayMAC, Entry->MACAddress, MACAddressLen );
+                CurrentState.HaveGatewayMAC = 1;
+
+                WarmStart_Write( &CurrentState );
+            }
+        }
+    }
+}
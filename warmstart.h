@@ -0,0 +1,61 @@
+#ifndef _WARMSTART_H_
+#define _WARMSTART_H_
+
+/*
+ * Warm start state kept in RTC user memory.
+ * It survives a watchdog/software reset (but not a cold power up) and lets us
+ * skip the WiFi scan and the first round of blocking ARP requests after a reboot.
+ */
+
+#define WarmStartMagic 0x534C5057
+#define WarmStartRTCOffset 0
+
+/* How long to try the cached BSSID/channel before falling back to a full scan */
+#define WarmStartConnectTimeoutMS 2000
+
+struct WarmStartState {
+    uint32_t CRC;
+    uint32_t Magic;
+    uint32_t ConfigKey;
+
+    uint32_t IPAddress;
+    uint32_t Netmask;
+    uint32_t Gateway;
+
+    uint8_t BSSID[ MACAddressLen ];
+    uint8_t GatewayMAC[ MACAddressLen ];
+
+    uint8_t Channel;
+    uint8_t HaveGatewayMAC;
+    uint8_t Pad[ 2 ];
+};
+
+/*
+ * Reads the warm start state from RTC memory.
+ * Returns 1 if it is valid for the current SSID, otherwise 0.
+ */
+int WarmStart_Load( struct WarmStartState* State );
+
+/*
+ * Records the current BSSID, channel and IP configuration in RTC memory.
+ */
+void WarmStart_Save( void );
+
+/*
+ * Throws away the cached state, used when connecting with it fails.
+ */
+void WarmStart_Invalidate( void );
+
+/*
+ * Adds the cached gateway MAC to the ARP table so the first packets
+ * after a reboot don't have to wait on an ARP request.
+ */
+void WarmStart_SeedNeighbors( const struct WarmStartState* State );
+
+/*
+ * Called every "frame" or run through the main loop.
+ * Saves the gateway MAC once it shows up in (or changes in) the ARP table.
+ */
+void WarmStart_Tick( void );
+
+#endif